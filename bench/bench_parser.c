@@ -0,0 +1,223 @@
+#include "../src/ast_free.h"
+#include "../src/parser.h"
+#include "../src/reparse.h"
+#include "../src/strpool.h"
+#include "../src/tokenizer.h"
+#include "../src/cvector.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/***
+ *  Parser stress benchmark
+ *    Generates programs that lean on one part of the shift/reduce loop each, then reports
+ *    how the front end scales with program size. Tokenizing happens up front and isn't timed,
+ *    only pctx_consume_token is.
+ *
+ *    Allocation counts come from wrapping malloc & co at link time (see build-bench in the Makefile),
+ *    so only allocations made by our own code are counted.
+ *
+ *    A second table changes one literal in the middle of each program and times the incremental
+ *    reparse (see src/reparse.h), which should stay flat as the program grows.
+ *
+ *    Usage: bench_parser [size...]        (default sizes: 1000 10000 100000)
+ */
+
+static size_t alloc_calls;
+static size_t alloc_bytes;
+
+void* __real_malloc(size_t);
+void* __real_calloc(size_t, size_t);
+void* __real_realloc(void*, size_t);
+
+void* __wrap_malloc(size_t n) {
+	alloc_calls++;
+	alloc_bytes += n;
+	return __real_malloc(n);
+}
+void* __wrap_calloc(size_t n, size_t size) {
+	alloc_calls++;
+	alloc_bytes += n * size;
+	return __real_calloc(n, size);
+}
+void* __wrap_realloc(void* p, size_t n) {
+	alloc_calls++;
+	alloc_bytes += n;
+	return __real_realloc(p, n);
+}
+
+typedef struct {
+	char*  data;
+	size_t length, capacity;
+} strbuf;
+
+static void sb_append(strbuf* sb, const char* s) {
+	size_t n = strlen(s);
+	if (sb->length + n + 1 > sb->capacity) {
+		sb->capacity = (sb->length + n + 1) * 2;
+		sb->data = realloc(sb->data, sb->capacity);
+	}
+	memcpy(sb->data + sb->length, s, n + 1);
+	sb->length += n;
+}
+
+// 1 2 + 3 + 4 + ...   (left-deep chain, the parse stack stays shallow)
+static void gen_eeo_left(strbuf* sb, int n) {
+	sb_append(sb, "1 ");
+	for (int i = 0; i < n; i++) sb_append(sb, "2 + ");
+	sb_append(sb, "println .\n");
+}
+
+// 1 1 1 ... + + + ... (right-deep chain, every operand waits on the parse stack)
+static void gen_eeo_right(strbuf* sb, int n) {
+	for (int i = 0; i <= n; i++) sb_append(sb, "1 ");
+	for (int i = 0; i < n; i++) sb_append(sb, "+ ");
+	sb_append(sb, "println .\n");
+}
+
+// if 1 { 1 . 1 . 1 . ... }   (one very wide block)
+static void gen_wide_block(strbuf* sb, int n) {
+	sb_append(sb, "if 1 {\n");
+	for (int i = 0; i < n; i++) sb_append(sb, "\t1 .\n");
+	sb_append(sb, "}\n");
+}
+
+// if 1 { if 1 { ... } }   (nested blocks)
+static void gen_nested_if(strbuf* sb, int n) {
+	for (int i = 0; i < n; i++) sb_append(sb, "if 1 { ");
+	for (int i = 0; i < n; i++) sb_append(sb, "} ");
+	sb_append(sb, "\n");
+}
+
+// 1 ; . ;; .. , ,, ...   (long runs of stack operators)
+static void gen_stack_ops(strbuf* sb, int n) {
+	sb_append(sb, "1 ");
+	for (int i = 0; i < n; i++) sb_append(sb, i % 2 ? ";; .. " : "; , . ,, ");
+	sb_append(sb, "\n");
+}
+
+typedef struct {
+	const char* name;
+	void (*gen)(strbuf*, int);
+} scenario;
+
+static scenario scenarios[] = {
+	{"eeo-left",   gen_eeo_left},
+	{"eeo-right",  gen_eeo_right},
+	{"wide-block", gen_wide_block},
+	{"nested-if",  gen_nested_if},
+	{"stack-ops",  gen_stack_ops},
+};
+
+static double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(scenario sc, int size) {
+	strbuf sb = {0};
+	sc.gen(&sb, size);
+
+	tokenizer_ctx tctx = tctx_from_cstr(sb.data);
+	cvector_vector_type(token) tokens = NULL;
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		cvector_push_back(tokens, tok);
+	}
+
+	parse_ctx pctx = pctx_new(100);
+	size_t calls_before = alloc_calls, bytes_before = alloc_bytes;
+	double start = now_seconds();
+	for (token* it = cvector_begin(tokens); it != cvector_end(tokens); it++) {
+		pctx_consume_token(&pctx, *it);
+	}
+	double elapsed = now_seconds() - start;
+	size_t calls = alloc_calls - calls_before, bytes = alloc_bytes - bytes_before;
+
+	size_t ntokens = cvector_size(tokens);
+	printf("%-12s %8d %9zu %11zu %12.0f %8d %12zu %9.2f\n",
+			sc.name, size, ntokens, pctx.stats.reductions,
+			elapsed > 0 ? pctx.stats.reductions / elapsed : 0.0,
+			pctx.stats.peak_depth, bytes, (double) calls / ntokens);
+
+	for (int i = 0; i < pctx.pstack.length; i++) {
+		ast_free_node(pctx.pstack.data[i]);
+	}
+	pctx_free(&pctx);
+	cvector_free(tokens);
+	tctx_free(&tctx);
+	free(sb.data);
+}
+
+static void run_reparse(scenario sc, int size) {
+	strbuf sb = {0};
+	sc.gen(&sb, size);
+	reparse_ctx rctx = rctx_new(sb.data);
+
+	int n = rctx_token_count(&rctx), at = -1;
+	for (int i = 0; i < n && at == -1; i++) {
+		if (rctx.tokens[(n / 2 + i) % n].type == T_DECIMAL_LIT) at = (n / 2 + i) % n;
+	}
+	size_t reductions = rctx.pctx.stats.reductions;
+	size_t calls_before = alloc_calls;
+	double start = now_seconds();
+	rctx_edit(&rctx, at, 1, "2");
+	double elapsed = now_seconds() - start;
+
+	printf("%-12s %8d %9d %11zu %12.6f %12zu\n",
+			sc.name, size, n, rctx.pctx.stats.reductions - reductions, elapsed, alloc_calls - calls_before);
+	rctx_free(&rctx);
+	free(sb.data);
+}
+
+typedef struct {
+	int argc;
+	char** argv;
+} bench_args;
+
+static void* bench_main(void* arg) {
+	bench_args* a = arg;
+	int argc = a->argc;
+	char** argv = a->argv;
+	int default_sizes[] = {1000, 10000, 100000};
+	int nsizes = argc > 1 ? argc - 1 : 3;
+
+	printf("%-12s %8s %9s %11s %12s %8s %12s %9s\n",
+			"scenario", "size", "tokens", "reductions", "reductions/s", "peak", "bytes", "mallocs/tok");
+	for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+		for (int i = 0; i < nsizes; i++) {
+			int size = argc > 1 ? atoi(argv[i + 1]) : default_sizes[i];
+			run(scenarios[s], size);
+		}
+	}
+
+	printf("\n%-12s %8s %9s %11s %12s %12s\n",
+			"reparse", "size", "tokens", "reductions", "seconds", "mallocs");
+	for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+		for (int i = 0; i < nsizes; i++) {
+			int size = argc > 1 ? atoi(argv[i + 1]) : default_sizes[i];
+			run_reparse(scenarios[s], size);
+		}
+	}
+	strpool_free();
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	// ASTs are freed recursively, so the deepest scenarios need far more than the default stack
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, (size_t) 1 << 30);
+	bench_args args = {argc, argv};
+	pthread_t thread;
+	if (pthread_create(&thread, &attr, bench_main, &args) != 0) {
+		fprintf(stderr, "Failed to start benchmark thread\n");
+		return 1;
+	}
+	pthread_join(thread, NULL);
+	return 0;
+}
@@ -0,0 +1,339 @@
+#include "array.h"
+#include "cvector.h"
+#include "sl_assert.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ARR_X86 1
+#endif
+
+// a*b+c stays two roundings even when the compiler may use FMA, the lanes don't fuse either
+#pragma GCC optimize("fp-contract=off")
+
+// Doubles are reduced in this many lanes, two AVX2 registers
+#define ARR_LANES 8
+
+static cvector_vector_type(array*) arrays;
+
+stack_node arr_new(size_t length, stack_node fill) {
+	array* a = malloc(sizeof(array));
+	sl_assert(a, "Out of memory making an array\n");
+	a->type = sn_type(fill);
+	a->length = length;
+	// 32 byte aligned, rounded up since aligned_alloc wants a multiple
+	size_t bytes = (length * (a->type == INTEGER ? sizeof(int32_t) : sizeof(double)) + 31) / 32 * 32;
+	a->ints = aligned_alloc(32, bytes ? bytes : 32);
+	sl_assert(a->ints, "Out of memory making an array of %zu\n", length);
+	for (size_t i = 0; i < length; i++) {
+		if (a->type == INTEGER) a->ints[i] = sn_int(fill);
+		else a->doubles[i] = sn_double(fill);
+	}
+	cvector_push_back(arrays, a);
+	return (stack_node) {SN_BOXED(ARRAY) | (uintptr_t) a};
+}
+
+stack_node arr_get(const array* a, size_t index) {
+	return a->type == INTEGER ? sn_from_int(a->ints[index]) : sn_from_double(a->doubles[index]);
+}
+
+bool arr_set(array* a, size_t index, stack_node v) {
+	if (a->type == INTEGER) {
+		if (!sn_is_int(v)) return false;
+		a->ints[index] = sn_int(v);
+	}
+	else if (sn_is_int(v)) a->doubles[index] = sn_int(v);
+	else if (sn_type(v) == DOUBLE) a->doubles[index] = sn_double(v);
+	else return false;
+	return true;
+}
+
+void arr_print(output_buf* out, const array* a) {
+	ob_char(out, '[');
+	for (size_t i = 0; i < a->length; i++) {
+		if (i) ob_write(out, SV(", "));
+		if (a->type == INTEGER) ob_int(out, a->ints[i]);
+		else ob_double(out, "%0.4f", a->doubles[i]);
+	}
+	ob_char(out, ']');
+}
+
+static stack_node arr_int64(int64_t v) {
+	return v >= INT32_MIN && v <= INT32_MAX ? sn_from_int((int) v) : sn_from_double((double) v);
+}
+
+// min and max the way _mm256_min_pd/_mm256_max_pd pick, so NaNs land the same in both
+static inline double arr_dmin(double a, double b) { return a < b ? a : b; }
+static inline double arr_dmax(double a, double b) { return a > b ? a : b; }
+
+// =================
+// Scalar
+// =================
+static int64_t scalar_sum_i(const int32_t* x, size_t n) {
+	int64_t s = 0;
+	for (size_t i = 0; i < n; i++) s += x[i];
+	return s;
+}
+
+static int64_t scalar_dot_i(const int32_t* x, const int32_t* y, size_t n) {
+	uint64_t s = 0;  // wraps instead of overflowing, like the lanes do
+	for (size_t i = 0; i < n; i++) s += (uint64_t) ((int64_t) x[i] * y[i]);
+	return (int64_t) s;
+}
+
+static int32_t scalar_min_i(const int32_t* x, size_t n) {
+	int32_t m = x[0];
+	for (size_t i = 1; i < n; i++) m = x[i] < m ? x[i] : m;
+	return m;
+}
+
+static int32_t scalar_max_i(const int32_t* x, size_t n) {
+	int32_t m = x[0];
+	for (size_t i = 1; i < n; i++) m = x[i] > m ? x[i] : m;
+	return m;
+}
+
+// The lanes fold as (0+4, 1+5, 2+6, 3+7), then (0+1) + (2+3), what the AVX2 code does
+static double fold_lanes(const double* l, double (*op)(double, double)) {
+	double s[4];
+	for (int j = 0; j < 4; j++) s[j] = op(l[j], l[j + 4]);
+	return op(op(s[0], s[1]), op(s[2], s[3]));
+}
+
+static double arr_dadd(double a, double b) { return a + b; }
+
+static double scalar_sum_d(const double* x, size_t n) {
+	double l[ARR_LANES] = {0};
+	size_t i = 0;
+	for (; i + ARR_LANES <= n; i += ARR_LANES) {
+		for (int j = 0; j < ARR_LANES; j++) l[j] += x[i + j];
+	}
+	double s = fold_lanes(l, arr_dadd);
+	for (; i < n; i++) s += x[i];
+	return s;
+}
+
+static double scalar_dot_d(const double* x, const double* y, size_t n) {
+	double l[ARR_LANES] = {0};
+	size_t i = 0;
+	for (; i + ARR_LANES <= n; i += ARR_LANES) {
+		for (int j = 0; j < ARR_LANES; j++) l[j] += x[i + j] * y[i + j];
+	}
+	double s = fold_lanes(l, arr_dadd);
+	for (; i < n; i++) s += x[i] * y[i];
+	return s;
+}
+
+static double scalar_pick_d(const double* x, size_t n, double (*op)(double, double)) {
+	double l[ARR_LANES];
+	for (int j = 0; j < ARR_LANES; j++) l[j] = x[0];
+	size_t i = 0;
+	for (; i + ARR_LANES <= n; i += ARR_LANES) {
+		for (int j = 0; j < ARR_LANES; j++) l[j] = op(l[j], x[i + j]);
+	}
+	double m = fold_lanes(l, op);
+	for (; i < n; i++) m = op(m, x[i]);
+	return m;
+}
+
+static double scalar_min_d(const double* x, size_t n) { return scalar_pick_d(x, n, arr_dmin); }
+static double scalar_max_d(const double* x, size_t n) { return scalar_pick_d(x, n, arr_dmax); }
+
+// =================
+// AVX2
+// =================
+#ifdef ARR_X86
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static int64_t hsum_epi64(__m256i v) {
+	int64_t l[4];
+	_mm256_storeu_si256((__m256i*) l, v);
+	return (int64_t) ((uint64_t) l[0] + l[1] + l[2] + l[3]);
+}
+
+AVX2 static int64_t avx2_sum_i(const int32_t* x, size_t n) {
+	__m256i a = _mm256_setzero_si256(), b = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		a = _mm256_add_epi64(a, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*) (x + i))));
+		b = _mm256_add_epi64(b, _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*) (x + i + 4))));
+	}
+	return hsum_epi64(_mm256_add_epi64(a, b)) + scalar_sum_i(x + i, n - i);
+}
+
+AVX2 static int64_t avx2_dot_i(const int32_t* x, const int32_t* y, size_t n) {
+	__m256i s = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) (x + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*) (y + i));
+		// mul_epi32 multiplies the even lanes, shifting brings the odd ones down
+		s = _mm256_add_epi64(s, _mm256_mul_epi32(a, b));
+		s = _mm256_add_epi64(s, _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)));
+	}
+	return (int64_t) ((uint64_t) hsum_epi64(s) + (uint64_t) scalar_dot_i(x + i, y + i, n - i));
+}
+
+AVX2 static int32_t avx2_min_i(const int32_t* x, size_t n) {
+	if (n < 8) return scalar_min_i(x, n);
+	__m256i m = _mm256_loadu_si256((const __m256i*) x);
+	size_t i = 8;
+	for (; i + 8 <= n; i += 8) m = _mm256_min_epi32(m, _mm256_loadu_si256((const __m256i*) (x + i)));
+	int32_t l[8];
+	_mm256_storeu_si256((__m256i*) l, m);
+	int32_t r = scalar_min_i(l, 8);
+	for (; i < n; i++) r = x[i] < r ? x[i] : r;
+	return r;
+}
+
+AVX2 static int32_t avx2_max_i(const int32_t* x, size_t n) {
+	if (n < 8) return scalar_max_i(x, n);
+	__m256i m = _mm256_loadu_si256((const __m256i*) x);
+	size_t i = 8;
+	for (; i + 8 <= n; i += 8) m = _mm256_max_epi32(m, _mm256_loadu_si256((const __m256i*) (x + i)));
+	int32_t l[8];
+	_mm256_storeu_si256((__m256i*) l, m);
+	int32_t r = scalar_max_i(l, 8);
+	for (; i < n; i++) r = x[i] > r ? x[i] : r;
+	return r;
+}
+
+AVX2 static void store_lanes(double* l, __m256d a, __m256d b) {
+	_mm256_storeu_pd(l, a);
+	_mm256_storeu_pd(l + 4, b);
+}
+
+AVX2 static double avx2_sum_d(const double* x, size_t n) {
+	__m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + ARR_LANES <= n; i += ARR_LANES) {
+		a = _mm256_add_pd(a, _mm256_loadu_pd(x + i));
+		b = _mm256_add_pd(b, _mm256_loadu_pd(x + i + 4));
+	}
+	double l[ARR_LANES];
+	store_lanes(l, a, b);
+	double s = fold_lanes(l, arr_dadd);
+	for (; i < n; i++) s += x[i];
+	return s;
+}
+
+AVX2 static double avx2_dot_d(const double* x, const double* y, size_t n) {
+	__m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + ARR_LANES <= n; i += ARR_LANES) {
+		a = _mm256_add_pd(a, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+		b = _mm256_add_pd(b, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+	}
+	double l[ARR_LANES];
+	store_lanes(l, a, b);
+	double s = fold_lanes(l, arr_dadd);
+	for (; i < n; i++) s += x[i] * y[i];
+	return s;
+}
+
+AVX2 static double avx2_min_d(const double* x, size_t n) {
+	__m256d a = _mm256_set1_pd(x[0]), b = a;
+	size_t i = 0;
+	for (; i + ARR_LANES <= n; i += ARR_LANES) {
+		a = _mm256_min_pd(a, _mm256_loadu_pd(x + i));
+		b = _mm256_min_pd(b, _mm256_loadu_pd(x + i + 4));
+	}
+	double l[ARR_LANES];
+	store_lanes(l, a, b);
+	double m = fold_lanes(l, arr_dmin);
+	for (; i < n; i++) m = arr_dmin(m, x[i]);
+	return m;
+}
+
+AVX2 static double avx2_max_d(const double* x, size_t n) {
+	__m256d a = _mm256_set1_pd(x[0]), b = a;
+	size_t i = 0;
+	for (; i + ARR_LANES <= n; i += ARR_LANES) {
+		a = _mm256_max_pd(a, _mm256_loadu_pd(x + i));
+		b = _mm256_max_pd(b, _mm256_loadu_pd(x + i + 4));
+	}
+	double l[ARR_LANES];
+	store_lanes(l, a, b);
+	double m = fold_lanes(l, arr_dmax);
+	for (; i < n; i++) m = arr_dmax(m, x[i]);
+	return m;
+}
+#endif
+
+// =================
+// Dispatch
+// =================
+typedef struct {
+	int64_t (*sum_i)(const int32_t*, size_t);
+	int64_t (*dot_i)(const int32_t*, const int32_t*, size_t);
+	int32_t (*min_i)(const int32_t*, size_t);
+	int32_t (*max_i)(const int32_t*, size_t);
+	double  (*sum_d)(const double*, size_t);
+	double  (*dot_d)(const double*, const double*, size_t);
+	double  (*min_d)(const double*, size_t);
+	double  (*max_d)(const double*, size_t);
+} arr_kernels;
+
+static const arr_kernels scalar = {
+	scalar_sum_i, scalar_dot_i, scalar_min_i, scalar_max_i,
+	scalar_sum_d, scalar_dot_d, scalar_min_d, scalar_max_d,
+};
+#ifdef ARR_X86
+static const arr_kernels avx2 = {
+	avx2_sum_i, avx2_dot_i, avx2_min_i, avx2_max_i,
+	avx2_sum_d, avx2_dot_d, avx2_min_d, avx2_max_d,
+};
+#endif
+
+static const arr_kernels* kernels;
+
+static const arr_kernels* arr_kernels_get() {
+	if (!kernels) arr_use_simd(true);
+	return kernels;
+}
+
+bool arr_simd() {
+	return arr_kernels_get() != &scalar;
+}
+
+void arr_use_simd(bool simd) {
+	kernels = &scalar;
+#ifdef ARR_X86
+	if (simd && __builtin_cpu_supports("avx2")) kernels = &avx2;
+#endif
+}
+
+stack_node arr_sum(const array* a) {
+	const arr_kernels* k = arr_kernels_get();
+	if (a->type == INTEGER) return arr_int64(k->sum_i(a->ints, a->length));
+	return sn_from_double(k->sum_d(a->doubles, a->length));
+}
+
+bool arr_min(const array* a, stack_node* out) {
+	if (a->length == 0) return false;
+	const arr_kernels* k = arr_kernels_get();
+	*out = a->type == INTEGER ? sn_from_int(k->min_i(a->ints, a->length)) : sn_from_double(k->min_d(a->doubles, a->length));
+	return true;
+}
+
+bool arr_max(const array* a, stack_node* out) {
+	if (a->length == 0) return false;
+	const arr_kernels* k = arr_kernels_get();
+	*out = a->type == INTEGER ? sn_from_int(k->max_i(a->ints, a->length)) : sn_from_double(k->max_d(a->doubles, a->length));
+	return true;
+}
+
+stack_node arr_dot(const array* a, const array* b) {
+	const arr_kernels* k = arr_kernels_get();
+	if (a->type == INTEGER) return arr_int64(k->dot_i(a->ints, b->ints, a->length));
+	return sn_from_double(k->dot_d(a->doubles, b->doubles, a->length));
+}
+
+void arr_free() {
+	for (size_t i = 0; i < cvector_size(arrays); i++) {
+		free(arrays[i]->ints);
+		free(arrays[i]);
+	}
+	cvector_free(arrays);
+	arrays = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+#include "interpreter.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Arrays
+ *    An ARRAY value points at one of these: a length and contiguous elements, all INTEGER
+ *    (32 bit, what an int value holds) or all DOUBLE. Copying the value shares the
+ *    elements, set changes them for every copy.
+ *    The reductions run over the elements directly, with AVX2 when the CPU has it (checked
+ *    once) and a scalar loop otherwise. Both add doubles in the same order, in 8 lanes,
+ *    so they give the same bits. Int sums and dots are exact in 64 bits, they're an
+ *    INTEGER when that fits and a DOUBLE when it doesn't.
+ *    Arrays live until arr_free, like the pool's entries.
+ */
+typedef struct array {
+	stack_node_type type;     // of the elements, INTEGER or DOUBLE
+	size_t          length;
+	union {
+		int32_t* ints;
+		double*  doubles;
+	};
+} array;
+
+static inline array* sn_array(stack_node v) { return (array*) (uintptr_t) (v.bits & SN_PAYLOAD); }
+
+// length copies of fill, an INTEGER or a DOUBLE
+stack_node arr_new(size_t length, stack_node fill);
+stack_node arr_get(const array*, size_t index);
+// an int goes into a double array as a double, a double can't go into an int array
+bool       arr_set(array*, size_t index, stack_node);
+
+stack_node arr_sum(const array*);
+// false for an empty array
+bool       arr_min(const array*, stack_node* out);
+bool       arr_max(const array*, stack_node* out);
+// same type and length
+stack_node arr_dot(const array*, const array*);
+
+// [1, 2, 3], doubles the way print prints them
+void       arr_print(output_buf*, const array*);
+
+// Whether the reductions use AVX2, which is only possible when the CPU has it
+bool arr_simd();
+void arr_use_simd(bool);
+void arr_free();
+
+#endif
@@ -21,27 +21,33 @@
  * 		operator       := <arith_op> 
  * 										| <logic_op>
  *    expression     := <expression> <expression> <operator> 
- *    								| <operator> 
+ *    								| <operator>                 (operands come from the data stack)
  *    								| <term> 
  *    								| <stack_op> 
  *    								| <procedure_call>
  *    procedure_call := <expression> <id>
  * 		procedure      := <id> <block>
  * 		statement  		 := <if> 
+ * 										| <while>
  * 										| <switch>
  * 		statements     := <statement> <statements> 
  * 		                | null
  * 		block          := '{' <statements> '}'
  *    if   					 := if <expression> <block>
- *
- *    -------- FUTURE ----------
- *    switch				 := switch <stack_op> <switch-block>
- * 		switch-case    := <term> ':' <expression>
- * 		switch-block   := <switch-case> <block>
+ *    while          := while <expression> <block>
+ *    switch				 := switch <expression> <switch-block>
+ * 		switch-case    := <term> ':' <block>
+ * 		                | <term> <expression>
+ * 		                | default ':' <block>
+ * 		                | default ':'                (last, does nothing)
+ * 		switch-block   := '{' <switch-cases> '}'
+ * 		switch-cases   := <switch-case> <switch-cases>
+ * 		                | null
  */
 
 #include "cvector.h"
 #include "sv.h"
+#include "strpool.h"
 #include "tokenizer.h"
 // These directly corrolate to the grammar above
 typedef enum TerminalType {
@@ -66,6 +72,15 @@ typedef enum OperatorType {
 	OPERATOR_TYPE_LOGIC,      // operator := <logic_op>
 	OPERATOR_TYPE_STACK			  // operator := <stack_op> ??
 } OperatorType;
+// What an operator does, resolved from the token when it's parsed
+typedef enum OperatorCode {
+	OPERATOR_CODE_UNDEFINED = 0,  // parsed, but nothing implements it (">=", "<=")
+	OPERATOR_CODE_ADD, OPERATOR_CODE_SUB, OPERATOR_CODE_MUL, OPERATOR_CODE_DIV, OPERATOR_CODE_MOD,
+	OPERATOR_CODE_GT, OPERATOR_CODE_LT,
+	OPERATOR_CODE_LAND, OPERATOR_CODE_LOR,
+	OPERATOR_CODE_EQ,
+	OPERATOR_CODE_COUNT
+} OperatorCode;
 typedef enum StackOpType {
 	STACK_OP_TYPE_COMMA_SEQ,
 	STACK_OP_TYPE_PERIOD_SEQ,
@@ -76,12 +91,14 @@ typedef enum ExpressionType {
 	EXPRESSION_TYPE_EEO,      // expression := <expression> <expression> <operator>
 	EXPRESSION_TYPE_TERM,     // expression := <term>
 	EXPRESSION_TYPE_STACK_OP, // expression := <stack_op>
+	EXPRESSION_TYPE_OPERATOR, // expression := <operator>
 } ExpressionType;
 typedef enum StatementType {
 	// STATEMENT_TYPE_EXPRESSION,   // statement := <expression>   // Not really
 	STATEMENT_TYPE_PROCEDURE_DEF,   // statement := <procedure_def>
 	// STATEMENT_TYPE_PROCEDURE_CALL,  // statement := <procedure_call>
 	STATEMENT_TYPE_IFF,             // statement := <iff>
+	STATEMENT_TYPE_WHILE,           // statement := <while>
 	STATEMENT_TYPE_SWITCH,          // statement := <switch>
 	STATEMENT_TYPE_CASE,            // statement := <case>
 	STATEMENT_TYPE_BLOCK            // statement := <block>
@@ -103,10 +120,12 @@ typedef struct Statement Statement;
 typedef struct StatementExpression StatementExpression;
 typedef struct ProcedureCall ProcedureCall;
 typedef struct Iff Iff;
+typedef struct While While;
 typedef struct Switch Switch;
 typedef struct SwitchCase SwitchCase;
 typedef struct Block Block;
 typedef struct SwitchBlock SwitchBlock;
+typedef struct sw_table sw_table;
 
 typedef enum AST_NodeType {
 	AST_NODE_TYPE_STACK_UNDERFLOW = -1,
@@ -143,6 +162,7 @@ struct Reserved {
 struct Operator {
 	tokenizer_state state;
 	OperatorType type;
+	OperatorCode code;
 	String_View op_str;
 };
 
@@ -152,7 +172,7 @@ struct Terminal {
 	union {
 		// Reserved reserved;
 		String_View id;
-		String_View str_lit;
+		const strpool_entry* str_lit;
 		String_View chr_lit;
 		int integer_lit;
 		double dbl_lit;
@@ -166,16 +186,20 @@ struct Term {
 	union {
 		int         _integer;
 		double      _double;
-		String_View _string;
+		const strpool_entry* _string;
 		String_View _ident;
 		String_View _chr;
 	};
 };
 
+struct interp_builtin;
 struct ProcedureCall {
 	tokenizer_state state;
 	String_View name;
 	int argumentCount;
+	const struct interp_builtin* builtin; // set by interp_builtin_link, NULL until then
+	const ProcedureDef*          proc;    //   or this, when the name is a procedure of the program
+	bool                         tail;    //   the last thing its procedure does, see ictx_call_proc
 };
 
 struct StackOp {
@@ -205,6 +229,9 @@ struct Expression {
 			Expression *left, *right;
 			Operator operation;
 		} EEO;
+		struct {
+			Operator operation;
+		} EOp;
 		struct {
 			ProcedureCall proc_call;
 		} EProcCall;
@@ -229,6 +256,7 @@ struct ProcedureDef {
 	String_View name;
 	cvector_vector_type(String_View) params;
 	Block block;
+	Expression* call;  // after an expression the name was already reduced to a call, this is it
 };
 
 struct Iff {
@@ -237,15 +265,27 @@ struct Iff {
 	Block block;
 };
 
+// Runs the block for as long as the condition leaves a nonzero integer, which it pops like an if does
+struct While {
+	tokenizer_state state;
+	Expression* expression;
+	Block block;
+	uint64_t iterations;  // how often the block ran, every engine counts them for --profile
+};
+
+// Pops what the expression leaves and runs the case with that value, or the default.
+// The cases are looked up in table (see switch.h), built when the switch is linked
 struct Switch {
 	tokenizer_state state;
-	Expression expr;
+	Expression* expression;
 	SwitchBlock block;
+	sw_table* table;
 };
 
 struct SwitchCase {
 	tokenizer_state state;
 	Term value;
+	bool is_default;
 	Block b;
 };
 
@@ -254,6 +294,7 @@ struct Statement {
 	tokenizer_state state;
 	union {
 		Iff iff;
+		While whilee;
 		Switch switchh;
 		ProcedureCall procCall;
 	};
@@ -3,6 +3,7 @@
 #include "cvector.h"
 #include "sl_assert.h"
 #include "sl_log.h"
+#include "switch.h"
 #include <stdio.h>
 
 int free_depth = 0;
@@ -29,10 +30,10 @@ void ast_free_node           (AST_Node n){
 	case AST_NODE_TYPE_PROCEDURE_DEF:  			ast_free_procedure_def(n.procDef); break;
 	case AST_NODE_TYPE_STATEMENT_EXPRESSION:ast_free_stmt_expr(n.stmtExpr); break;
 	// case AST_NODE_TYPE_PROCEDURE_CALL:      ast_free_procedure_call(n.procedureCall); break;
-	case AST_NODE_TYPE_SWITCH:  			      ast_free_switch(n.switchf); break; 
-	case AST_NODE_TYPE_CASE: 					      ast_free_switch_case(n.casef); break; 
+	case AST_NODE_TYPE_SWITCH:  			      ast_free_switch(n.switchf); free(n.switchf); break; 
+	case AST_NODE_TYPE_CASE: 					      ast_free_switch_case(n.casef); free(n.casef); break; 
 	case AST_NODE_TYPE_BLOCK: 				      ast_free_block(n.block); break; 
-	case AST_NODE_TYPE_SWITCH_BLOCK:        ast_free_switch_block(n.switchBlock); break;
+	case AST_NODE_TYPE_SWITCH_BLOCK:        ast_free_switch_block(n.switchBlock); free(n.switchBlock); break;
 	default:   												      assert(0 && "Unimplemented ast node type");
 	}
 }
@@ -89,7 +90,9 @@ void ast_free_expression     (Expression* n){
 			free(n);
 			break;
 		case EXPRESSION_TYPE_STACK_OP:
-			// Doesn't exist...
+		case EXPRESSION_TYPE_OPERATOR:
+			// Nothing owned besides the node itself
+			free(n);
 			break;
 	}
 	END_FREE_FUNC
@@ -97,14 +100,20 @@ void ast_free_expression     (Expression* n){
 void ast_free_statement      (Statement* n){
 	BEGIN_FREE_FUNC
 	switch (n->type) {
-		case STATEMENT_TYPE_IFF: ast_free_iff(n->iff);
+		case STATEMENT_TYPE_IFF: ast_free_iff(n->iff); break;
+		case STATEMENT_TYPE_WHILE: ast_free_while(n->whilee); break;
+		case STATEMENT_TYPE_SWITCH: ast_free_switch(&n->switchh); break;
 		default: break;
 	}
+	free(n);
 	END_FREE_FUNC
 }
 void ast_free_procedure_def  (ProcedureDef* n){
 	BEGIN_FREE_FUNC
-	sl_assert(0, "procedure_def free not implemented");
+	ast_free_block(n->block);
+	if (n->call) ast_free_expression(n->call);
+	cvector_free(n->params);
+	free(n);
 	END_FREE_FUNC
 }
 void ast_free_procedure_call (ProcedureCall* n){
@@ -118,14 +127,23 @@ void ast_free_iff            (Iff n){
 	ast_free_expression(n.expression);
 	END_FREE_FUNC
 }
+void ast_free_while          (While n){
+	BEGIN_FREE_FUNC
+	ast_free_block(n.block);
+	ast_free_expression(n.expression);
+	END_FREE_FUNC
+}
+// The three below free what they hold, not the struct itself, a Switch lives in its Statement
 void ast_free_switch         (Switch* n){
 	BEGIN_FREE_FUNC
-	sl_assert(0, "switch free not implemented");
+	ast_free_expression(n->expression);
+	ast_free_switch_block(&n->block);
+	sw_free(n->table);
 	END_FREE_FUNC
 }
 void ast_free_switch_case    (SwitchCase* n){
 	BEGIN_FREE_FUNC
-	sl_assert(0, "switch_case free not implemented");
+	ast_free_block(n->b);
 	END_FREE_FUNC
 }
 void ast_free_block   				(Block n){
@@ -138,6 +156,9 @@ void ast_free_block   				(Block n){
 }
 void ast_free_switch_block   (SwitchBlock* n){
 	BEGIN_FREE_FUNC
-	sl_assert(0, "switch block free not implemented");
+	for (SwitchCase* it = cvector_begin(n->cases); it != cvector_end(n->cases); it++) {
+		ast_free_switch_case(it);
+	}
+	cvector_free(n->cases);
 	END_FREE_FUNC
 }
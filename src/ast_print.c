@@ -7,33 +7,33 @@
 void ast_print_node_lite(AST_Node node) {
 	switch (node.nodeType) {
 		case AST_NODE_TYPE_UNDEFINED:
-			sl_log_ast("Lite: Undefined"); break;
+			sl_trace(SL_CAT_AST, "Lite: Undefined"); break;
 		case AST_NODE_TYPE_PROGRAM:
-			sl_log_ast("Lite: Program"); break;
+			sl_trace(SL_CAT_AST, "Lite: Program"); break;
 		case AST_NODE_TYPE_RESERVED:
-			sl_log_ast("Lite: Reserved: " SV_Fmt "\"", SV_Arg(node.reserved.token.text)); break;
+			sl_trace(SL_CAT_AST, "Lite: Reserved: " SV_Fmt "\"", SV_Arg(node.reserved.token.text)); break;
 		case AST_NODE_TYPE_TERMINAL:
-			sl_log_ast("Lite: Terminal"); break;
+			sl_trace(SL_CAT_AST, "Lite: Terminal"); break;
 		case AST_NODE_TYPE_TERM:
-			sl_log_ast("Lite: Term"); break;
+			sl_trace(SL_CAT_AST, "Lite: Term"); break;
 		case AST_NODE_TYPE_OPERATOR:
-			sl_log_ast("Lite: Operator"); break;
+			sl_trace(SL_CAT_AST, "Lite: Operator"); break;
 		case AST_NODE_TYPE_STATEMENT_EXPRESSION:
-			sl_log_ast("Lite: StatementExpression"); break;
+			sl_trace(SL_CAT_AST, "Lite: StatementExpression"); break;
 		case AST_NODE_TYPE_PROCEDURE_DEF:
-			sl_log_ast("Lite: ProcedureDef"); break;
+			sl_trace(SL_CAT_AST, "Lite: ProcedureDef"); break;
 		case AST_NODE_TYPE_PROCEDURE_CALL:
-			sl_log_ast("Lite: ProcedureCall"); break;
+			sl_trace(SL_CAT_AST, "Lite: ProcedureCall"); break;
 		case AST_NODE_TYPE_IFF:
-			sl_log_ast("Lite: Iff"); break;
+			sl_trace(SL_CAT_AST, "Lite: Iff"); break;
 		case AST_NODE_TYPE_SWITCH:
-			sl_log_ast("Lite: Switch"); break;
+			sl_trace(SL_CAT_AST, "Lite: Switch"); break;
 		case AST_NODE_TYPE_CASE:
-			sl_log_ast("Lite: Case"); break;
+			sl_trace(SL_CAT_AST, "Lite: Case"); break;
 		case AST_NODE_TYPE_BLOCK:
-			sl_log_ast("Lite: Block"); break;
+			sl_trace(SL_CAT_AST, "Lite: Block"); break;
 		case AST_NODE_TYPE_SWITCH_BLOCK:
-			sl_log_ast("Lite: SwitchBlock"); break;
+			sl_trace(SL_CAT_AST, "Lite: SwitchBlock"); break;
 	}
 }
 
@@ -75,7 +75,7 @@ void ast_print_terminal       (Terminal terminal, int depth) {
 		case TERMINAL_TYPE_DEC_LIT:    sl_log_ast(" |   DecLit = %d", terminal.integer_lit);                    break;
 		case TERMINAL_TYPE_DOUBLE_LIT: sl_log_ast(" |   DblLit = %.8f", terminal.dbl_lit);                      break;
 		case TERMINAL_TYPE_HEX_LIT:    sl_log_ast(" |   HexLit = 0x%X", terminal.integer_lit);                  break;
-		case TERMINAL_TYPE_STRING_LIT: sl_log_ast(" |   StrLit = " SV_Fmt, SV_Arg(terminal.str_lit));        break;
+		case TERMINAL_TYPE_STRING_LIT: sl_log_ast(" |   StrLit = " SV_Fmt, SV_Arg(STRPOOL_SV(terminal.str_lit)));        break;
 		case TERMINAL_TYPE_CHAR_LIT:   sl_log_ast(" |   ChrLit = " SV_Fmt, SV_Arg(terminal.chr_lit));        break;
 	}
 }
@@ -85,7 +85,7 @@ void ast_print_term           (Term term, int depth) {
 		case TERM_TYPE_DEC_LIT:    sl_log_ast("%*cDecLit = %d",         (depth + 1) * 2, ' ', term._integer); break;
 		case TERM_TYPE_DOUBLE_LIT: sl_log_ast("%*cDblLit = %.8f",       (depth + 1) * 2, ' ', term._double); break;
 		case TERM_TYPE_HEX_LIT:    sl_log_ast("%*cHexLit = 0x%X",       (depth + 1) * 2, ' ', term._integer); break;
-		case TERM_TYPE_STRING_LIT: sl_log_ast("%*cStrLit = " SV_Fmt "", (depth + 1) * 2, ' ', SV_Arg(term._string)); break;
+		case TERM_TYPE_STRING_LIT: sl_log_ast("%*cStrLit = " SV_Fmt "", (depth + 1) * 2, ' ', SV_Arg(STRPOOL_SV(term._string))); break;
 		case TERM_TYPE_CHR_LIT:    sl_log_ast("%*cChrLit = " SV_Fmt "", (depth + 1) * 2, ' ', SV_Arg(term._chr)); break;
 	}                                                                 
 }
@@ -131,6 +131,10 @@ void ast_print_expression     (Expression *expr, int depth) {
 			sl_log_ast("%*cExpression(StackOp): ", depth * 2, ' ');
 			ast_print_stackop(expr->stackOp, depth + 1);
 			break;
+		case EXPRESSION_TYPE_OPERATOR:
+			sl_log_ast("%*cExpression(Operator): ", depth * 2, ' ');
+			ast_print_operator(expr->EOp.operation, depth + 1);
+			break;
 		case EXPRESSION_TYPE_PROC_CALL:
 			sl_log_ast("%*cExpression(ProcCall): ", depth * 2, ' ');
 			ast_print_procedure_call(&expr->EProcCall.proc_call, depth + 1);
@@ -138,6 +142,9 @@ void ast_print_expression     (Expression *expr, int depth) {
 	}
 }
 void ast_print_procedure_def  (ProcedureDef *proc_def, int depth) {
+	sl_log_ast("%*cProcedureDef: ", depth * 2, ' ');
+	sl_log_ast("%*cName: " SV_Fmt "", (depth + 1) * 2, ' ', SV_Arg(proc_def->name));
+	ast_print_block(proc_def->block, depth + 1);
 }
 void ast_print_statement      (Statement *stmt, int depth) {
 	sl_log_ast("%*cStatement: ", depth * 2, ' ');
@@ -145,7 +152,8 @@ void ast_print_statement      (Statement *stmt, int depth) {
 		case STATEMENT_TYPE_PROCEDURE_DEF:  break;
 		// case STATEMENT_TYPE_PROCEDURE_CALL: break;
 		case STATEMENT_TYPE_IFF:            ast_print_iff(stmt->iff, depth+1); break;
-		case STATEMENT_TYPE_SWITCH:         break;
+		case STATEMENT_TYPE_WHILE:          ast_print_while(stmt->whilee, depth+1); break;
+		case STATEMENT_TYPE_SWITCH:         ast_print_switch(&stmt->switchh, depth+1); break;
 		case STATEMENT_TYPE_CASE:         	break;
 		case STATEMENT_TYPE_BLOCK:         	break;
 	}
@@ -161,9 +169,25 @@ void ast_print_iff            (Iff iff, int depth) {
 	ast_print_expression(iff.expression, depth + 1);
 	ast_print_block(iff.block, depth + 1);
 }
+void ast_print_while          (While whilee, int depth) {
+	sl_log_ast("%*cWhile: ", depth * 2, ' ');
+	ast_print_expression(whilee.expression, depth + 1);
+	ast_print_block(whilee.block, depth + 1);
+}
 void ast_print_switch         (Switch *sswitch, int depth) {
+	sl_log_ast("%*cSwitch: ", depth * 2, ' ');
+	ast_print_expression(sswitch->expression, depth + 1);
+	ast_print_switch_block(&sswitch->block, depth + 1);
 }
 void ast_print_switch_case    (SwitchCase *ccase, int depth) {
+	if (ccase->is_default) {
+		sl_log_ast("%*cDefault: ", depth * 2, ' ');
+	}
+	else {
+		sl_log_ast("%*cCase: ", depth * 2, ' ');
+		ast_print_term(ccase->value, depth + 1);
+	}
+	ast_print_block(ccase->b, depth + 1);
 }
 void ast_print_block   				(Block block, int depth) {
 	sl_log_ast("%*cBlock: [%lu]", depth * 2, ' ', cvector_size(block.items));
@@ -176,4 +200,8 @@ void ast_print_block   				(Block block, int depth) {
 	}
 }
 void ast_print_switch_block   (SwitchBlock *sw_block, int depth) {
+	sl_log_ast("%*cSwitchBlock: [%lu]", depth * 2, ' ', cvector_size(sw_block->cases));
+	for (SwitchCase* it = cvector_begin(sw_block->cases); it != cvector_end(sw_block->cases); it++) {
+		ast_print_switch_case(it, depth + 1);
+	}
 }
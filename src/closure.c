@@ -0,0 +1,383 @@
+#include "closure.h"
+#include "sl_assert.h"
+#include "sl_log.h"
+#include "switch.h"
+#include <stdlib.h>
+
+#define CL_CHUNK_NODES 256
+
+// =================
+// Handlers
+// =================
+static void cl_push(interpreter_ctx* ictx, const closure* c) {
+	ictx->stack[++ictx->stack_top] = c->constant;
+}
+
+static void cl_pop(interpreter_ctx* ictx, const closure* c) {
+	ictx->stack_top -= c->count;
+	if (ictx->stack_top < -1) ictx_pop_underflow();
+}
+
+static void cl_dup(interpreter_ctx* ictx, const closure* c) {
+	stack_node top = ictx->stack[ictx->stack_top];
+	for (int n = c->count; n > 0; n--) {
+		ictx->stack[++ictx->stack_top] = top;
+	}
+}
+
+static void cl_peek(interpreter_ctx* ictx, const closure* c) {
+	if (ictx->stack_top < c->count) ictx_pop_underflow();
+	stack_node n = ictx->stack[ictx->stack_top - c->count];
+	ictx->stack[++ictx->stack_top] = n;
+}
+
+static void cl_nop(interpreter_ctx* ictx, const closure* c) {
+	(void) ictx;
+	(void) c;
+}
+
+static void cl_seq(interpreter_ctx* ictx, const closure* c) {
+	for (size_t i = 0; i < c->seq.count; i++) {
+		c->seq.items[i].fn(ictx, &c->seq.items[i]);
+	}
+}
+
+static void cl_iff(interpreter_ctx* ictx, const closure* c) {
+	c->iff.cond->fn(ictx, c->iff.cond);
+	stack_node* top = &ictx->stack[ictx->stack_top];
+	if (sn_is_int(*top) && sn_int(*top) != 0) {
+		ictx->stack_top--;
+		c->iff.body->fn(ictx, c->iff.body);
+	}
+}
+
+static void cl_while(interpreter_ctx* ictx, const closure* c) {
+	for (;;) {
+		c->loop.cond->fn(ictx, c->loop.cond);
+		stack_node* top = &ictx->stack[ictx->stack_top];
+		if (!sn_is_int(*top) || sn_int(*top) == 0) break;
+		ictx->stack_top--;
+		(*c->loop.iterations)++;
+		c->loop.body->fn(ictx, c->loop.body);
+	}
+}
+
+static void cl_switch(interpreter_ctx* ictx, const closure* c) {
+	c->sw.value->fn(ictx, c->sw.value);
+	int i = sw_lookup(c->sw.table, ictx->stack[ictx->stack_top--]);
+	if (i >= 0) c->sw.cases[i].fn(ictx, &c->sw.cases[i]);
+}
+
+static void cl_native(interpreter_ctx* ictx, const closure* c) {
+	interp_builtin_call(ictx, c->builtin->id);
+}
+
+// Same loop as ictx_call_proc, a tail call leaves its body in tail_call
+static void cl_call(interpreter_ctx* ictx, const closure* c) {
+	if (ictx->call_depth == ICTX_CALL_DEPTH_MAX) ictx_call_overflow();
+	ictx->call_depth++;
+	const closure* body = c->proc;
+	while (body) {
+		ictx->tail_call = NULL;
+		body->fn(ictx, body);
+		body = ictx->tail_call;
+	}
+	ictx->call_depth--;
+}
+
+static void cl_tail_call(interpreter_ctx* ictx, const closure* c) {
+	ictx->tail_call = c->proc;
+}
+
+static void cl_bad_call(interpreter_ctx* ictx, const closure* c) {
+	(void) ictx;
+	sl_assert(0, "Proc call for '" SV_Fmt "' not implemented", SV_Arg(c->name));
+}
+
+static void cl_bad_operator(interpreter_ctx* ictx, const closure* c) {
+	(void) ictx;
+	sl_assert(0, "Undefined operation \"" SV_Fmt "\"\n", SV_Arg(c->name));
+}
+
+/**
+ *  Binary operators come in three shapes
+ *    cl_op_*      a bare operator, both operands are already on the stack
+ *    cl_eeo_*     'left right op'
+ *    cl_eeo_*_k   'left <int literal> op', the literal never touches the stack when left is an int
+ *  Integer operands are handled inline, anything else goes through ictx_apply_binary
+ */
+static void cl_op_generic(interpreter_ctx* ictx, const closure* c) {
+	ictx_apply_binary(ictx, c->binary.op);
+}
+
+static void cl_eeo_generic(interpreter_ctx* ictx, const closure* c) {
+	c->binary.left->fn(ictx, c->binary.left);
+	c->binary.right->fn(ictx, c->binary.right);
+	ictx_apply_binary(ictx, c->binary.op);
+}
+
+static void cl_eeo_generic_k(interpreter_ctx* ictx, const closure* c) {
+	c->binary.left->fn(ictx, c->binary.left);
+	ictx->stack[++ictx->stack_top] = sn_from_int(c->binary.k);
+	ictx_apply_binary(ictx, c->binary.op);
+}
+
+#define CL_INT_BINARY(name, expr) \
+	static inline void cl_apply_##name(interpreter_ctx* ictx, OperatorCode op) {\
+		stack_node* l = &ictx->stack[ictx->stack_top - 1];\
+		stack_node* r = &ictx->stack[ictx->stack_top];\
+		if (sn_is_int(*l) && sn_is_int(*r)) {\
+			int a = sn_int(*l), b = sn_int(*r);\
+			*l = sn_from_int(expr);\
+			ictx->stack_top--;\
+		}\
+		else {\
+			ictx_apply_binary(ictx, op);\
+		}\
+	}\
+	static void cl_op_##name(interpreter_ctx* ictx, const closure* c) {\
+		cl_apply_##name(ictx, c->binary.op);\
+	}\
+	static void cl_eeo_##name(interpreter_ctx* ictx, const closure* c) {\
+		c->binary.left->fn(ictx, c->binary.left);\
+		c->binary.right->fn(ictx, c->binary.right);\
+		cl_apply_##name(ictx, c->binary.op);\
+	}\
+	static void cl_eeo_##name##_k(interpreter_ctx* ictx, const closure* c) {\
+		c->binary.left->fn(ictx, c->binary.left);\
+		stack_node* l = &ictx->stack[ictx->stack_top];\
+		if (sn_is_int(*l)) {\
+			int a = sn_int(*l), b = c->binary.k;\
+			*l = sn_from_int(expr);\
+		}\
+		else {\
+			ictx->stack[++ictx->stack_top] = sn_from_int(c->binary.k);\
+			ictx_apply_binary(ictx, c->binary.op);\
+		}\
+	}
+
+CL_INT_BINARY(add,  a + b)
+CL_INT_BINARY(sub,  a - b)
+CL_INT_BINARY(mul,  a * b)
+CL_INT_BINARY(gt,   a > b)
+CL_INT_BINARY(lt,   a < b)
+CL_INT_BINARY(land, a && b)
+CL_INT_BINARY(lor,  a || b)
+CL_INT_BINARY(eq,   a == b)
+
+// '/' and '%' always take the generic path
+static const closure_fn cl_op_fns[OPERATOR_CODE_COUNT] = {
+	[OPERATOR_CODE_ADD] = cl_op_add, [OPERATOR_CODE_SUB] = cl_op_sub, [OPERATOR_CODE_MUL] = cl_op_mul,
+	[OPERATOR_CODE_DIV] = cl_op_generic, [OPERATOR_CODE_MOD] = cl_op_generic,
+	[OPERATOR_CODE_GT] = cl_op_gt, [OPERATOR_CODE_LT] = cl_op_lt,
+	[OPERATOR_CODE_LAND] = cl_op_land, [OPERATOR_CODE_LOR] = cl_op_lor,
+	[OPERATOR_CODE_EQ] = cl_op_eq,
+};
+static const closure_fn cl_eeo_fns[OPERATOR_CODE_COUNT] = {
+	[OPERATOR_CODE_ADD] = cl_eeo_add, [OPERATOR_CODE_SUB] = cl_eeo_sub, [OPERATOR_CODE_MUL] = cl_eeo_mul,
+	[OPERATOR_CODE_DIV] = cl_eeo_generic, [OPERATOR_CODE_MOD] = cl_eeo_generic,
+	[OPERATOR_CODE_GT] = cl_eeo_gt, [OPERATOR_CODE_LT] = cl_eeo_lt,
+	[OPERATOR_CODE_LAND] = cl_eeo_land, [OPERATOR_CODE_LOR] = cl_eeo_lor,
+	[OPERATOR_CODE_EQ] = cl_eeo_eq,
+};
+static const closure_fn cl_eeo_k_fns[OPERATOR_CODE_COUNT] = {
+	[OPERATOR_CODE_ADD] = cl_eeo_add_k, [OPERATOR_CODE_SUB] = cl_eeo_sub_k, [OPERATOR_CODE_MUL] = cl_eeo_mul_k,
+	[OPERATOR_CODE_DIV] = cl_eeo_generic_k, [OPERATOR_CODE_MOD] = cl_eeo_generic_k,
+	[OPERATOR_CODE_GT] = cl_eeo_gt_k, [OPERATOR_CODE_LT] = cl_eeo_lt_k,
+	[OPERATOR_CODE_LAND] = cl_eeo_land_k, [OPERATOR_CODE_LOR] = cl_eeo_lor_k,
+	[OPERATOR_CODE_EQ] = cl_eeo_eq_k,
+};
+
+// =================
+// Conversion
+// =================
+static closure* cl_alloc(closure_program* p, size_t n) {
+	closure_chunk* ch = p->chunks;
+	if (!ch || ch->cap - ch->used < n) {
+		size_t cap = n > CL_CHUNK_NODES ? n : CL_CHUNK_NODES;
+		ch = malloc(sizeof(closure_chunk) + cap * sizeof(closure));
+		sl_assert(ch, "Out of memory converting to closures");
+		ch->next = p->chunks;
+		ch->used = 0;
+		ch->cap = cap;
+		p->chunks = ch;
+	}
+	closure* c = ch->nodes + ch->used;
+	ch->used += n;
+	return c;
+}
+
+static void cl_build_stmt_expr(closure_program*, closure*, StatementExpression);
+
+static void cl_build_block(closure_program* p, closure* out, Block block) {
+	size_t count = cvector_size(block.items);
+	closure* items = cl_alloc(p, count);
+	for (size_t i = 0; i < count; i++) {
+		cl_build_stmt_expr(p, &items[i], block.items[i]);
+	}
+	*out = (closure) {.fn = cl_seq, .seq = {.items = items, .count = count}};
+}
+
+// The body is registered before it's converted, so a procedure that calls itself finds it
+static const closure* cl_proc_body(closure_program* p, const ProcedureDef* def) {
+	for (closure_proc* it = cvector_begin(p->procs); it != cvector_end(p->procs); it++) {
+		if (it->def == def) return it->body;
+	}
+	closure* body = cl_alloc(p, 1);
+	cvector_push_back(p->procs, ((closure_proc) {.def = def, .body = body}));
+	cl_build_block(p, body, def->block);
+	return body;
+}
+
+static void cl_build_expression(closure_program* p, closure* out, Expression* exp) {
+	switch (exp->type) {
+		case EXPRESSION_TYPE_TERM: {
+			Term t = exp->ETerm.term;
+			stack_node n = SN_UNDEFINED;
+			switch (t.type) {
+				case TERM_TYPE_HEX_LIT:
+				case TERM_TYPE_DEC_LIT:    n = sn_from_int(t._integer); break;
+				case TERM_TYPE_DOUBLE_LIT: n = sn_from_double(t._double); break;
+				case TERM_TYPE_STRING_LIT: n = ictx_string_from_pool(t._string); break;
+				case TERM_TYPE_CHR_LIT:    n = ictx_char_from_sv(t._chr); break;
+			}
+			*out = (closure) {.fn = cl_push, .constant = n};
+			break;
+		}
+		case EXPRESSION_TYPE_STACK_OP:
+			switch (exp->stackOp.type) {
+				case STACK_OP_TYPE_PERIOD_SEQ: *out = (closure) {.fn = cl_pop, .count = exp->stackOp.op.op_str.count}; break;
+				case STACK_OP_TYPE_SEMI_SEQ:   *out = (closure) {.fn = cl_dup, .count = exp->stackOp.op.op_str.count}; break;
+				case STACK_OP_TYPE_COMMA_SEQ:
+					if (exp->stackOp.op.op_str.count == 1) *out = (closure) {.fn = cl_nop};
+					else *out = (closure) {.fn = cl_peek, .count = exp->stackOp.op.op_str.count - 1};
+					break;
+			}
+			break;
+		case EXPRESSION_TYPE_PROC_CALL: {
+			const ProcedureCall* call = &exp->EProcCall.proc_call;
+			if (call->proc) {
+				*out = (closure) {.fn = call->tail ? cl_tail_call : cl_call, .proc = cl_proc_body(p, call->proc)};
+				break;
+			}
+			const interp_builtin* b = interp_builtin_resolve(call);
+			if (!b)
+				*out = (closure) {.fn = cl_bad_call, .name = exp->EProcCall.proc_call.name};
+			else
+				*out = (closure) {.fn = cl_native, .builtin = b};
+			break;
+		}
+		case EXPRESSION_TYPE_OPERATOR: {
+			String_View op_str = exp->EOp.operation.op_str;
+			OperatorCode o = exp->EOp.operation.code;
+			if (o == OPERATOR_CODE_UNDEFINED)
+				*out = (closure) {.fn = cl_bad_operator, .name = op_str};
+			else
+				*out = (closure) {.fn = cl_op_fns[o], .binary = {.op = o}};
+			break;
+		}
+		case EXPRESSION_TYPE_EEO: {
+			String_View op_str = exp->EEO.operation.op_str;
+			OperatorCode o = exp->EEO.operation.code;
+			if (o == OPERATOR_CODE_UNDEFINED) {
+				// both sides still run before it fails
+				closure* items = cl_alloc(p, 3);
+				cl_build_expression(p, &items[0], exp->EEO.left);
+				cl_build_expression(p, &items[1], exp->EEO.right);
+				items[2] = (closure) {.fn = cl_bad_operator, .name = op_str};
+				*out = (closure) {.fn = cl_seq, .seq = {.items = items, .count = 3}};
+				break;
+			}
+			Expression* right = exp->EEO.right;
+			if (right->type == EXPRESSION_TYPE_TERM &&
+					(right->ETerm.term.type == TERM_TYPE_DEC_LIT || right->ETerm.term.type == TERM_TYPE_HEX_LIT)) {
+				closure* left = cl_alloc(p, 1);
+				cl_build_expression(p, left, exp->EEO.left);
+				*out = (closure) {.fn = cl_eeo_k_fns[o], .binary = {.left = left, .k = right->ETerm.term._integer, .op = o}};
+				break;
+			}
+			closure* operands = cl_alloc(p, 2);
+			cl_build_expression(p, &operands[0], exp->EEO.left);
+			cl_build_expression(p, &operands[1], right);
+			*out = (closure) {.fn = cl_eeo_fns[o], .binary = {.left = &operands[0], .right = &operands[1], .op = o}};
+			break;
+		}
+	}
+}
+
+static void cl_build_stmt_expr(closure_program* p, closure* out, StatementExpression se) {
+	switch (se.type) {
+		case STATEMENT_EXPR_TYPE_EXPRESSION:
+			cl_build_expression(p, out, se.expr);
+			break;
+		case STATEMENT_EXPR_TYPE_STATEMENT: {
+			if (se.stmt->type == STATEMENT_TYPE_WHILE) {
+				While* w = &se.stmt->whilee;
+				closure* parts = cl_alloc(p, 2);
+				cl_build_expression(p, &parts[0], w->expression);
+				cl_build_block(p, &parts[1], w->block);
+				*out = (closure) {.fn = cl_while, .loop = {.cond = &parts[0], .body = &parts[1], .iterations = &w->iterations}};
+				break;
+			}
+			if (se.stmt->type == STATEMENT_TYPE_SWITCH) {
+				Switch* sw = &se.stmt->switchh;
+				size_t count = cvector_size(sw->block.cases);
+				closure* value = cl_alloc(p, 1);
+				closure* cases = cl_alloc(p, count);
+				cl_build_expression(p, value, sw->expression);
+				for (size_t i = 0; i < count; i++) {
+					cl_build_block(p, &cases[i], sw->block.cases[i].b);
+				}
+				*out = (closure) {.fn = cl_switch, .sw = {.value = value, .cases = cases, .table = sw->table}};
+				break;
+			}
+			if (se.stmt->type != STATEMENT_TYPE_IFF) {
+				*out = (closure) {.fn = cl_nop};
+				break;
+			}
+			closure* parts = cl_alloc(p, 2);
+			cl_build_expression(p, &parts[0], se.stmt->iff.expression);
+			cl_build_block(p, &parts[1], se.stmt->iff.block);
+			*out = (closure) {.fn = cl_iff, .iff = {.cond = &parts[0], .body = &parts[1]}};
+			break;
+		}
+	}
+}
+
+closure_program cl_compile_program(Program prog) {
+	closure_program p = {0};
+	// same as ictx_run_node, anything else left on the parse stack is ignored
+	size_t count = 0;
+	for (AST_Node* n = cvector_begin(prog.p); n != cvector_end(prog.p); n++) {
+		count += n->nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION;
+	}
+	closure* items = cl_alloc(&p, count);
+	size_t i = 0;
+	for (AST_Node* n = cvector_begin(prog.p); n != cvector_end(prog.p); n++) {
+		if (n->nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION)
+			cl_build_stmt_expr(&p, &items[i++], n->stmtExpr);
+	}
+	p.root = (closure) {.fn = cl_seq, .seq = {.items = items, .count = count}};
+	sl_debug(SL_CAT_INTERP, "converted %zu top-level nodes to closures", count);
+	return p;
+}
+
+closure_program cl_compile_node(AST_Node n) {
+	closure_program p = {0};
+	if (n.nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION)
+		cl_build_stmt_expr(&p, &p.root, n.stmtExpr);
+	else
+		p.root = (closure) {.fn = cl_nop};
+	return p;
+}
+
+void cl_free(closure_program* p) {
+	closure_chunk* ch = p->chunks;
+	while (ch) {
+		closure_chunk* next = ch->next;
+		free(ch);
+		ch = next;
+	}
+	cvector_free(p->procs);
+	*p = (closure_program) {0};
+}
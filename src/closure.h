@@ -0,0 +1,83 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+#include "ast.h"
+#include "interpreter.h"
+#include "interpreter_builtins.h"
+
+/**
+ *  Closure tree for the closure engine (--engine=closure)
+ *    The AST is converted once into nodes that each carry the function that runs them.
+ *    That function is already picked for the operator, and for 'expr <int literal> op'
+ *    the shape of the operands; calls hold their registry entry, or the converted body of
+ *    the procedure they call. So running the tree never compares a string or switches on
+ *    an expression type.
+ *    Each procedure is converted once per closure_program, the first time a call to it is.
+ *    Semantics match the tree walker (interpreter.c), quirks included, see compiler.h
+ */
+typedef struct closure closure;
+typedef void (*closure_fn)(interpreter_ctx*, const closure*);
+
+struct closure {
+	closure_fn fn;
+	union {
+		stack_node constant;                       // literals
+		int count;                                 // how long a '.' or ';' run is, how far below the top ',' peeks
+		String_View name;                          // whatever failed to resolve
+		const interp_builtin* builtin;
+		const closure* proc;                       // a procedure body, a seq
+		struct {
+			const closure* left;
+			const closure* right;                    // unused when the right operand is constant
+			int            k;                        //   then it's this
+			OperatorCode   op;
+		} binary;
+		struct {
+			const closure* items;
+			size_t         count;
+		} seq;                                     // blocks and the program itself
+		struct {
+			const closure* cond;
+			const closure* body;                     // a seq
+		} iff;
+		struct {
+			const closure* cond;
+			const closure* body;                     // a seq
+			uint64_t*      iterations;               // the While's own counter
+		} loop;
+		struct {
+			const closure*  value;
+			const closure*  cases;                  // a seq per case
+			const sw_table* table;
+		} sw;
+	};
+};
+
+// Nodes are carved out of fixed size chunks, so children stay put while the tree is built
+typedef struct closure_chunk {
+	struct closure_chunk* next;
+	size_t                used, cap;
+	closure               nodes[];
+} closure_chunk;
+
+typedef struct {
+	const ProcedureDef* def;
+	closure*            body;
+} closure_proc;
+
+typedef struct {
+	closure_chunk* chunks;
+	closure        root;
+	cvector_vector_type(closure_proc) procs;
+} closure_program;
+
+// cl_compile_node converts a single top-level node, for streaming mode
+closure_program cl_compile_program(Program);
+closure_program cl_compile_node(AST_Node);
+void            cl_free(closure_program*);
+
+static inline void cl_run(interpreter_ctx* ictx, const closure_program* p) {
+	ictx_enter(ictx);
+	p->root.fn(ictx, &p->root);
+}
+
+#endif
@@ -0,0 +1,554 @@
+#include "compiler.h"
+#include "interpreter_builtins.h"
+#include "sl_assert.h"
+#include "sl_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// cvector grows one element at a time, so keep doubling it ourselves
+#define BC_RESERVE(vec, n) \
+	do {\
+		size_t cap__ = cvector_capacity(vec);\
+		if (cap__ < (size_t) (n))\
+			cvector_grow((vec), (size_t) (n) > cap__ * 2 ? (size_t) (n) : cap__ * 2);\
+	} while (0)
+#define BC_PUSH(vec, v) \
+	do {\
+		BC_RESERVE((vec), cvector_size(vec) + 1);\
+		cvector_push_back((vec), (v));\
+	} while (0)
+
+static void bc_emit(bytecode* bc, bc_op op) {
+	BC_PUSH(bc->code, (uint8_t) op);
+}
+
+static size_t bc_emit_arg(bytecode* bc, bc_op op, int32_t arg) {
+	bc_emit(bc, op);
+	size_t at = cvector_size(bc->code);
+	BC_RESERVE(bc->code, at + sizeof(arg));
+	memcpy(bc->code + at, &arg, sizeof(arg));
+	cvector_set_size(bc->code, at + sizeof(arg));
+	return at;
+}
+
+static void bc_patch(bytecode* bc, size_t at, int32_t arg) {
+	memcpy(bc->code + at, &arg, sizeof(arg));
+}
+
+static int32_t bc_name(bytecode* bc, String_View name) {
+	BC_PUSH(bc->names, name);
+	return cvector_size(bc->names) - 1;
+}
+
+// =================
+// Types
+// =================
+static void bc_type_push(bytecode* bc, stack_node_type t) {
+	BC_PUSH(bc->types, t);
+}
+
+static stack_node_type bc_type_pop(bytecode* bc) {
+	if (cvector_empty(bc->types)) return UNDEFINED;
+	stack_node_type t = bc->types[cvector_size(bc->types) - 1];
+	cvector_pop_back(bc->types);
+	return t;
+}
+
+static stack_node_type bc_type_top(bytecode* bc) {
+	return cvector_empty(bc->types) ? UNDEFINED : bc->types[cvector_size(bc->types) - 1];
+}
+
+static void bc_types_forget(bytecode* bc) {
+	cvector_set_size(bc->types, 0);
+}
+
+static bc_op bc_typed_operator(OperatorCode code, stack_node_type l, stack_node_type r) {
+	if (l == INTEGER && r == INTEGER)
+		return BC_ADD_I + (code - OPERATOR_CODE_ADD);
+	if (l == DOUBLE && r == DOUBLE) {
+		switch (code) {
+			case OPERATOR_CODE_ADD: return BC_ADD_D;
+			case OPERATOR_CODE_SUB: return BC_SUB_D;
+			case OPERATOR_CODE_MUL: return BC_MUL_D;
+			case OPERATOR_CODE_DIV: return BC_DIV_D;
+			case OPERATOR_CODE_GT:  return BC_GT_D;
+			case OPERATOR_CODE_LT:  return BC_LT_D;
+			case OPERATOR_CODE_EQ:  return BC_EQ_D;
+			default: break;
+		}
+	}
+	return BC_ADD + (code - OPERATOR_CODE_ADD);
+}
+
+static int32_t bc_proc_index(bytecode* bc, const ProcedureDef* def) {
+	for (size_t i = 0; i < cvector_size(bc->procs); i++) {
+		if (bc->procs[i].def == def) return i;
+	}
+	BC_PUSH(bc->procs, ((bc_proc) {.def = def, .entry = -1}));
+	return cvector_size(bc->procs) - 1;
+}
+
+static void bc_compile_stmt_expr(bytecode*, StatementExpression);
+
+static void bc_compile_expression(bytecode* bc, Expression* exp) {
+	switch (exp->type) {
+		case EXPRESSION_TYPE_TERM: {
+			Term t = exp->ETerm.term;
+			switch (t.type) {
+				case TERM_TYPE_HEX_LIT:
+				case TERM_TYPE_DEC_LIT:
+					bc_emit_arg(bc, BC_PUSH_INT, t._integer);
+					bc_type_push(bc, INTEGER);
+					break;
+				case TERM_TYPE_DOUBLE_LIT:
+					BC_PUSH(bc->doubles, t._double);
+					bc_emit_arg(bc, BC_PUSH_DOUBLE, cvector_size(bc->doubles) - 1);
+					bc_type_push(bc, DOUBLE);
+					break;
+				case TERM_TYPE_STRING_LIT:
+					BC_PUSH(bc->strings, t._string);
+					bc_emit_arg(bc, BC_PUSH_STRING, cvector_size(bc->strings) - 1);
+					bc_type_push(bc, STRING);
+					break;
+				case TERM_TYPE_CHR_LIT:
+					bc_emit_arg(bc, BC_PUSH_CHAR, sn_char(ictx_char_from_sv(t._chr)));
+					bc_type_push(bc, CHAR);
+					break;
+			}
+			break;
+		}
+		case EXPRESSION_TYPE_STACK_OP: {
+			int n = exp->stackOp.op.op_str.count;
+			switch (exp->stackOp.type) {
+				case STACK_OP_TYPE_PERIOD_SEQ:
+					bc_emit_arg(bc, BC_POP, n);
+					for (int i = 0; i < n; i++) bc_type_pop(bc);
+					break;
+				case STACK_OP_TYPE_SEMI_SEQ: {
+					bc_emit_arg(bc, BC_DUP, n);
+					stack_node_type top = bc_type_top(bc);
+					for (int i = 0; i < n; i++) bc_type_push(bc, top);
+					break;
+				}
+				case STACK_OP_TYPE_COMMA_SEQ: {
+					if (n == 1) break;
+					size_t known = cvector_size(bc->types);
+					bc_emit_arg(bc, BC_PEEK, n - 1);
+					bc_type_push(bc, known >= (size_t) n ? bc->types[known - n] : UNDEFINED);
+					break;
+				}
+			}
+			break;
+		}
+		case EXPRESSION_TYPE_PROC_CALL: {
+			const ProcedureCall* call = &exp->EProcCall.proc_call;
+			if (call->proc) {
+				bc_emit_arg(bc, call->tail ? BC_JUMP : BC_CALL_PROC, bc_proc_index(bc, call->proc));
+				bc_types_forget(bc);
+				break;
+			}
+			const interp_builtin* b = interp_builtin_resolve(call);
+			if (!b) {
+				bc_emit_arg(bc, BC_BAD_CALL, bc_name(bc, exp->EProcCall.proc_call.name));
+				bc_types_forget(bc);
+				break;
+			}
+			bc_emit_arg(bc, BC_CALL, b->id);
+			// what a native leaves is unknown, unless it only looked
+			if (!b->inspects) {
+				for (int i = 0; i < b->in; i++) bc_type_pop(bc);
+				for (int i = 0; i < b->out; i++) bc_type_push(bc, UNDEFINED);
+			}
+			break;
+		}
+		case EXPRESSION_TYPE_EEO:
+			bc_compile_expression(bc, exp->EEO.left);
+			bc_compile_expression(bc, exp->EEO.right);
+			// fallthrough
+		case EXPRESSION_TYPE_OPERATOR: {
+			Operator op = exp->type == EXPRESSION_TYPE_EEO ? exp->EEO.operation : exp->EOp.operation;
+			stack_node_type r = bc_type_pop(bc), l = bc_type_pop(bc);
+			if (op.code == OPERATOR_CODE_UNDEFINED) {
+				bc_emit_arg(bc, BC_BAD_OPERATOR, bc_name(bc, op.op_str));
+				bc_type_push(bc, UNDEFINED);
+				break;
+			}
+			bc_emit(bc, bc_typed_operator(op.code, l, r));
+			bc_type_push(bc, ictx_binary_result_type(op.code, l, r));
+			break;
+		}
+	}
+}
+
+static void bc_compile_block(bytecode* bc, Block block) {
+	for (StatementExpression* it = cvector_begin(block.items); it != cvector_end(block.items); it++) {
+		bc_compile_stmt_expr(bc, *it);
+	}
+}
+
+static void bc_compile_statement(bytecode* bc, Statement* stmt) {
+	if (stmt->type == STATEMENT_TYPE_IFF) {
+		bc_compile_expression(bc, stmt->iff.expression);
+		size_t target = bc_emit_arg(bc, BC_BRANCH_FALSE, 0);
+		bc_type_pop(bc);
+		bc_compile_block(bc, stmt->iff.block);
+		bc_patch(bc, target, cvector_size(bc->code));
+		// two paths meet here
+		bc_types_forget(bc);
+	}
+	if (stmt->type == STATEMENT_TYPE_WHILE) {
+		// so do the way in and the back edge
+		bc_types_forget(bc);
+		int32_t head = cvector_size(bc->code);
+		bc_compile_expression(bc, stmt->whilee.expression);
+		size_t exit = bc_emit_arg(bc, BC_BRANCH_FALSE, 0);
+		bc_type_pop(bc);
+		bc_compile_block(bc, stmt->whilee.block);
+		BC_PUSH(bc->loops, ((bc_loop) {.def = &stmt->whilee, .head = head}));
+		bc_emit_arg(bc, BC_LOOP, cvector_size(bc->loops) - 1);
+		bc_patch(bc, exit, cvector_size(bc->code));
+		bc_types_forget(bc);
+	}
+	if (stmt->type == STATEMENT_TYPE_SWITCH) {
+		const Switch* sw = &stmt->switchh;
+		bc_compile_expression(bc, sw->expression);
+		bc_type_pop(bc);
+		// the cases can hold switches of their own, so this one is only referred to by index
+		size_t index = cvector_size(bc->switches);
+		BC_PUSH(bc->switches, ((bc_switch) {.def = sw}));
+		bc_emit_arg(bc, BC_SWITCH, index);
+		size_t count = cvector_size(sw->block.cases);
+		cvector_vector_type(size_t) ends = NULL;
+		for (size_t i = 0; i < count; i++) {
+			bc_types_forget(bc);
+			cvector_push_back(bc->switches[index].targets, cvector_size(bc->code));
+			bc_compile_block(bc, sw->block.cases[i].b);
+			if (i + 1 < count) cvector_push_back(ends, bc_emit_arg(bc, BC_GOTO, 0));
+		}
+		bc->switches[index].exit = cvector_size(bc->code);
+		for (size_t* it = cvector_begin(ends); it != cvector_end(ends); it++) {
+			bc_patch(bc, *it, bc->switches[index].exit);
+		}
+		cvector_free(ends);
+		bc_types_forget(bc);
+	}
+}
+
+static void bc_compile_stmt_expr(bytecode* bc, StatementExpression se) {
+	switch (se.type) {
+		case STATEMENT_EXPR_TYPE_EXPRESSION: bc_compile_expression(bc, se.expr); break;
+		case STATEMENT_EXPR_TYPE_STATEMENT:  bc_compile_statement(bc, se.stmt); break;
+	}
+}
+
+void bc_compile_node(bytecode* bc, AST_Node n) {
+	// same as ictx_run_node, anything else left on the parse stack is ignored
+	if (n.nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION) {
+		bc_compile_stmt_expr(bc, n.stmtExpr);
+	}
+}
+
+// =================
+// Peephole
+// =================
+typedef struct {
+	bc_op   op;
+	int32_t arg;
+} bc_insn;
+
+// the operand is an offset into the code
+static bool bc_is_jump(bc_op op) {
+	return op == BC_BRANCH_FALSE || op == BC_CALL_PROC || op == BC_JUMP || op == BC_GOTO;
+}
+
+static size_t bc_decode(const uint8_t* code, size_t pc, bc_insn* out) {
+	out->op = code[pc++];
+	out->arg = 0;
+	if (bc_has_arg(out->op)) {
+		memcpy(&out->arg, code + pc, sizeof(out->arg));
+		pc += sizeof(out->arg);
+	}
+	return pc;
+}
+
+// Rewrites the last instructions of out while they match a rule, never below floor
+static void bc_reduce(cvector_vector_type(bc_insn) out, size_t floor) {
+	while (cvector_size(out) >= floor + 2) {
+		size_t n = cvector_size(out);
+		bc_insn* a = &out[n - 2];
+		bc_insn* b = &out[n - 1];
+		if ((a->op == BC_POP || a->op == BC_DUP) && b->op == a->op) {
+			a->arg += b->arg;
+			cvector_erase(out, n - 1);
+		}
+		else if (a->op == BC_DUP && b->op == BC_POP) {
+			int32_t k = a->arg < b->arg ? a->arg : b->arg;
+			a->arg -= k;
+			b->arg -= k;
+			if (b->arg == 0) cvector_erase(out, n - 1);
+			if (a->arg == 0) cvector_erase(out, n - 2);
+		}
+		else if (a->op == BC_CALL && b->op == BC_POP && interp_builtin_get(a->arg)->out >= 1) {
+			a->op = BC_CALL_POP;
+			if (--b->arg == 0) cvector_erase(out, n - 1);
+		}
+		else if (a->op == BC_DUP && b->op == BC_CALL_POP && interp_builtin_get(b->arg)->inspects) {
+			b->op = BC_CALL;
+			if (--a->arg == 0) cvector_erase(out, n - 2);
+		}
+		else {
+			break;
+		}
+	}
+}
+
+static void bc_peephole(bytecode* bc) {
+	size_t size = cvector_size(bc->code);
+	// branch targets start a new run, nothing merges across one
+	bool*   target = calloc(size + 1, sizeof(bool));
+	size_t* index_of = calloc(size + 1, sizeof(size_t));
+	sl_assert(target && index_of, "Out of memory optimizing bytecode");
+	bc_insn in;
+	for (size_t pc = 0; pc < size; ) {
+		pc = bc_decode(bc->code, pc, &in);
+		if (bc_is_jump(in.op)) target[in.arg] = true;
+	}
+	for (bc_loop* it = cvector_begin(bc->loops); it != cvector_end(bc->loops); it++) {
+		target[it->head] = true;
+	}
+	for (bc_switch* it = cvector_begin(bc->switches); it != cvector_end(bc->switches); it++) {
+		for (int32_t* t = cvector_begin(it->targets); t != cvector_end(it->targets); t++) {
+			target[*t] = true;
+		}
+		target[it->exit] = true;
+	}
+
+	cvector_vector_type(bc_insn) out = NULL;
+	size_t floor = 0;
+	for (size_t pc = 0; pc < size; ) {
+		if (target[pc]) {
+			floor = cvector_size(out);
+			index_of[pc] = floor;
+		}
+		pc = bc_decode(bc->code, pc, &in);
+		// so is anything that jumps or returns
+		if (bc_is_jump(in.op) || in.op == BC_LOOP || in.op == BC_SWITCH || in.op == BC_RET || in.op == BC_HALT) {
+			cvector_push_back(out, in);
+			floor = cvector_size(out);
+			continue;
+		}
+		cvector_push_back(out, in);
+		bc_reduce(out, floor);
+	}
+	index_of[size] = cvector_size(out);
+
+	// re-encode, branches now point at instruction indices
+	size_t count = cvector_size(out);
+	size_t* offset = malloc((count + 1) * sizeof(size_t));
+	sl_assert(offset, "Out of memory optimizing bytecode");
+	size_t at = 0;
+	for (size_t i = 0; i < count; i++) {
+		offset[i] = at;
+		at += 1 + (bc_has_arg(out[i].op) ? sizeof(int32_t) : 0);
+	}
+	offset[count] = at;
+	for (bc_loop* it = cvector_begin(bc->loops); it != cvector_end(bc->loops); it++) {
+		it->head = offset[index_of[it->head]];
+	}
+	for (bc_switch* it = cvector_begin(bc->switches); it != cvector_end(bc->switches); it++) {
+		for (int32_t* t = cvector_begin(it->targets); t != cvector_end(it->targets); t++) {
+			*t = offset[index_of[*t]];
+		}
+		it->exit = offset[index_of[it->exit]];
+	}
+	cvector_set_size(bc->code, 0);
+	for (size_t i = 0; i < count; i++) {
+		if (!bc_has_arg(out[i].op))
+			bc_emit(bc, out[i].op);
+		else if (bc_is_jump(out[i].op))
+			bc_emit_arg(bc, out[i].op, offset[index_of[out[i].arg]]);
+		else
+			bc_emit_arg(bc, out[i].op, out[i].arg);
+	}
+	sl_debug(SL_CAT_INTERP, "peephole: %zu bytes down to %zu", size, at);
+
+	cvector_free(out);
+	free(offset);
+	free(index_of);
+	free(target);
+}
+
+void bc_compile_procs(bytecode* bc) {
+	if (cvector_empty(bc->procs)) return;
+	bc_emit(bc, BC_HALT);
+	// a body can call procedures nothing before it did, they're appended and compiled in turn
+	for (size_t i = 0; i < cvector_size(bc->procs); i++) {
+		bc->procs[i].entry = cvector_size(bc->code);
+		bc_types_forget(bc);
+		bc_compile_block(bc, bc->procs[i].def->block);
+		bc_emit(bc, BC_RET);
+	}
+	bc_types_forget(bc);
+
+	bc_insn in;
+	for (size_t pc = 0; pc < cvector_size(bc->code); ) {
+		size_t at = pc + 1;
+		pc = bc_decode(bc->code, pc, &in);
+		if (in.op == BC_CALL_PROC || in.op == BC_JUMP)
+			bc_patch(bc, at, bc->procs[in.arg].entry);
+	}
+}
+
+bytecode bc_compile_program(Program p) {
+	bytecode bc = {0};
+	for (AST_Node* n = cvector_begin(p.p); n != cvector_end(p.p); n++) {
+		bc_compile_node(&bc, *n);
+	}
+	bc_compile_procs(&bc);
+	bc_peephole(&bc);
+	sl_debug(SL_CAT_INTERP, "compiled %zu bytes of bytecode", cvector_size(bc.code));
+	return bc;
+}
+
+void bc_free(bytecode* bc) {
+	cvector_free(bc->code);
+	cvector_free(bc->doubles);
+	cvector_free(bc->strings);
+	cvector_free(bc->names);
+	cvector_free(bc->types);
+	cvector_free(bc->procs);
+	cvector_free(bc->loops);
+	for (bc_switch* it = cvector_begin(bc->switches); it != cvector_end(bc->switches); it++) {
+		cvector_free(it->targets);
+	}
+	cvector_free(bc->switches);
+	*bc = (bytecode) {0};
+}
+
+static const char* bc_op_str(bc_op op) {
+	switch (op) {
+		case BC_PUSH_INT:     return "PUSH_INT";
+		case BC_PUSH_DOUBLE:  return "PUSH_DOUBLE";
+		case BC_PUSH_STRING:  return "PUSH_STRING";
+		case BC_PUSH_CHAR:    return "PUSH_CHAR";
+		case BC_ADD:          return "ADD";
+		case BC_SUB:          return "SUB";
+		case BC_MUL:          return "MUL";
+		case BC_DIV:          return "DIV";
+		case BC_MOD:          return "MOD";
+		case BC_GT:           return "GT";
+		case BC_LT:           return "LT";
+		case BC_LAND:         return "LAND";
+		case BC_LOR:          return "LOR";
+		case BC_EQ:           return "EQ";
+		case BC_ADD_I:        return "ADD_I";
+		case BC_SUB_I:        return "SUB_I";
+		case BC_MUL_I:        return "MUL_I";
+		case BC_DIV_I:        return "DIV_I";
+		case BC_MOD_I:        return "MOD_I";
+		case BC_GT_I:         return "GT_I";
+		case BC_LT_I:         return "LT_I";
+		case BC_LAND_I:       return "LAND_I";
+		case BC_LOR_I:        return "LOR_I";
+		case BC_EQ_I:         return "EQ_I";
+		case BC_ADD_D:        return "ADD_D";
+		case BC_SUB_D:        return "SUB_D";
+		case BC_MUL_D:        return "MUL_D";
+		case BC_DIV_D:        return "DIV_D";
+		case BC_GT_D:         return "GT_D";
+		case BC_LT_D:         return "LT_D";
+		case BC_EQ_D:         return "EQ_D";
+		case BC_BAD_OPERATOR: return "BAD_OPERATOR";
+		case BC_POP:          return "POP";
+		case BC_DUP:          return "DUP";
+		case BC_PEEK:         return "PEEK";
+		case BC_CALL:         return "CALL";
+		case BC_CALL_POP:     return "CALL_POP";
+		case BC_BAD_CALL:     return "BAD_CALL";
+		case BC_BRANCH_FALSE: return "BRANCH_FALSE";
+		case BC_RET:          return "RET";
+		case BC_HALT:         return "HALT";
+		case BC_CALL_PROC:    return "CALL_PROC";
+		case BC_JUMP:         return "JUMP";
+		case BC_LOOP:         return "LOOP";
+		case BC_SWITCH:       return "SWITCH";
+		case BC_GOTO:         return "GOTO";
+	}
+	return "?";
+}
+
+void bc_disassemble(bytecode* bc) {
+	for (size_t pc = 0; pc < cvector_size(bc->code); ) {
+		bc_op op = bc->code[pc];
+		printf("%04zu  %-13s", pc, bc_op_str(op));
+		pc++;
+		int32_t arg;
+		switch (op) {
+			case BC_PUSH_INT:
+			case BC_POP:
+			case BC_DUP:
+			case BC_PEEK:
+			case BC_BRANCH_FALSE:
+			case BC_GOTO:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" %d", arg);
+				break;
+			case BC_PUSH_DOUBLE:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" %f", bc->doubles[arg]);
+				break;
+			case BC_PUSH_STRING:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" \"" SV_Fmt "\"", SV_Arg(STRPOOL_SV(bc->strings[arg])));
+				break;
+			case BC_PUSH_CHAR:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" '%c'", arg);
+				break;
+			case BC_BAD_OPERATOR:
+			case BC_BAD_CALL:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" " SV_Fmt, SV_Arg(bc->names[arg]));
+				break;
+			case BC_CALL:
+			case BC_CALL_POP:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" %s", interp_builtin_get(arg)->name);
+				break;
+			case BC_CALL_PROC:
+			case BC_JUMP:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" %d", arg);
+				for (bc_proc* it = cvector_begin(bc->procs); it != cvector_end(bc->procs); it++) {
+					if (it->entry == arg) printf(" (" SV_Fmt ")", SV_Arg(it->def->name));
+				}
+				break;
+			case BC_LOOP:
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				printf(" %d (while on line %d)", bc->loops[arg].head, bc->loops[arg].def->state.line + 1);
+				break;
+			case BC_SWITCH: {
+				memcpy(&arg, bc->code + pc, sizeof(arg));
+				pc += sizeof(arg);
+				const bc_switch* sw = &bc->switches[arg];
+				printf(" [");
+				for (size_t i = 0; i < cvector_size(sw->targets); i++) {
+					printf(i ? " %d" : "%d", sw->targets[i]);
+				}
+				printf("] else %d", sw->exit);
+				break;
+			}
+			default: break;
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,136 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+#include "ast.h"
+#include "cvector.h"
+#include "interpreter.h"
+#include "strpool.h"
+#include <stdint.h>
+
+/**
+ *  Bytecode for the vm engine (--engine=vm)
+ *    Each instruction is a one byte opcode, some followed by a 4 byte operand.
+ *    Operators and builtins are resolved while compiling, so running a program never
+ *    looks at op_str or a procedure name again.
+ *    Semantics match the tree walker (interpreter.c) exactly, quirks included:
+ *      + a run of n '.' pops n values, n ';' pushes n copies of the top
+ *      + a run of n ',' pushes a copy of the value n - 1 below the top (PEEK), a single ','
+ *        peeks the top, which is already there, so it isn't compiled at all
+ *      + an if only pops its condition when it's a nonzero integer
+ *      + unknown operators and procedures only fail once they're reached
+ *
+ *    bc_compile_program finishes with a peephole pass over straight-line runs (never across
+ *    a branch target):
+ *      + adjacent POPs and adjacent DUPs merge, 'DUP n POP m' cancels down
+ *      + 'CALL f POP' becomes 'CALL_POP f', so 'print .' is one instruction
+ *      + 'DUP CALL_POP f' becomes 'CALL f' when f only inspects the top, so does '; print .'
+ *    The one visible difference: a DUP that's cancelled can't underflow anymore.
+ *
+ *    Procedures are compiled after the top-level code, which then ends in HALT. A call pushes
+ *    its return address on the vm's return stack, a tail call is a plain JUMP and reuses
+ *    the frame it's in.
+ *
+ *    A while is its condition, a BRANCH_FALSE past the loop, the block, then a LOOP back to
+ *    the condition. Each engine runs it as a flat backward jump, and LOOP bumps the While's
+ *    iteration count on the way.
+ *
+ *    A switch is its expression, then SWITCH, which pops the value and jumps through the
+ *    switch's table (see switch.h) to the block of its case. Every case but the last ends in
+ *    a GOTO past the switch.
+ *
+ *    While compiling, the compiler also tracks what it knows about the types on top of the
+ *    stack (literals, and what operators on them produce). An operator whose operands are
+ *    known to be ints, or both doubles, gets a typed opcode that skips the tag checks.
+ *    Anything from a call, and everything after an if or at a loop's head or a case, is unknown.
+ */
+typedef enum {
+	BC_PUSH_INT,      // i32 value
+	BC_PUSH_DOUBLE,   // i32 index into doubles
+	BC_PUSH_STRING,   // i32 index into strings
+	BC_PUSH_CHAR,     // i32 character
+
+	// Same order as OperatorCode, see bc_binary_operator
+	BC_ADD, BC_SUB, BC_MUL, BC_DIV, BC_MOD,
+	BC_GT, BC_LT,
+	BC_LAND, BC_LOR,
+	BC_EQ,
+	// operands known to be ints, same order again
+	BC_ADD_I, BC_SUB_I, BC_MUL_I, BC_DIV_I, BC_MOD_I,
+	BC_GT_I, BC_LT_I,
+	BC_LAND_I, BC_LOR_I,
+	BC_EQ_I,
+	// operands known to be doubles
+	BC_ADD_D, BC_SUB_D, BC_MUL_D, BC_DIV_D,
+	BC_GT_D, BC_LT_D,
+	BC_EQ_D,
+	// no operand either
+	BC_RET,           // back to the address on top of the return stack
+	BC_HALT,          // the end of the top-level code, procedures follow it
+
+	BC_BAD_OPERATOR,  // i32 index into names
+
+	BC_POP,           // i32 count
+	BC_DUP,           // i32 count
+	BC_PEEK,          // i32 depth, pushes a copy of the value that far below the top
+
+	BC_CALL,          // i32 interp_builtin_id
+	BC_CALL_POP,      // i32 interp_builtin_id, then drops the top
+	BC_BAD_CALL,      // i32 index into names
+
+	BC_BRANCH_FALSE,  // i32 target. Falls through (popping the condition) on a nonzero integer
+	BC_CALL_PROC,     // i32 target, the start of a procedure
+	BC_JUMP,          // i32 target, a tail call
+	BC_LOOP,          // i32 index into loops, counts an iteration then jumps back to the loop's head
+	BC_SWITCH,        // i32 index into switches, pops the value and jumps to its case
+	BC_GOTO,          // i32 target, the end of a case
+} bc_op;
+
+#define bc_binary_operator(op) ((OperatorCode) ((op) - BC_ADD + OPERATOR_CODE_ADD))
+
+static inline bool bc_has_arg(bc_op op) {
+	return op < BC_ADD || op > BC_HALT;
+}
+
+// Procedures a compilation calls, entry is where each one starts once it's compiled
+typedef struct {
+	const ProcedureDef* def;
+	int32_t             entry;
+} bc_proc;
+
+// A while's back edge: where its condition starts, and the node whose iterations it counts
+typedef struct {
+	While*  def;
+	int32_t head;
+} bc_loop;
+
+// A switch's jump table: where each of its cases starts, and where the code after it does
+typedef struct {
+	const Switch*                 def;
+	cvector_vector_type(int32_t)  targets;
+	int32_t                       exit;
+} bc_switch;
+
+typedef struct {
+	cvector_vector_type(uint8_t)              code;
+	cvector_vector_type(double)               doubles;
+	cvector_vector_type(const strpool_entry*) strings;
+	cvector_vector_type(String_View)          names;  // the text of whatever failed to resolve
+	// until bc_compile_procs, CALL_PROC and JUMP hold an index into this instead of a target
+	cvector_vector_type(bc_proc)              procs;
+	cvector_vector_type(bc_loop)              loops;
+	cvector_vector_type(bc_switch)            switches;
+	// compile time only: the types on top of the stack where compilation is, UNDEFINED when
+	// unknown, and everything below them is unknown. Kept here so bc_compile_node can carry on
+	cvector_vector_type(stack_node_type)      types;
+} bytecode;
+
+// Compilation
+//   bc_compile_node appends one top-level node, so streaming mode can compile statement by statement.
+//   bc_compile_procs then appends the procedures that code calls, once, after the last node
+bytecode bc_compile_program(Program);
+void     bc_compile_node(bytecode*, AST_Node);
+void     bc_compile_procs(bytecode*);
+void     bc_free(bytecode*);
+
+void     bc_disassemble(bytecode*);
+
+#endif
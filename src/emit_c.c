@@ -0,0 +1,272 @@
+#include "emit_c.h"
+#include "interpreter.h"
+#include "interpreter_builtins.h"
+#include "sl_assert.h"
+#include "sl_log.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+static const char* emitc_operator_code[OPERATOR_CODE_COUNT] = {
+	[OPERATOR_CODE_ADD]  = "OPERATOR_CODE_ADD",  [OPERATOR_CODE_SUB] = "OPERATOR_CODE_SUB",
+	[OPERATOR_CODE_MUL]  = "OPERATOR_CODE_MUL",  [OPERATOR_CODE_DIV] = "OPERATOR_CODE_DIV",
+	[OPERATOR_CODE_MOD]  = "OPERATOR_CODE_MOD",
+	[OPERATOR_CODE_GT]   = "OPERATOR_CODE_GT",   [OPERATOR_CODE_LT]  = "OPERATOR_CODE_LT",
+	[OPERATOR_CODE_LAND] = "OPERATOR_CODE_LAND", [OPERATOR_CODE_LOR] = "OPERATOR_CODE_LOR",
+	[OPERATOR_CODE_EQ]   = "OPERATOR_CODE_EQ",
+};
+
+typedef struct {
+	FILE*                                     out;
+	int                                       depth;
+	cvector_vector_type(const strpool_entry*) strings;
+	cvector_vector_type(const ProcedureDef*)  procs;
+	cvector_vector_type(const Switch*)        switches;
+} emitc_ctx;
+
+// bytes as a C string literal, anything unusual escaped
+static void emitc_quoted(FILE* out, String_View sv) {
+	fputc('"', out);
+	for (size_t i = 0; i < sv.count; i++) {
+		unsigned char c = sv.data[i];
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20 || c >= 0x7F)
+			fprintf(out, "\\%03o", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+static void emitc_line(emitc_ctx* ctx, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void emitc_line(emitc_ctx* ctx, const char* fmt, ...) {
+	for (int i = 0; i < ctx->depth; i++) fputc('\t', ctx->out);
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(ctx->out, fmt, args);
+	va_end(args);
+	fputc('\n', ctx->out);
+}
+
+static size_t emitc_string(emitc_ctx* ctx, const strpool_entry* e) {
+	for (size_t i = 0; i < cvector_size(ctx->strings); i++) {
+		if (ctx->strings[i] == e) return i;
+	}
+	cvector_push_back(ctx->strings, e);
+	return cvector_size(ctx->strings) - 1;
+}
+
+// procedures are emitted after main, in the order their first call was found
+static size_t emitc_proc(emitc_ctx* ctx, const ProcedureDef* def) {
+	for (size_t i = 0; i < cvector_size(ctx->procs); i++) {
+		if (ctx->procs[i] == def) return i;
+	}
+	cvector_push_back(ctx->procs, def);
+	return cvector_size(ctx->procs) - 1;
+}
+
+static void emitc_operator(emitc_ctx* ctx, Operator op) {
+	if (op.code != OPERATOR_CODE_UNDEFINED) {
+		emitc_line(ctx, "rt_binary(ictx, %s);", emitc_operator_code[op.code]);
+		return;
+	}
+	for (int i = 0; i < ctx->depth; i++) fputc('\t', ctx->out);
+	fputs("rt_bad_operator(", ctx->out);
+	emitc_quoted(ctx->out, op.op_str);
+	fputs(");\n", ctx->out);
+}
+
+static void emitc_stmt_expr(emitc_ctx*, StatementExpression);
+
+static void emitc_expression(emitc_ctx* ctx, Expression* exp) {
+	switch (exp->type) {
+		case EXPRESSION_TYPE_TERM: {
+			Term t = exp->ETerm.term;
+			switch (t.type) {
+				case TERM_TYPE_HEX_LIT:
+				case TERM_TYPE_DEC_LIT:    emitc_line(ctx, "rt_push(ictx, sn_from_int(%d));", t._integer); break;
+				case TERM_TYPE_DOUBLE_LIT: emitc_line(ctx, "rt_push(ictx, sn_from_double(%a));", t._double); break;
+				case TERM_TYPE_STRING_LIT: emitc_line(ctx, "rt_push(ictx, strings[%zu]);", emitc_string(ctx, t._string)); break;
+				case TERM_TYPE_CHR_LIT:    emitc_line(ctx, "rt_push(ictx, sn_from_char(%d));", sn_char(ictx_char_from_sv(t._chr))); break;
+			}
+			break;
+		}
+		case EXPRESSION_TYPE_STACK_OP: {
+			size_t n = exp->stackOp.op.op_str.count;
+			switch (exp->stackOp.type) {
+				case STACK_OP_TYPE_PERIOD_SEQ: emitc_line(ctx, "rt_pop(ictx, %zu);", n); break;
+				case STACK_OP_TYPE_SEMI_SEQ:   emitc_line(ctx, "rt_dup(ictx, %zu);", n); break;
+				case STACK_OP_TYPE_COMMA_SEQ:  if (n > 1) emitc_line(ctx, "rt_peek(ictx, %zu);", n - 1); break;
+			}
+			break;
+		}
+		case EXPRESSION_TYPE_PROC_CALL: {
+			const ProcedureCall* call = &exp->EProcCall.proc_call;
+			if (call->proc) {
+				size_t i = emitc_proc(ctx, call->proc);
+				// a call in tail position is a sibling call, gcc -O2 turns it into a jump
+				if (call->tail)
+					emitc_line(ctx, "proc_%zu(ictx); return; // " SV_Fmt, i, SV_Arg(call->name));
+				else
+					emitc_line(ctx, "rt_enter(ictx); proc_%zu(ictx); rt_leave(ictx); // " SV_Fmt, i, SV_Arg(call->name));
+				break;
+			}
+			const interp_builtin* b = interp_builtin_resolve(&exp->EProcCall.proc_call);
+			if (b && b->id < INTERP_BUILTIN_COUNT) {
+				emitc_line(ctx, "interp_builtin_call(ictx, %d); // %s", b->id, b->name);
+				break;
+			}
+			String_View name = exp->EProcCall.proc_call.name;
+			emitc_line(ctx, "rt_bad_call(\"" SV_Fmt "\");", SV_Arg(name));
+			break;
+		}
+		case EXPRESSION_TYPE_OPERATOR:
+			emitc_operator(ctx, exp->EOp.operation);
+			break;
+		case EXPRESSION_TYPE_EEO:
+			emitc_expression(ctx, exp->EEO.left);
+			emitc_expression(ctx, exp->EEO.right);
+			emitc_operator(ctx, exp->EEO.operation);
+			break;
+	}
+}
+
+static void emitc_block(emitc_ctx* ctx, Block b) {
+	for (StatementExpression* it = cvector_begin(b.items); it != cvector_end(b.items); it++) {
+		emitc_stmt_expr(ctx, *it);
+	}
+}
+
+static void emitc_stmt_expr(emitc_ctx* ctx, StatementExpression se) {
+	if (se.type == STATEMENT_EXPR_TYPE_EXPRESSION) {
+		emitc_expression(ctx, se.expr);
+		return;
+	}
+	if (se.stmt->type == STATEMENT_TYPE_WHILE) {
+		emitc_line(ctx, "for (;;) {");
+		ctx->depth++;
+		emitc_expression(ctx, se.stmt->whilee.expression);
+		emitc_line(ctx, "if (!rt_branch(ictx)) break;");
+		emitc_block(ctx, se.stmt->whilee.block);
+		ctx->depth--;
+		emitc_line(ctx, "}");
+		return;
+	}
+	// the tables are built at startup, the cases are a C switch on the index the lookup gives
+	if (se.stmt->type == STATEMENT_TYPE_SWITCH) {
+		const Switch* sw = &se.stmt->switchh;
+		size_t index = cvector_size(ctx->switches);
+		cvector_push_back(ctx->switches, sw);
+		for (const SwitchCase* c = cvector_begin(sw->block.cases); c != cvector_end(sw->block.cases); c++) {
+			if (!c->is_default && c->value.type == TERM_TYPE_STRING_LIT) emitc_string(ctx, c->value._string);
+		}
+		emitc_expression(ctx, sw->expression);
+		emitc_line(ctx, "switch (rt_switch(ictx, switches[%zu])) {", index);
+		for (size_t i = 0; i < cvector_size(sw->block.cases); i++) {
+			emitc_line(ctx, "case %zu: {", i);
+			ctx->depth++;
+			emitc_block(ctx, sw->block.cases[i].b);
+			emitc_line(ctx, "break;");
+			ctx->depth--;
+			emitc_line(ctx, "}");
+		}
+		emitc_line(ctx, "}");
+		return;
+	}
+	if (se.stmt->type != STATEMENT_TYPE_IFF) return;
+	emitc_expression(ctx, se.stmt->iff.expression);
+	emitc_line(ctx, "if (rt_branch(ictx)) {");
+	ctx->depth++;
+	emitc_block(ctx, se.stmt->iff.block);
+	ctx->depth--;
+	emitc_line(ctx, "}");
+}
+
+// the same cases the linker built the switch's table from, in the same order
+static void emitc_switch_table(emitc_ctx* ctx, FILE* out, size_t index) {
+	const Switch* sw = ctx->switches[index];
+	size_t count = cvector_size(sw->block.cases);
+	if (count == 0) {
+		fprintf(out, "\tswitches[%zu] = sw_build(NULL, 0);\n", index);
+		return;
+	}
+	fprintf(out, "\tswitches[%zu] = sw_build((sw_case[]) {", index);
+	for (size_t i = 0; i < count; i++) {
+		const SwitchCase* c = &sw->block.cases[i];
+		fprintf(out, i ? ", " : "");
+		if (c->is_default) {
+			fprintf(out, "{.is_default = true}");
+			continue;
+		}
+		switch (c->value.type) {
+			case TERM_TYPE_HEX_LIT:
+			case TERM_TYPE_DEC_LIT:    fprintf(out, "{sn_from_int(%d)}", c->value._integer); break;
+			case TERM_TYPE_CHR_LIT:    fprintf(out, "{sn_from_char(%d)}", sn_char(ictx_char_from_sv(c->value._chr))); break;
+			case TERM_TYPE_STRING_LIT: fprintf(out, "{strings[%zu]}", emitc_string(ctx, c->value._string)); break;
+			case TERM_TYPE_DOUBLE_LIT: break;  // the linker doesn't let these through
+		}
+	}
+	fprintf(out, "}, %zu);\n", count);
+}
+
+void emitc_program(FILE* out, Program p, int max_depth, bool verified) {
+	// main and the procedures go to memory first, the string table and the prototypes
+	// in front of them are only known after
+	char*  body = NULL, *procs = NULL;
+	size_t body_size = 0, procs_size = 0;
+	emitc_ctx ctx = {.depth = 1};
+	ctx.out = open_memstream(&body, &body_size);
+	sl_assert(ctx.out, "Couldn't open a buffer for the C output\n");
+	for (AST_Node* n = cvector_begin(p.p); n != cvector_end(p.p); n++) {
+		// same as ictx_run_node, anything else left on the parse stack is ignored
+		if (n->nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION)
+			emitc_stmt_expr(&ctx, n->stmtExpr);
+	}
+	fclose(ctx.out);
+
+	// a body can find more procedures, so procs grows while this runs
+	ctx.out = open_memstream(&procs, &procs_size);
+	sl_assert(ctx.out, "Couldn't open a buffer for the C output\n");
+	for (size_t i = 0; i < cvector_size(ctx.procs); i++) {
+		fprintf(ctx.out, "\nstatic void proc_%zu(interpreter_ctx* ictx) { // " SV_Fmt "\n", i, SV_Arg(ctx.procs[i]->name));
+		emitc_block(&ctx, ctx.procs[i]->block);
+		fprintf(ctx.out, "}\n");
+	}
+	fclose(ctx.out);
+
+	size_t count = cvector_size(ctx.strings);
+	fprintf(out, "// Generated by spaz --emit-c, build with: gcc -O2 -Isrc prog.c out/libspaz.a -lm\n");
+	fprintf(out, "#include \"runtime.h\"\n\n");
+	if (count > 0)
+		fprintf(out, "static stack_node strings[%zu];\n", count);
+	if (!cvector_empty(ctx.switches))
+		fprintf(out, "static sw_table* switches[%zu];\n", cvector_size(ctx.switches));
+	for (size_t i = 0; i < cvector_size(ctx.procs); i++) {
+		fprintf(out, "static void proc_%zu(interpreter_ctx*);\n", i);
+	}
+	fprintf(out, "\nint main(void) {\n");
+	fprintf(out, "\tinterpreter_ctx* ictx = rt_start(%d, %s);\n", max_depth, verified ? "true" : "false");
+	for (size_t i = 0; i < count; i++) {
+		fprintf(out, "\tstrings[%zu] = rt_string(", i);
+		emitc_quoted(out, STRPOOL_SV(ctx.strings[i]));
+		fprintf(out, ", %zu);\n", ctx.strings[i]->length);
+	}
+	for (size_t i = 0; i < cvector_size(ctx.switches); i++) {
+		emitc_switch_table(&ctx, out, i);
+	}
+	fprintf(out, "\n");
+	fwrite(body, 1, body_size, out);
+	fprintf(out, "\n");
+	for (size_t i = 0; i < cvector_size(ctx.switches); i++) {
+		fprintf(out, "\tsw_free(switches[%zu]);\n", i);
+	}
+	fprintf(out, "\trt_finish(ictx);\n\treturn 0;\n}\n");
+	fwrite(procs, 1, procs_size, out);
+	sl_debug(SL_CAT_MAIN, "emitted C for %zu top-level nodes, %zu procedures, %zu strings", cvector_size(p.p), cvector_size(ctx.procs), count);
+
+	cvector_free(ctx.strings);
+	cvector_free(ctx.procs);
+	cvector_free(ctx.switches);
+	free(body);
+	free(procs);
+}
@@ -0,0 +1,20 @@
+#ifndef EMIT_C_H
+#define EMIT_C_H
+#include "ast.h"
+#include <stdio.h>
+
+/**
+ *  Translation to C (--emit-c)
+ *    Writes a C program that does what the parsed program does, one runtime call per
+ *    expression (see runtime.h), ifs become ifs, whiles for loops (without the iteration
+ *    counts, profile the C instead), switches C switches on the index their table gives
+ *    and procedures static functions. String literals are interned and the switch
+ *    tables built once at startup. max_depth sizes the stack, it comes from
+ *    vfy_program, 0 when recursion leaves it unbounded. verified drops the calls' depth
+ *    checks, only when vfy_program proved no path can underflow.
+ *    Calls are resolved the way the engines resolve them, host natives can't be in the
+ *    output and fail like an unknown procedure.
+ */
+void emitc_program(FILE*, Program, int max_depth, bool verified);
+
+#endif
@@ -0,0 +1,114 @@
+#include "heapstr.h"
+#include "strpool.h"
+#include "sl_assert.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool hs_due;
+
+static struct {
+	heapstr* all;
+	size_t   made;     // bytes since the last collection
+	size_t   kept;     // bytes the last collection kept
+	uint32_t epoch;    // the collection running, or the last one
+} heap;
+
+static size_t hs_size(const heapstr* h) {
+	return sizeof(heapstr) + (h->owner ? 0 : h->length + 1);
+}
+
+void hs_made(size_t bytes) {
+	heap.made += bytes;
+	if (heap.made > (heap.kept > HS_COLLECT_MIN ? heap.kept : HS_COLLECT_MIN)) hs_due = true;
+}
+
+void hs_kept(size_t bytes) {
+	heap.kept += bytes;
+}
+
+static heapstr* hs_make(size_t length, size_t room, uint32_t* owner) {
+	heapstr* h = malloc(sizeof(heapstr) + room);
+	sl_assert(h, "Out of memory making a string");
+	h->next = heap.all;
+	h->mark = 0;
+	h->hashed = false;
+	h->length = length;
+	h->bytes = h->data;
+	h->owner = owner;
+	heap.all = h;
+	hs_made(hs_size(h));
+	return h;
+}
+
+heapstr* hs_alloc(size_t length) {
+	return hs_make(length, length + 1, NULL);
+}
+
+void hs_finish(heapstr* h) {
+	h->data[h->length] = 0;
+}
+
+heapstr* hs_view(String_View sv, uint32_t* owner) {
+	heapstr* h = hs_make(sv.count, 0, owner);
+	h->bytes = sv.data;
+	return h;
+}
+
+uint64_t hs_hash(heapstr* h) {
+	if (!h->hashed) {
+		h->hash = strpool_hash(h->bytes, h->length);
+		h->hashed = true;
+	}
+	return h->hash;
+}
+
+heapstr* hs_new(String_View sv) {
+	heapstr* h = hs_alloc(sv.count);
+	memcpy(h->data, sv.data, sv.count);
+	hs_finish(h);
+	return h;
+}
+
+void hs_begin() {
+	heap.epoch++;
+	heap.made = heap.kept = 0;
+	hs_due = false;
+}
+
+bool hs_stamp(uint32_t* mark) {
+	if (*mark == heap.epoch) return false;
+	*mark = heap.epoch;
+	return true;
+}
+
+bool hs_stamped(uint32_t mark) {
+	return mark == heap.epoch;
+}
+
+void hs_mark(heapstr* h) {
+	h->mark = heap.epoch;
+	if (h->owner) *h->owner = heap.epoch;
+}
+
+void hs_sweep() {
+	for (heapstr** it = &heap.all; *it;) {
+		heapstr* h = *it;
+		if (h->mark == heap.epoch) {
+			heap.kept += hs_size(h);
+			it = &h->next;
+			continue;
+		}
+		*it = h->next;
+		free(h);
+	}
+}
+
+void hs_free() {
+	while (heap.all) {
+		heapstr* h = heap.all;
+		heap.all = h->next;
+		free(h);
+	}
+	heap.made = heap.kept = 0;
+	hs_due = false;
+}
@@ -0,0 +1,66 @@
+#ifndef HEAPSTR_H
+#define HEAPSTR_H
+#include "sv.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Heap strings, the long strings a program makes while it runs
+ *    What input reads is too long to go inline in a value more often than not, and unlike
+ *    a literal it's usually seen once. These get their own buffer with the length and hash
+ *    next to the bytes, instead of an entry in the pool (see strpool.h) that would stay
+ *    until the process ends. What input reads isn't copied even once: that string is a
+ *    view, pointing into the chunk of input it came from, which it keeps alive (see input.h).
+ *    The hash is worked out the first time something asks for it, a whole readall is
+ *    usually only printed or split.
+ *    They're freed by a collection: everything the stack of a live context reaches (see
+ *    ictx_collect) is marked, the rest freed, ropes too (see rope.h). One only starts at a
+ *    safe point, a builtin call or a binary operator, where every value the program holds
+ *    is on a stack. A value only C holds isn't seen, so a native keeps what it's working
+ *    on on the stack (see interpreter_builtins.h). It's due once the bytes made since the last one pass what that one kept
+ *    (HS_COLLECT_MIN at least), so the time spent collecting stays in proportion to
+ *    what's made.
+ */
+#define HS_COLLECT_MIN (1 << 20)
+
+typedef struct heapstr {
+	struct heapstr* next;      // every heap string, for the sweep
+	uint32_t        mark;      // the collection that last saw it
+	bool            hashed;
+	uint64_t        hash;      // see hs_hash
+	size_t          length;
+	const char*     bytes;     // data, or for a view what it points into
+	uint32_t*       owner;     // the mark of what a view points into, stamped with it
+	char            data[];    // NUL terminated, empty for a view
+} heapstr;
+
+#define HEAPSTR_SV(h) sv_from_parts((h)->bytes, (h)->length)
+
+// set once a collection is due, see hs_made
+extern bool hs_due;
+
+heapstr* hs_new(String_View);
+//   room for length bytes, write them to data then hs_finish
+heapstr* hs_alloc(size_t length);
+void     hs_finish(heapstr*);
+//   no copy, the bytes stay where they are for as long as whatever owner is the mark of
+heapstr* hs_view(String_View, uint32_t* owner);
+uint64_t hs_hash(heapstr*);
+void     hs_free();
+
+// A collection: hs_begin, then hs_mark on every heap string reachable (hs_stamp keeps
+// the walk from visiting anything twice), then hs_sweep frees the ones it missed
+void     hs_begin();
+//   true the first time it's called on a mark in this collection
+bool     hs_stamp(uint32_t* mark);
+//   whether this collection has stamped it
+bool     hs_stamped(uint32_t mark);
+void     hs_mark(heapstr*);
+void     hs_sweep();
+// Bytes of something else that's collected, made or kept, so they count towards the next
+// collection as well
+void     hs_made(size_t bytes);
+void     hs_kept(size_t bytes);
+
+#endif
@@ -0,0 +1,129 @@
+#include "input.h"
+#include "heapstr.h"
+#include "sl_assert.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static input_buf* stdin_buf;
+
+static in_chunk* in_chunk_new(input_buf* in, size_t size) {
+	in_chunk* c = malloc(sizeof(in_chunk) + size);
+	sl_assert(c, "Out of memory reading input, %zu bytes\n", size);
+	c->next = in->chunk;
+	c->mark = 0;
+	c->size = size;
+	in->chunk = c;
+	hs_made(sizeof(in_chunk) + size);
+	return c;
+}
+
+input_buf* in_new(int fd, size_t size) {
+	input_buf* in = calloc(1, sizeof(input_buf));
+	sl_assert(in, "Out of memory allocating the input buffer\n");
+	in->fd = fd;
+	in->size = size;
+	in_chunk_new(in, size);
+	return in;
+}
+
+void in_close(input_buf* in) {
+	while (in->chunk) {
+		in_chunk* c = in->chunk;
+		in->chunk = c->next;
+		free(c);
+	}
+	free(in);
+}
+
+input_buf* in_stdin() {
+	if (!stdin_buf) stdin_buf = in_new(STDIN_FILENO, IN_DEFAULT_SIZE);
+	return stdin_buf;
+}
+
+void in_free() {
+	if (!stdin_buf) return;
+	in_close(stdin_buf);
+	stdin_buf = NULL;
+}
+
+void in_sweep() {
+	if (!stdin_buf) return;
+	size_t kept = sizeof(in_chunk) + stdin_buf->chunk->size;
+	for (in_chunk** it = &stdin_buf->chunk->next; *it;) {
+		in_chunk* c = *it;
+		if (hs_stamped(c->mark)) {
+			kept += sizeof(in_chunk) + c->size;
+			it = &c->next;
+			continue;
+		}
+		*it = c->next;
+		free(c);
+	}
+	hs_kept(kept);
+}
+
+// Twice the size, a chunk nothing's been handed out from is still only the reader's
+static void in_grow(input_buf* in) {
+	in_chunk* c = realloc(in->chunk, sizeof(in_chunk) + in->chunk->size * 2);
+	sl_assert(c, "Out of memory reading input, %zu bytes\n", in->chunk->size * 2);
+	hs_made(c->size);
+	c->size *= 2;
+	in->chunk = c;
+}
+
+// Reads once more, into a new chunk when this one is full and lent. The unread part goes
+// to the front of that, it's twice as big when the unread part is already most of a chunk.
+// False at the end of the input
+static bool in_fill(input_buf* in) {
+	if (in->eof) return false;
+	if (in->end == in->chunk->size && !in->lent) in_grow(in);
+	else if (in->end == in->chunk->size) {
+		size_t left = in->end - in->start;
+		const char* from = in->chunk->data + in->start;
+		in_chunk* c = in_chunk_new(in, left * 2 > in->size ? left * 2 : in->size);
+		memcpy(c->data, from, left);
+		in->start = 0;
+		in->end = left;
+		in->lent = false;
+	}
+	ssize_t n;
+	do n = read(in->fd, in->chunk->data + in->end, in->chunk->size - in->end);
+	while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		in->eof = true;
+		return false;
+	}
+	in->end += n;
+	return true;
+}
+
+bool in_line(input_buf* in, String_View* out) {
+	size_t scanned = 0;   // past start, already looked at for a newline
+	for (;;) {
+		const char* from = in->chunk->data + in->start;
+		const char* nl = memchr(from + scanned, '\n', in->end - in->start - scanned);
+		if (nl) {
+			*out = sv_from_parts(from, nl - from);
+			in->start += nl - from + 1;
+			in->lent = true;
+			return true;
+		}
+		scanned = in->end - in->start;
+		if (!in_fill(in)) break;
+	}
+	if (in->start == in->end) return false;
+	*out = sv_from_parts(in->chunk->data + in->start, in->end - in->start);
+	in->start = in->end;
+	in->lent = true;
+	return true;
+}
+
+String_View in_all(input_buf* in) {
+	while (in_fill(in));
+	String_View all = sv_from_parts(in->chunk->data + in->start, in->end - in->start);
+	in->start = in->end;
+	in->lent = true;
+	return all;
+}
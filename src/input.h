@@ -0,0 +1,53 @@
+#ifndef INPUT_H
+#define INPUT_H
+#include "sv.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Program input
+ *    stdin is read with read(2) into chunks, so lines have no length limit and each one
+ *    costs a scan for its newline, not a call. A chunk never moves once something in it has
+ *    been handed out: when a line doesn't fit in what's left of one, its start is copied to a
+ *    new chunk (bigger, if the line is) and the old one stays where it is. Until then it
+ *    grows in place, so readall on input nothing has been read from yet is one buffer.
+ *    Lines and readall come back as views into a chunk that last as long as it does, input
+ *    and readall make strings that point into it rather than copies (see heapstr.h).
+ *    Chunks are collected like heap strings: one no string points into anymore is freed
+ *    by the next collection, except the one being read into.
+ *    stdin belongs to the whole process, so there's one reader for it, made on first use.
+ */
+#define IN_DEFAULT_SIZE (1 << 16)
+
+typedef struct in_chunk {
+	struct in_chunk* next;     // every chunk of the reader, for the sweep
+	uint32_t         mark;     // the last collection that saw a string in it
+	size_t           size;
+	char             data[];
+} in_chunk;
+
+typedef struct {
+	int       fd;
+	size_t    size;           // of a new chunk, unless a line needs more
+	in_chunk* chunk;          // the one being read into, the list of all of them
+	size_t    start, end;     // what's been read into it but not handed out yet
+	bool      lent;           // whether something before start has been
+	bool      eof;
+} input_buf;
+
+//   doesn't own the fd
+input_buf*  in_new(int fd, size_t size);
+void        in_close(input_buf*);
+input_buf*  in_stdin();
+void        in_free();
+//   frees the chunks of the stdin reader that the collection running didn't stamp
+void        in_sweep();
+
+// The next line without its newline, false once the input has ended.
+// A last line without a newline still counts. It's in in->chunk
+bool        in_line(input_buf*, String_View* out);
+// Everything left until the input ends, in one piece in in->chunk
+String_View in_all(input_buf*);
+
+#endif
@@ -1,9 +1,15 @@
 #include "interpreter.h"
 #include "interpreter_builtins.h"
+#include "interpreter_stack.h"
+#include "switch.h"
+#include "rope.h"
+#include "input.h"
+#include "array.h"
 #include "ast.h"
 #include "sl_log.h"
 #include "sv.h"
 #include <stdio.h>
+#include <unistd.h>
 #include "sl_assert.h"
 
 /***
@@ -11,79 +17,161 @@
  *  Making use of a symbol table in an interesting way could be handy for implementing function calls later on as well
  */
 
+// Every context that has run and hasn't been freed, a collection marks what all of their
+// stacks hold, see ictx_collect
+static cvector_vector_type(interpreter_ctx*) live;
+
 interpreter_ctx ictx_new() {
+	return ictx_new_sized(INTERP_STACK_DEFAULT_SLOTS);
+}
+
+interpreter_ctx ictx_new_sized(size_t stack_size) {
 	interpreter_ctx ctx = {0};
+	ctx.stack_size = stack_size;
+	ctx.stack = interp_stack_map(&ctx.stack_size);
 	ctx.stack_top = -1;
+	ctx.out = ob_new(STDOUT_FILENO, OB_DEFAULT_SIZE);
 	return ctx;
 }
 
+void ictx_free(interpreter_ctx* ictx) {
+	for (size_t i = 0; i < cvector_size(live); i++) {
+		if (live[i] != ictx) continue;
+		cvector_erase(live, i);
+		break;
+	}
+	ob_free(ictx->out);
+	ictx->out = NULL;
+	if (!ictx->stack) return;
+	interp_stack_unmap(ictx->stack, ictx->stack_size);
+	ictx->stack = NULL;
+}
+
 const char* ictx_stack_node_type_to_str(stack_node_type type) {
 	switch(type) {
 		case INTEGER:   return "INTEGER";
 		case DOUBLE:    return "DOUBLE";
 		case CHAR:      return "CHAR";
 		case STRING:    return "STRING";
-		case STACK_OP:  return "STACKOP";
+		case ARRAY:     return "ARRAY";
 		case UNDEFINED: return "UNDEFINED";
 	}
+	return "?";
+}
+
+stack_node ictx_string_from_sv(String_View sv) {
+	// copied into the value or the pool, so it outlives whatever buffer sv points into
+	if (sv.count > SN_STRING_INLINE_MAX)
+		return (stack_node) {SN_BOXED(STRING) | (uintptr_t) strpool_intern(sv)};
+	uint64_t bits = SN_BOXED(STRING) | SN_STRING_INLINE | (uint64_t) sv.count << SN_STRING_LENGTH_SHIFT;
+	for (size_t i = 0; i < sv.count; i++)
+		bits |= (uint64_t) (unsigned char) sv.data[i] << (8 * i);
+	return (stack_node) {bits};
+}
+
+stack_node ictx_string_from_pool(const strpool_entry* e) {
+	if (e->length <= SN_STRING_INLINE_MAX)
+		return ictx_string_from_sv(STRPOOL_SV(e));
+	return (stack_node) {SN_BOXED(STRING) | (uintptr_t) e};
+}
+
+stack_node ictx_string_new(String_View sv) {
+	if (sv.count <= SN_STRING_INLINE_MAX)
+		return ictx_string_from_sv(sv);
+	return (stack_node) {SN_BOXED(STRING) | (uintptr_t) hs_new(sv) | SN_STRING_HEAP};
+}
+
+stack_node ictx_string_view(String_View sv, uint32_t* owner) {
+	if (sv.count <= SN_STRING_INLINE_MAX)
+		return ictx_string_from_sv(sv);
+	return (stack_node) {SN_BOXED(STRING) | (uintptr_t) hs_view(sv, owner) | SN_STRING_HEAP};
+}
+
+bool ictx_string_eq(stack_node l, stack_node r) {
+	if (l.bits == r.bits) return true;
+	// inline and interned strings are only ever stored the one way
+	if (!sn_is_rope(l) && !sn_is_heapstr(l) && !sn_is_rope(r) && !sn_is_heapstr(r)) return false;
+	if (sn_is_heapstr(l) && sn_is_heapstr(r) && hs_hash(sn_heapstr(l)) != hs_hash(sn_heapstr(r))) return false;
+	if (rope_length(l) != rope_length(r)) return false;
+	String_View a = sn_string(&l), b = sn_string(&r);
+	return memcmp(a.data, b.data, a.count) == 0;
+}
+
+bool ictx_string_literal(stack_node v, stack_node* out) {
+	if (sn_is_rope(v)) v = *rope_flatten(v);
+	if (!sn_is_heapstr(v)) {
+		*out = v;
+		return true;
+	}
+	heapstr* h = sn_heapstr(v);
+	const strpool_entry* e = strpool_find(HEAPSTR_SV(h), hs_hash(h));
+	if (!e) return false;
+	*out = ictx_string_from_pool(e);
+	return true;
+}
+
+void ictx_enter(interpreter_ctx* ictx) {
+	for (interpreter_ctx** it = cvector_begin(live); it != cvector_end(live); it++) {
+		if (*it == ictx) return;
+	}
+	cvector_push_back(live, ictx);
+}
+
+static void ictx_mark_stack(const interpreter_ctx* ictx) {
+	for (int i = 0; i <= ictx->stack_top; i++) {
+		stack_node v = ictx->stack[i];
+		if (sn_type(v) != STRING) continue;
+		if (sn_is_heapstr(v)) hs_mark(sn_heapstr(v));
+		else if (sn_is_rope(v)) rope_mark(v);
+	}
+}
+
+// The other contexts are stopped somewhere that left their stack_top current: they called
+// out of a builtin into this one, or returned from their run
+void ictx_collect(interpreter_ctx* ictx) {
+	ictx_enter(ictx);
+	hs_begin();
+	for (interpreter_ctx** it = cvector_begin(live); it != cvector_end(live); it++) {
+		ictx_mark_stack(*it);
+	}
+	hs_sweep();
+	rope_sweep();
+	in_sweep();
+}
+
+stack_node ictx_char_from_sv(String_View sv) {
+	if (sv.count == 3 && sv.data[0] == '\'')
+		return sn_from_char(sv.data[1]);
+	return sn_from_char(sv.count ? sv.data[0] : 0);
 }
 
 void ictx_show_stack(interpreter_ctx* ictx) {
 	for (int i = 0; i <= ictx->stack_top; i++) {
-		switch (ictx->stack[i].type) {
+		switch (sn_type(ictx->stack[i])) {
 			case DOUBLE:
-				printf("%04.f\n", ictx->stack[i].doubleLiteral);
+				ob_double(ictx->out, "%04.f", sn_double(ictx->stack[i]));
 				break;
 			case INTEGER:
-				printf("%d\n", ictx->stack[i].integerLiteral);
+				ob_int(ictx->out, sn_int(ictx->stack[i]));
 				break;
 			case CHAR:
-				printf(SV_Fmt "\n", SV_Arg(ictx->stack[i].charLiteral));
+				ob_char(ictx->out, sn_char(ictx->stack[i]));
 				break;
 			case STRING:
-				printf(SV_Fmt "\n", SV_Arg(ictx->stack[i].stringLiteral));
+				ob_write(ictx->out, sn_string(&ictx->stack[i]));
 				break;
-			case STACK_OP:
-				printf(SV_Fmt "\n", SV_Arg(ictx->stack[i].stackOp.op.op_str));
+			case ARRAY:
+				arr_print(ictx->out, sn_array(ictx->stack[i]));
 				break;
 			case UNDEFINED:
-				printf("%s\n", ictx_stack_node_type_to_str(UNDEFINED));
+				ob_write(ictx->out, sv_from_cstr(ictx_stack_node_type_to_str(UNDEFINED)));
 				break;
 		}
+		ob_newline(ictx->out);
 	}
 }
 
 
-/*
- *  A helper struct for using the ARITH_OPERATION macro
- *    + resultType  -> what is the type of the resulting operation?
- *    + leftType    -> what is the type of the left operand?
- *    + rightType   -> what is the type of the right operand?
- */
-typedef struct ArithInfo {
-	stack_node_type resultType;
-	stack_node_type leftType, rightType;
-} ArithInfo;
-
-/*
- *  A macro used to perform an arbitrary operation based on the two operand types
- *    + l         -> the left operand (stack_node)
- *    + r         -> the right operand (stack_node)
- *    + arithInfo -> instance of the struct defined above
- *    + expr      -> the operation to execute if the left and right operands pass type checking
- */
-#define ARITH_OPERATION(l, r, arithInfo, expr) \
-	/*if (ictx->stack_top > 0 && l.type == STACK_OP && l.stackOp.type == STACK_OP_TYPE_PERIOD_SEQ) ictx->stack_top--; l = ictx->stack[ictx->stack_top - l.stackOp.op.op_str.count];\
-	if (ictx->stack_top > 0 && l.type == STACK_OP && l.stackOp.type == STACK_OP_TYPE_COMMA_SEQ)  l = ictx->stack[ictx->stack_top - l.stackOp.op.op_str.count];\
-	if (ictx->stack_top > 0 && r.type == STACK_OP && r.stackOp.type == STACK_OP_TYPE_PERIOD_SEQ) ictx->stack_top--; r = ictx->stack[ictx->stack_top - r.stackOp.op.op_str.count];\
-	if (ictx->stack_top > 0 && r.type == STACK_OP && r.stackOp.type == STACK_OP_TYPE_COMMA_SEQ)  r = ictx->stack[ictx->stack_top - r.stackOp.op.op_str.count];*/\
-	if (l.type == arithInfo.leftType && r.type == arithInfo.rightType) {\
-		n.type = arithInfo.resultType;\
-		{\
-			(expr);\
-		}\
-	}
-
 void ictx_process_expression(interpreter_ctx* ictx, Expression* exp) {
 	// =================
 	// Term
@@ -92,24 +180,20 @@ void ictx_process_expression(interpreter_ctx* ictx, Expression* exp) {
 		switch (exp->ETerm.term.type) {
 			case TERM_TYPE_CHR_LIT:
 				ictx->stack_top++;
-				ictx->stack[ictx->stack_top].type = CHAR;
-				ictx->stack[ictx->stack_top].charLiteral = exp->ETerm.term._chr;
+				ictx->stack[ictx->stack_top] = ictx_char_from_sv(exp->ETerm.term._chr);
 				break;
 			case TERM_TYPE_STRING_LIT:
 				ictx->stack_top++;
-				ictx->stack[ictx->stack_top].type = STRING;
-				ictx->stack[ictx->stack_top].stringLiteral = exp->ETerm.term._string;
+				ictx->stack[ictx->stack_top] = ictx_string_from_pool(exp->ETerm.term._string);
 				break;
 			case TERM_TYPE_HEX_LIT:
 			case TERM_TYPE_DEC_LIT:
 				ictx->stack_top++;
-				ictx->stack[ictx->stack_top].type = INTEGER;
-				ictx->stack[ictx->stack_top].integerLiteral = exp->ETerm.term._integer;
+				ictx->stack[ictx->stack_top] = sn_from_int(exp->ETerm.term._integer);
 				break;
 			case TERM_TYPE_DOUBLE_LIT:
 				ictx->stack_top++;
-				ictx->stack[ictx->stack_top].type = DOUBLE;
-				ictx->stack[ictx->stack_top].doubleLiteral = exp->ETerm.term._double;
+				ictx->stack[ictx->stack_top] = sn_from_double(exp->ETerm.term._double);
 				break;
 		}
 		return;
@@ -119,113 +203,50 @@ void ictx_process_expression(interpreter_ctx* ictx, Expression* exp) {
 	// =================
 	if (exp->type == EXPRESSION_TYPE_STACK_OP) {
 		switch (exp->stackOp.type) {
+			// a run of n pops n values, or pushes n copies of the top
 			case STACK_OP_TYPE_PERIOD_SEQ: {
-				ictx->stack_top--;
+				ictx->stack_top -= exp->stackOp.op.op_str.count;
+				if (ictx->stack_top < -1) ictx_pop_underflow();
 				break;
 			}
 			case STACK_OP_TYPE_SEMI_SEQ: {
 				stack_node s = ictx->stack[ictx->stack_top];
-				ictx->stack[++ictx->stack_top] = s;
+				for (size_t i = 0; i < exp->stackOp.op.op_str.count; i++) {
+					ictx->stack[++ictx->stack_top] = s;
+				}
 				break;
 			}
+			// a run of n pushes a copy of the value n - 1 below the top, so a single ','
+			// peeks the top, which is already there
 			case STACK_OP_TYPE_COMMA_SEQ: {
-				// sl_log("Comma op");
-				// push the item from count in the stack to the top
-				// int stackloc = ictx->stack_top - exp->stackOp.op.op_str.count + 1;
-				// sl_assert(stackloc >= 0, "Stack underflow: %d", stackloc); 
-				// stack_node n = ictx->stack[stackloc];
-				// ictx->stack_top++;
-				// ictx->stack[ictx->stack_top] = n;
-				// sl_log("%d\n", ictx->stack[ictx->stack_top].type);
+				int depth = exp->stackOp.op.op_str.count - 1;
+				if (depth == 0) break;
+				if (ictx->stack_top < depth) ictx_pop_underflow();
+				stack_node n = ictx->stack[ictx->stack_top - depth];
+				ictx->stack[++ictx->stack_top] = n;
 				break;
 			}
 		}
-		// exp->stackOp.op.op_str.count;
-		// ictx->stack_top++;
-		// ictx->stack[ictx->stack_top].type = STACK_OP;
-		// ictx->stack[ictx->stack_top].stackOp = exp->stackOp;
 		return;
-		// switch (exp->stackOp.type) {
-		// 	/**
-		// 	 *    Operation: ,
-		// 	 *    Function: Peek the top of the stack
-		// 	 */
-		// 	case STACK_OP_TYPE_COMMA_SEQ: {
-		// 		int sequenceCount = exp->stackOp.op.op_str.count;
-		// 		ictx->stack_top++;
-		// 		ictx->stack[ictx->stack_top].type = STACK_OP;
-		// 		ictx->stack[ictx->stack_top].stackOp = exp->stackOp;
-		// 		break;
-		// 	}
-		// 	/**
-		// 	 *    Operation: .
-		// 	 *    Function: Pop the top of the stack
-		// 	 */
-		// 	case STACK_OP_TYPE_PERIOD_SEQ:{
-		// 		int sequenceCount = exp->stackOp.op.op_str.count;
-		// 		ictx->stack_top -= sequenceCount;
-		// 		break;
-		// 	}
-		// }
-		/*
-		if (sv_eq(exp->StackOp.op.op_str, SV(","))) {
-			ictx->peeked = ictx->stack[ictx->stack_top];
-			//sl_log("top of stack: %d", ictx->stack[ictx->stack_top].type);
-			return;
-		}
-		*/
-		/**
-		 *    Operation: .
-		 *    Function: Pop the top of the stack
-		 */
-		/*
-		if (sv_eq(exp->StackOp.op.op, SV("."))) {
-			ictx->stack_top--;
-			return;
-		}
-		*/
-		/**
-		 *    Operation: ;
-		 *    Function: Duplicate the top of the stack
-		 */
-		/*
-		if (sv_eq(exp->EEO.operation.op, SV(";"))) {
-			stack_node n = ictx->stack[ictx->stack_top];
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		*/
 	}
 
 	// =================
 	// ProcedureCall
 	// =================
 	if (exp->type == EXPRESSION_TYPE_PROC_CALL) {
-		if (sv_eq(exp->EProcCall.proc_call.name, SV("exit"))) {
-			exit(100);
-			return;
-		}
-		if (sv_eq(exp->EProcCall.proc_call.name, SV("print"))) {
-			stack_node l = ictx->stack[ictx->stack_top];
-			interp_builtin_print(l);
-			return;
-		}
-		if (sv_eq(exp->EProcCall.proc_call.name, SV("println"))) {
-			stack_node l = ictx->stack[ictx->stack_top];
-			interp_builtin_println(l);
-			return;
-		}
-		if (sv_eq(exp->EProcCall.proc_call.name, SV("input"))) {
-			stack_node l = {0};
-			interp_builtin_input(&l);
-			ictx->stack[++ictx->stack_top] = l;
+		const ProcedureCall* call = &exp->EProcCall.proc_call;
+		if (call->proc && call->tail) {
+			ictx->tail_call = call->proc;
 			return;
 		}
-		if (sv_eq(exp->EProcCall.proc_call.name, SV("showstack"))) {
-			interp_builtin_showstack(ictx);
+		if (call->proc) {
+			ictx_call_proc(ictx, call->proc);
 			return;
 		}
-		sl_assert(0, "Proc call for '" SV_Fmt "' not implemented", SV_Arg(exp->EProcCall.proc_call.name));
+		const interp_builtin* b = interp_builtin_resolve(call);
+		sl_assert(b, "Proc call for '" SV_Fmt "' not implemented", SV_Arg(exp->EProcCall.proc_call.name));
+		interp_builtin_call(ictx, b->id);
+		return;
 	}
 	// =======================
 	// EEO    (Expr, Expr, Op)
@@ -233,111 +254,134 @@ void ictx_process_expression(interpreter_ctx* ictx, Expression* exp) {
 	if (exp->type == EXPRESSION_TYPE_EEO) {
 		ictx_process_expression(ictx, exp->EEO.left);
 		ictx_process_expression(ictx, exp->EEO.right);
-		stack_node r = ictx->stack[ictx->stack_top--];
-		stack_node l = ictx->stack[ictx->stack_top--];
-
-		stack_node n = (stack_node) {.type=UNDEFINED};
-		if (sv_eq(exp->EEO.operation.op_str, SV("+"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType=DOUBLE,  .leftType=DOUBLE,  .rightType=DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  + r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType=DOUBLE,  .leftType=INTEGER, .rightType=DOUBLE}),  n.doubleLiteral  = (l.integerLiteral + r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType=DOUBLE,  .leftType=DOUBLE,  .rightType=DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  + r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType=INTEGER, .leftType=INTEGER, .rightType=INTEGER}), n.integerLiteral = (l.integerLiteral + r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '+' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("-"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = DOUBLE , .rightType = DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  - r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = INTEGER, .rightType = DOUBLE}),  n.doubleLiteral  = (l.integerLiteral - r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = DOUBLE,  .rightType = INTEGER}), n.doubleLiteral  = (l.doubleLiteral  - r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = INTEGER}), n.integerLiteral = (l.integerLiteral - r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '-' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("*"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = DOUBLE , .rightType = DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  * r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = INTEGER, .rightType = DOUBLE}),  n.doubleLiteral  = (l.integerLiteral * r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = DOUBLE,  .rightType = INTEGER}), n.doubleLiteral  = (l.doubleLiteral  * r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = INTEGER}), n.integerLiteral = (l.integerLiteral * r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '*' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("/"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = DOUBLE , .rightType = DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  / r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = INTEGER, .rightType = DOUBLE}),  n.doubleLiteral  = (l.integerLiteral / r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = DOUBLE , .leftType = DOUBLE,  .rightType = INTEGER}), n.doubleLiteral  = (l.doubleLiteral  / r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = INTEGER}), n.integerLiteral = (l.integerLiteral / r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '/' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("%"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = INTEGER}), n.integerLiteral = (l.integerLiteral % r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '%%' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV(">"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = DOUBLE , .rightType = DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  > r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = DOUBLE}),  n.doubleLiteral  = (l.integerLiteral > r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = DOUBLE,  .rightType = INTEGER}), n.doubleLiteral  = (l.doubleLiteral  > r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = INTEGER}), n.integerLiteral = (l.integerLiteral > r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '>' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("<"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = DOUBLE , .rightType = DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  < r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = DOUBLE}),  n.doubleLiteral  = (l.integerLiteral < r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = DOUBLE,  .rightType = INTEGER}), n.doubleLiteral  = (l.doubleLiteral  < r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = INTEGER}), n.integerLiteral = (l.integerLiteral < r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '<' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("&&"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER , .leftType = INTEGER , .rightType = INTEGER}),  n.integerLiteral  = (l.integerLiteral && r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '&&' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("||"))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER , .leftType = INTEGER , .rightType = INTEGER}),  n.integerLiteral  = (l.integerLiteral || r.integerLiteral));
-			sl_assert(n.type != UNDEFINED, "Operator '||' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			return;
-		}
-		if (sv_eq(exp->EEO.operation.op_str, SV("=="))) {
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER , .leftType = DOUBLE , .rightType = DOUBLE}),  n.doubleLiteral  = (l.doubleLiteral  == r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER , .leftType = INTEGER, .rightType = DOUBLE}),  n.doubleLiteral  = (l.integerLiteral == r.doubleLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER , .leftType = DOUBLE,  .rightType = INTEGER}), n.doubleLiteral  = (l.doubleLiteral  == r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER, .leftType = INTEGER, .rightType = INTEGER}), n.integerLiteral = (l.integerLiteral == r.integerLiteral));
-			ARITH_OPERATION(l, r, ((ArithInfo){.resultType = INTEGER,  .leftType = STRING,  .rightType = STRING}),  ({
-				String_View l2 = l.stringLiteral, r2 = r.stringLiteral;
-				int l2_quoted = l.stringLiteral.data[0] == '\"' && l.stringLiteral.data[l.stringLiteral.count - 1] == '\"';
-				int r2_quoted = r.stringLiteral.data[0] == '\"' && r.stringLiteral.data[r.stringLiteral.count - 1] == '\"';
-				if (l2_quoted) l2 = sv_from_parts(l.stringLiteral.data + 1, l.stringLiteral.count - 2);
-				if (r2_quoted) r2 = sv_from_parts(r.stringLiteral.data + 1, r.stringLiteral.count - 2);
-				n.integerLiteral = sv_eq(l2, r2);
-				//sl_log(SV_Fmt " == " SV_Fmt " = %d\n", SV_Arg(l2), SV_Arg(r2), n.integerLiteral);
-			}));
-			sl_assert(n.type != UNDEFINED, "Operator '==' not defined for %s and %s\n", ictx_stack_node_type_to_str(l.type), ictx_stack_node_type_to_str(r.type));
-			ictx->stack[++ictx->stack_top] = n;
-			// sl_log("'==' Push: %d\n", ictx->stack[ictx->stack_top].integerLiteral);
-			return;
+		ictx_apply_operator(ictx, exp->EEO.operation);
+		return;
+	}
+	// =======================
+	// Operator (operands already on the stack)
+	// =======================
+	if (exp->type == EXPRESSION_TYPE_OPERATOR) {
+		ictx_apply_operator(ictx, exp->EOp.operation);
+		return;
+	}
+}
+
+const char* ictx_operator_str[OPERATOR_CODE_COUNT] = {
+	[OPERATOR_CODE_UNDEFINED] = "?",
+	[OPERATOR_CODE_ADD]  = "+",  [OPERATOR_CODE_SUB] = "-", [OPERATOR_CODE_MUL] = "*", [OPERATOR_CODE_DIV] = "/", [OPERATOR_CODE_MOD] = "%",
+	[OPERATOR_CODE_GT]   = ">",  [OPERATOR_CODE_LT]  = "<",
+	[OPERATOR_CODE_LAND] = "&&", [OPERATOR_CODE_LOR] = "||",
+	[OPERATOR_CODE_EQ]   = "==",
+};
+
+/*
+ *  Binary operations, one function per (operator, left type, right type)
+ *    + BINARY_OP defines one: how to build the result, and what from
+ *    + ictx_binary_table maps each combination to its function, NULL means it isn't defined
+ */
+typedef stack_node (*ictx_binary_fn)(stack_node l, stack_node r);
+
+#define BINARY_OP(name, make, expr) \
+	static stack_node name(stack_node l, stack_node r) {\
+		return make(expr);\
+	}
+#define ARITH_OPS(name, op) \
+	BINARY_OP(name##_dd, sn_from_double, sn_double(l) op sn_double(r))\
+	BINARY_OP(name##_id, sn_from_double, sn_int(l)    op sn_double(r))\
+	BINARY_OP(name##_di, sn_from_double, sn_double(l) op sn_int(r))\
+	BINARY_OP(name##_ii, sn_from_int,    sn_int(l)    op sn_int(r))
+#define COMPARE_OPS(name, op) \
+	BINARY_OP(name##_dd, sn_from_int, sn_double(l) op sn_double(r))\
+	BINARY_OP(name##_id, sn_from_int, sn_int(l)    op sn_double(r))\
+	BINARY_OP(name##_di, sn_from_int, sn_double(l) op sn_int(r))\
+	BINARY_OP(name##_ii, sn_from_int, sn_int(l)    op sn_int(r))
+
+ARITH_OPS(bin_add, +)
+ARITH_OPS(bin_sub, -)
+ARITH_OPS(bin_mul, *)
+ARITH_OPS(bin_div, /)
+BINARY_OP(bin_mod_ii,  sn_from_int, sn_int(l) %  sn_int(r))
+COMPARE_OPS(bin_gt, >)
+COMPARE_OPS(bin_lt, <)
+COMPARE_OPS(bin_eq, ==)
+BINARY_OP(bin_eq_ss,   sn_from_int, ictx_string_eq(l, r))
+BINARY_OP(bin_add_ss,  ,             rope_concat(l, r))
+BINARY_OP(bin_land_ii, sn_from_int, sn_int(l) && sn_int(r))
+BINARY_OP(bin_lor_ii,  sn_from_int, sn_int(l) || sn_int(r))
+
+#define BINARY_ROW(op, name) \
+	[op][DOUBLE][DOUBLE]   = name##_dd,\
+	[op][INTEGER][DOUBLE]  = name##_id,\
+	[op][DOUBLE][INTEGER]  = name##_di,\
+	[op][INTEGER][INTEGER] = name##_ii
+
+static const ictx_binary_fn ictx_binary_table[OPERATOR_CODE_COUNT][STACK_NODE_TYPE_COUNT][STACK_NODE_TYPE_COUNT] = {
+	BINARY_ROW(OPERATOR_CODE_ADD, bin_add),
+	BINARY_ROW(OPERATOR_CODE_SUB, bin_sub),
+	BINARY_ROW(OPERATOR_CODE_MUL, bin_mul),
+	BINARY_ROW(OPERATOR_CODE_DIV, bin_div),
+	BINARY_ROW(OPERATOR_CODE_GT,  bin_gt),
+	BINARY_ROW(OPERATOR_CODE_LT,  bin_lt),
+	BINARY_ROW(OPERATOR_CODE_EQ,  bin_eq),
+	[OPERATOR_CODE_EQ][STRING][STRING]    = bin_eq_ss,
+	[OPERATOR_CODE_ADD][STRING][STRING]   = bin_add_ss,
+	[OPERATOR_CODE_MOD][INTEGER][INTEGER]  = bin_mod_ii,
+	[OPERATOR_CODE_LAND][INTEGER][INTEGER] = bin_land_ii,
+	[OPERATOR_CODE_LOR][INTEGER][INTEGER]  = bin_lor_ii,
+};
+
+static void ictx_binary_undefined(OperatorCode op, stack_node l, stack_node r) {
+	sl_assert(0, "Operator '%s' not defined for %s and %s\n", ictx_operator_str[op], ictx_stack_node_type_to_str(sn_type(l)), ictx_stack_node_type_to_str(sn_type(r)));
+}
+
+bool ictx_binary_eval(OperatorCode op, stack_node l, stack_node r, stack_node* out) {
+	ictx_binary_fn fn = ictx_binary_table[op][sn_type(l)][sn_type(r)];
+	if (!fn) return false;
+	*out = fn(l, r);
+	return true;
+}
+
+stack_node_type ictx_binary_result_type(OperatorCode op, stack_node_type lt, stack_node_type rt) {
+	// stand-ins to run each function on, none of them can trap
+	const stack_node sample[STACK_NODE_TYPE_COUNT] = {
+		[UNDEFINED] = SN_UNDEFINED, [CHAR] = sn_from_char('a'), [STRING] = ictx_string_from_sv(SV("")),
+		[DOUBLE] = sn_from_double(1.0), [INTEGER] = sn_from_int(1), [ARRAY] = {SN_BOXED(ARRAY)},
+	};
+	stack_node_type agreed = UNDEFINED;
+	for (stack_node_type l = CHAR; l < STACK_NODE_TYPE_COUNT; l++) {
+		if (lt != UNDEFINED && l != lt) continue;
+		for (stack_node_type r = CHAR; r < STACK_NODE_TYPE_COUNT; r++) {
+			if (rt != UNDEFINED && r != rt) continue;
+			stack_node res;
+			if (!ictx_binary_eval(op, sample[l], sample[r], &res)) continue;
+			if (agreed != UNDEFINED && agreed != sn_type(res)) return UNDEFINED;
+			agreed = sn_type(res);
 		}
-		sl_assert(0, "Undefined operation \"" SV_Fmt "\"\n", SV_Arg(exp->EEO.operation.op_str));
 	}
+	return agreed;
+}
+
+void ictx_apply_operator(interpreter_ctx* ictx, Operator op) {
+	sl_assert(op.code != OPERATOR_CODE_UNDEFINED, "Undefined operation \"" SV_Fmt "\"\n", SV_Arg(op.op_str));
+	ictx_apply_binary(ictx, op.code);
+}
+
+void ictx_apply_binary(interpreter_ctx* ictx, OperatorCode op) {
+	if (hs_due) ictx_collect(ictx);
+	stack_node r = ictx->stack[ictx->stack_top--];
+	stack_node l = ictx->stack[ictx->stack_top--];
+
+	ictx_binary_fn fn = ictx_binary_table[op][sn_type(l)][sn_type(r)];
+	if (!fn) ictx_binary_undefined(op, l, r);
+	ictx->stack[++ictx->stack_top] = fn(l, r);
 }
 
 void ictx_process_iff(interpreter_ctx* ictx, Iff iff) {
 	//sl_log("iff");
 	ictx_process_expression(ictx, iff.expression);
-	if (ictx->stack[ictx->stack_top].type == INTEGER) {
-		// sl_log("Stacktop: %d\n", ictx->stack[ictx->stack_top].integerLiteral);
-		if (ictx->stack[ictx->stack_top].integerLiteral != 0) {
+	if (sn_is_int(ictx->stack[ictx->stack_top])) {
+		// sl_log("Stacktop: %d\n", sn_int(ictx->stack[ictx->stack_top]));
+		if (sn_int(ictx->stack[ictx->stack_top]) != 0) {
 			// pop the result of the condition
 			ictx->stack_top--;
 			ictx_process_block(ictx, iff.block);
@@ -345,16 +389,69 @@ void ictx_process_iff(interpreter_ctx* ictx, Iff iff) {
 	}
 }
 
+void ictx_process_while(interpreter_ctx* ictx, While* whilee) {
+	for (;;) {
+		ictx_process_expression(ictx, whilee->expression);
+		stack_node top = ictx->stack[ictx->stack_top];
+		if (!sn_is_int(top) || sn_int(top) == 0) break;
+		ictx->stack_top--;
+		whilee->iterations++;
+		ictx_process_block(ictx, whilee->block);
+	}
+}
+
+void ictx_process_switch(interpreter_ctx* ictx, Switch* sw) {
+	ictx_process_expression(ictx, sw->expression);
+	int c = sw_lookup(sw->table, ictx->stack[ictx->stack_top--]);
+	if (c >= 0) ictx_process_block(ictx, sw->block.cases[c].b);
+}
+
 void ictx_process_block(interpreter_ctx* ictx, Block block) {
 	for (StatementExpression* it = cvector_begin(block.items); it != cvector_end(block.items); it++) {
 		ictx_process_stmt_expr(ictx, *it);
 	}
 }
 
+// Exits like a stack guard fault does. No stacktrace, thousands of frames of the same call
+// take seconds to symbolize and say nothing the message doesn't. _exit skips the atexit
+// hooks, so the log records still in the ring are drained here
+void ictx_call_overflow() {
+	fflush(stdout);
+	ob_flush_all();
+	fprintf(stderr, "Return stack overflow: more than %d nested procedure calls\n", ICTX_CALL_DEPTH_MAX);
+	sl_log_flush();
+	_exit(90);
+}
+
+void ictx_pop_underflow() {
+	fflush(stdout);
+	ob_flush_all();
+	fprintf(stderr, "Stack underflow: popped or peeked past the bottom of the data stack\n");
+	sl_log_flush();
+	_exit(90);
+}
+
+void ictx_call_proc(interpreter_ctx* ictx, const ProcedureDef* proc) {
+	if (ictx->call_depth == ICTX_CALL_DEPTH_MAX) ictx_call_overflow();
+	ictx->call_depth++;
+	while (proc) {
+		ictx->tail_call = NULL;
+		ictx_process_block(ictx, proc->block);
+		proc = ictx->tail_call;
+	}
+	ictx->call_depth--;
+}
+
 void ictx_process_statement(interpreter_ctx* ictx, Statement* stmt) {
 	if (stmt->type == STATEMENT_TYPE_IFF) {
 		ictx_process_iff(ictx, stmt->iff);
 	}
+	if (stmt->type == STATEMENT_TYPE_WHILE) {
+		ictx_process_while(ictx, &stmt->whilee);
+	}
+	if (stmt->type == STATEMENT_TYPE_SWITCH) {
+		ictx_process_switch(ictx, &stmt->switchh);
+	}
 }
 
 void ictx_process_stmt_expr(interpreter_ctx* ictx, StatementExpression stmtexpr) {
@@ -368,13 +465,18 @@ void ictx_process_stmt_expr(interpreter_ctx* ictx, StatementExpression stmtexpr)
 	}
 }
 
+void ictx_run_node(interpreter_ctx* ictx, AST_Node n) {
+	ictx_enter(ictx);
+	if (n.nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION) {
+		ictx_process_stmt_expr(ictx, n.stmtExpr);
+	}
+}
+
 void ictx_run(interpreter_ctx* ictx, Program p) {
 	// fprintf(stderr, "INTERPRETER OFFLINE\n");
 	// return;
 
 	for (AST_Node* n = cvector_begin(p.p); n != cvector_end(p.p); n++) {
-		if (n->nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION) {
-			ictx_process_stmt_expr(ictx, n->stmtExpr);
-		}
+		ictx_run_node(ictx, *n);
 	}
 }
@@ -2,44 +2,179 @@
 #define INTERPRETER_H
 #include "sv.h"
 #include "ast.h"
+#include "output.h"
+#include "heapstr.h"
+#include "strpool.h"
 #include "tokenizer.h"
-
-#define STACK_SIZE 500
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 typedef enum {
-	UNDEFINED=0, CHAR, STRING, DOUBLE, INTEGER, STACK_OP
+	UNDEFINED=0, CHAR, STRING, DOUBLE, INTEGER, ARRAY
 } stack_node_type;
+#define STACK_NODE_TYPE_COUNT (ARRAY + 1)
 
+/**
+ *  Runtime values, NaN-boxed into 8 bytes
+ *    A double is stored as itself, any NaN it holds is made the positive quiet NaN.
+ *    Everything else is a negative quiet NaN with the type in the 3 bits under the
+ *    exponent and the value in the low 48:
+ *      1111 1111 1111 1ttt  pppp pppp ... pppp
+ *    + INTEGER -> the int, low 32 bits
+ *    + CHAR    -> the character, low 8 bits
+ *    + STRING  -> up to 5 bytes held in the value itself, with bit 47 set and the length
+ *                 in bits 40-42 (byte i is bits 8i..8i+7). Longer literals are their
+ *                 strpool_entry, which has the length and hash, so equal literals have
+ *                 equal bits. Longer strings made at run time are a heapstr (see
+ *                 heapstr.h), a pointer with bit 1 set.
+ *                 A + of two strings is a rope instead (see rope.h), a pointer with its
+ *                 low bit set, until something needs the bytes
+ *    + ARRAY   -> its array, see array.h
+ *  Nothing about where a value came from is kept, errors get that from the AST.
+ */
 typedef struct {
-	stack_node_type type;
-	tokenizer_state state;
-	union {
-		String_View stringLiteral; // covers char and string 
-		double doubleLiteral;
-		int integerLiteral;
-		String_View charLiteral;
-		StackOp stackOp;
-	};
+	uint64_t bits;
 } stack_node;
 
+#define SN_BOX         0xFFF8000000000000ull
+#define SN_TAG_SHIFT   48
+#define SN_PAYLOAD     0x0000FFFFFFFFFFFFull
+#define SN_BOXED(type) (SN_BOX | (uint64_t) (type) << SN_TAG_SHIFT)
+#define SN_UNDEFINED   ((stack_node) {SN_BOXED(UNDEFINED)})
+
+static inline stack_node_type sn_type(stack_node v) {
+	return (v.bits & SN_BOX) == SN_BOX ? (stack_node_type) ((v.bits >> SN_TAG_SHIFT) & 7) : DOUBLE;
+}
+static inline bool sn_is_int(stack_node v) {
+	return (v.bits & ~SN_PAYLOAD) == SN_BOXED(INTEGER);
+}
+
+static inline int                  sn_int(stack_node v)    { return (int) (uint32_t) v.bits; }
+static inline char                 sn_char(stack_node v)   { return (char) v.bits; }
+static inline double               sn_double(stack_node v) {
+	double d;
+	memcpy(&d, &v.bits, sizeof(d));
+	return d;
+}
+
+#define SN_STRING_INLINE       (1ull << 47)
+#define SN_STRING_INLINE_MAX   5
+#define SN_STRING_LENGTH_SHIFT 40
+#define SN_STRING_ROPE         1ull
+#define SN_STRING_HEAP         2ull
+
+const stack_node* rope_flatten(stack_node);
+
+static inline bool sn_is_heapstr(stack_node v) {
+	return (v.bits & (SN_STRING_INLINE | SN_STRING_HEAP)) == SN_STRING_HEAP;
+}
+static inline heapstr* sn_heapstr(stack_node v) {
+	return (heapstr*) (uintptr_t) (v.bits & SN_PAYLOAD & ~SN_STRING_HEAP);
+}
+
+// The string's bytes, for an inline one they're in *v so the view lasts as long as it does.
+// Assumes little-endian, like the JIT
+static inline String_View sn_string(const stack_node* v) {
+	if ((v->bits & (SN_STRING_INLINE | SN_STRING_ROPE)) == SN_STRING_ROPE)
+		v = rope_flatten(*v);
+	if (v->bits & SN_STRING_INLINE)
+		return sv_from_parts((const char*) &v->bits, (v->bits >> SN_STRING_LENGTH_SHIFT) & 7);
+	if (v->bits & SN_STRING_HEAP)
+		return HEAPSTR_SV(sn_heapstr(*v));
+	const strpool_entry* e = (const strpool_entry*) (uintptr_t) (v->bits & SN_PAYLOAD);
+	return STRPOOL_SV(e);
+}
+
+static inline stack_node sn_from_int(int i)   { return (stack_node) {SN_BOXED(INTEGER) | (uint32_t) i}; }
+static inline stack_node sn_from_char(char c) { return (stack_node) {SN_BOXED(CHAR) | (unsigned char) c}; }
+static inline stack_node sn_from_double(double d) {
+	stack_node v;
+	if (d != d) return (stack_node) {0x7FF8000000000000ull};
+	memcpy(&v.bits, &d, sizeof(d));
+	return v;
+}
+
+// printable operator, indexed by OperatorCode
+extern const char* ictx_operator_str[OPERATOR_CODE_COUNT];
+
 typedef struct {
-	// Data stack
-	stack_node stack[STACK_SIZE];
-	int        stack_top;
+	// Data stack, see interpreter_stack.h
+	stack_node* stack;
+	int         stack_top;
+	size_t      stack_size;
+	bool        verified;    // vfy_program proved it can't underflow, calls skip their depth check
+
+	// Procedures, see ictx_call_proc
+	int         call_depth;
+	const void* tail_call;   // what a tail call leaves for the loop that called its procedure
+
+	// What the program prints, see output.h
+	output_buf* out;
 
 	stack_node peeked;
 } interpreter_ctx;
 
+// Procedure calls nest at most this deep in every engine, tail calls don't count.
+// The tree walker and the closures nest on the C stack, this much fits in 8MB even with sanitizers
+#define ICTX_CALL_DEPTH_MAX 4096
+
 
 const char* ictx_stack_node_type_to_str(stack_node_type);
 
+// string and char values
+//   short strings are inline and longer literals interned, those two are equal exactly when
+//   their bits are. Heap strings and ropes compare their bytes
+stack_node  ictx_string_from_sv(String_View);
+stack_node  ictx_string_from_pool(const strpool_entry*);
+//   a string made at run time, inline or a heap string
+stack_node  ictx_string_new(String_View);
+//   the same without the copy, pointing into what owner is the mark of (see hs_view)
+stack_node  ictx_string_view(String_View, uint32_t* owner);
+bool        ictx_string_eq(stack_node, stack_node);
+//   the inline or interned string equal to a string value, false when the pool has none
+//   (then it's equal to no literal)
+bool        ictx_string_literal(stack_node, stack_node* out);
+//   from a char literal's text, with or without its quotes
+stack_node  ictx_char_from_sv(String_View);
+
 interpreter_ctx ictx_new();
+interpreter_ctx ictx_new_sized(size_t stack_size);
+void            ictx_free(interpreter_ctx*);
 void  					ictx_run(interpreter_ctx*, Program);
+void  					ictx_run_node(interpreter_ctx*, AST_Node);
+//   frees the heap strings and ropes no live context's stack reaches anymore, see heapstr.h.
+//   Only where every value in use is on a stack, a builtin call or a binary operator
+void            ictx_collect(interpreter_ctx*);
+//   makes the stack a root of every collection until ictx_free. Every engine's run calls it,
+//   so a context mustn't move once it has run
+void            ictx_enter(interpreter_ctx*);
 
 // actions
 void ictx_process_stmt_expr(interpreter_ctx*, StatementExpression);
 void ictx_process_expression(interpreter_ctx*, Expression*);
+void ictx_apply_operator(interpreter_ctx*, Operator);
+//   pops the right then the left operand and pushes the result
+void ictx_apply_binary(interpreter_ctx*, OperatorCode);
+//   the same, without a stack. False when the operator isn't defined for those types
+bool ictx_binary_eval(OperatorCode, stack_node l, stack_node r, stack_node* out);
+//   the type an operator gives for those operand types, UNDEFINED when it isn't defined.
+//   An UNDEFINED operand means 'not known', the answer is then whatever every defined
+//   combination agrees on (a comparison is always an INTEGER), or UNDEFINED if they don't
+stack_node_type ictx_binary_result_type(OperatorCode, stack_node_type, stack_node_type);
 void ictx_process_statement(interpreter_ctx*, Statement*);
+//   runs a procedure in one frame, however many tail calls it makes: a tail call only sets
+//   tail_call and returns, the loop here runs the target next
+void ictx_call_proc(interpreter_ctx*, const ProcedureDef*);
+//   the error for going past ICTX_CALL_DEPTH_MAX
+void ictx_call_overflow();
+//   the error for a run of pops or a peek that went below the bottom, a long run can step
+//   over the guard page
+void ictx_pop_underflow();
 void ictx_process_iff(interpreter_ctx*, Iff);
+//   counts into whilee->iterations
+void ictx_process_while(interpreter_ctx*, While*);
+//   always pops the value it switches on
+void ictx_process_switch(interpreter_ctx*, Switch*);
 void ictx_process_block(interpreter_ctx*, Block);
 #endif
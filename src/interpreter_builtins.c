@@ -1,80 +1,365 @@
 #include "interpreter_builtins.h"
 #include "interpreter.h"
 #include "convert.h"
+#include "input.h"
+#include "array.h"
+#include "rope.h"
 #include "sl_assert.h"
+#include "sl_log.h"
+#include "switch.h"
 #include <stdio.h>
+#include <stdlib.h>
 
-void interp_builtin_print(stack_node sn) {
-	switch (sn.type) {
+static void native_exit(interpreter_ctx* ictx) {
+	ob_flush(ictx->out);
+	exit(100);
+}
+
+static void native_print(interpreter_ctx* ictx) {
+	interp_builtin_print(ictx, ictx->stack[ictx->stack_top]);
+}
+
+static void native_println(interpreter_ctx* ictx) {
+	interp_builtin_println(ictx, ictx->stack[ictx->stack_top]);
+}
+
+static void native_input(interpreter_ctx* ictx) {
+	stack_node l = SN_UNDEFINED;
+	interp_builtin_input(ictx, &l);
+	ictx->stack[++ictx->stack_top] = l;
+}
+
+static void native_readall(interpreter_ctx* ictx) {
+	stack_node l = SN_UNDEFINED;
+	interp_builtin_readall(ictx, &l);
+	ictx->stack[++ictx->stack_top] = l;
+}
+
+// Arrays, see array.h
+static array* array_arg(stack_node v, const char* name) {
+	sl_assert(sn_type(v) == ARRAY, "'%s' needs an array, not a %s\n", name, ictx_stack_node_type_to_str(sn_type(v)));
+	return sn_array(v);
+}
+
+static size_t index_arg(const array* a, stack_node i, const char* name) {
+	sl_assert(sn_is_int(i), "'%s' needs an int index, not a %s\n", name, ictx_stack_node_type_to_str(sn_type(i)));
+	sl_assert(sn_int(i) >= 0 && (size_t) sn_int(i) < a->length, "'%s' index %d is out of range, the array has %zu\n", name, sn_int(i), a->length);
+	return sn_int(i);
+}
+
+// count fill -> an array of count fills, the fill's type is the array's
+static void native_array(interpreter_ctx* ictx) {
+	stack_node fill = ictx->stack[ictx->stack_top--];
+	stack_node count = ictx->stack[ictx->stack_top];
+	sl_assert(sn_is_int(count) && sn_int(count) >= 0, "'array' needs a count of 0 or more\n");
+	sl_assert(sn_is_int(fill) || sn_type(fill) == DOUBLE, "An array holds ints or doubles, not a %s\n", ictx_stack_node_type_to_str(sn_type(fill)));
+	ictx->stack[ictx->stack_top] = arr_new(sn_int(count), fill);
+}
+
+static void native_len(interpreter_ctx* ictx) {
+	stack_node v = ictx->stack[ictx->stack_top];
+	if (sn_type(v) == STRING)
+		ictx->stack[ictx->stack_top] = sn_from_int(rope_length(v));
+	else
+		ictx->stack[ictx->stack_top] = sn_from_int(array_arg(v, "len")->length);
+}
+
+static void native_get(interpreter_ctx* ictx) {
+	stack_node i = ictx->stack[ictx->stack_top--];
+	array* a = array_arg(ictx->stack[ictx->stack_top], "get");
+	ictx->stack[ictx->stack_top] = arr_get(a, index_arg(a, i, "get"));
+}
+
+// array index value -> array
+static void native_set(interpreter_ctx* ictx) {
+	stack_node v = ictx->stack[ictx->stack_top--];
+	stack_node i = ictx->stack[ictx->stack_top--];
+	array* a = array_arg(ictx->stack[ictx->stack_top], "set");
+	sl_assert(arr_set(a, index_arg(a, i, "set"), v), "Can't set a %s in an array of %s\n", ictx_stack_node_type_to_str(sn_type(v)), ictx_stack_node_type_to_str(a->type));
+}
+
+static void native_sum(interpreter_ctx* ictx) {
+	ictx->stack[ictx->stack_top] = arr_sum(array_arg(ictx->stack[ictx->stack_top], "sum"));
+}
+
+static void native_min(interpreter_ctx* ictx) {
+	array* a = array_arg(ictx->stack[ictx->stack_top], "min");
+	sl_assert(arr_min(a, &ictx->stack[ictx->stack_top]), "'min' of an empty array\n");
+}
+
+static void native_max(interpreter_ctx* ictx) {
+	array* a = array_arg(ictx->stack[ictx->stack_top], "max");
+	sl_assert(arr_max(a, &ictx->stack[ictx->stack_top]), "'max' of an empty array\n");
+}
+
+static void native_dot(interpreter_ctx* ictx) {
+	array* b = array_arg(ictx->stack[ictx->stack_top--], "dot");
+	array* a = array_arg(ictx->stack[ictx->stack_top], "dot");
+	sl_assert(a->type == b->type && a->length == b->length, "'dot' needs two arrays of the same type and length\n");
+	ictx->stack[ictx->stack_top] = arr_dot(a, b);
+}
+
+static interp_builtin registry[INTERP_BUILTIN_MAX] = {
+	[INTERP_BUILTIN_EXIT]      = {INTERP_BUILTIN_EXIT,      "exit",      native_exit,              0, 0},
+	[INTERP_BUILTIN_PRINT]     = {INTERP_BUILTIN_PRINT,     "print",     native_print,             1, 1, true},
+	[INTERP_BUILTIN_PRINTLN]   = {INTERP_BUILTIN_PRINTLN,   "println",   native_println,           1, 1, true},
+	[INTERP_BUILTIN_INPUT]     = {INTERP_BUILTIN_INPUT,     "input",     native_input,             0, 1},
+	[INTERP_BUILTIN_SHOWSTACK] = {INTERP_BUILTIN_SHOWSTACK, "showstack", interp_builtin_showstack, 0, 0},
+	[INTERP_BUILTIN_READALL]   = {INTERP_BUILTIN_READALL,   "readall",   native_readall,           0, 1},
+	[INTERP_BUILTIN_ARRAY]     = {INTERP_BUILTIN_ARRAY,     "array",     native_array,             2, 1},
+	[INTERP_BUILTIN_LEN]       = {INTERP_BUILTIN_LEN,       "len",       native_len,               1, 1},
+	[INTERP_BUILTIN_GET]       = {INTERP_BUILTIN_GET,       "get",       native_get,               2, 1},
+	[INTERP_BUILTIN_SET]       = {INTERP_BUILTIN_SET,       "set",       native_set,               3, 1},
+	[INTERP_BUILTIN_SUM]       = {INTERP_BUILTIN_SUM,       "sum",       native_sum,               1, 1},
+	[INTERP_BUILTIN_MINIMUM]   = {INTERP_BUILTIN_MINIMUM,   "min",       native_min,               1, 1},
+	[INTERP_BUILTIN_MAXIMUM]   = {INTERP_BUILTIN_MAXIMUM,   "max",       native_max,               1, 1},
+	[INTERP_BUILTIN_DOT]       = {INTERP_BUILTIN_DOT,       "dot",       native_dot,               2, 1},
+};
+static int registry_count = INTERP_BUILTIN_COUNT;
+
+const interp_builtin* interp_builtin_get(interp_builtin_id id) {
+	if (id <= INTERP_BUILTIN_UNKNOWN || id >= registry_count) return NULL;
+	return &registry[id];
+}
+
+const interp_builtin* interp_builtin_find(String_View name) {
+	for (int id = INTERP_BUILTIN_EXIT; id < registry_count; id++) {
+		if (sv_eq(name, sv_from_cstr(registry[id].name)))
+			return &registry[id];
+	}
+	return NULL;
+}
+
+void interp_builtin_call(interpreter_ctx* ictx, interp_builtin_id id) {
+	const interp_builtin* b = &registry[id];
+	if (hs_due) ictx_collect(ictx);
+	if (!ictx->verified)
+		sl_assert(ictx->stack_top + 1 >= b->in, "Stack underflow: '%s' needs %d values, the stack has %d\n", b->name, b->in, ictx->stack_top + 1);
+	b->fn(ictx);
+}
+
+interp_builtin_id interp_builtin_register(const char* name, interp_native_fn fn, int in, int out) {
+	interp_builtin* b = (interp_builtin*) interp_builtin_find(sv_from_cstr(name));
+	if (!b) {
+		if (registry_count == INTERP_BUILTIN_MAX) return INTERP_BUILTIN_UNKNOWN;
+		b = &registry[registry_count];
+		b->id = registry_count++;
+	}
+	b->name = name;
+	b->fn = fn;
+	b->in = in;
+	b->out = out;
+	b->inspects = false;
+	sl_debug(SL_CAT_INTERP, "registered native '%s' as %d (%d -> %d)", name, b->id, in, out);
+	return b->id;
+}
+
+// Procedures defined so far, a later definition of a name replaces an earlier one
+static cvector_vector_type(const ProcedureDef*) procs;
+
+static const ProcedureDef* find_proc(String_View name) {
+	for (size_t i = cvector_size(procs); i > 0; i--) {
+		if (sv_eq(procs[i - 1]->name, name)) return procs[i - 1];
+	}
+	return NULL;
+}
+
+static void link_stmt_expr(StatementExpression, bool tail);
+
+static void link_expression(Expression* exp, bool tail) {
+	switch (exp->type) {
+		case EXPRESSION_TYPE_PROC_CALL: {
+			ProcedureCall* call = &exp->EProcCall.proc_call;
+			call->proc = find_proc(call->name);
+			call->builtin = call->proc ? NULL : interp_builtin_find(call->name);
+			call->tail = tail && call->proc;
+			if (!call->proc && !call->builtin)
+				sl_warn(SL_CAT_INTERP, "no builtin named '" SV_Fmt "'", SV_Arg(call->name));
+			break;
+		}
+		case EXPRESSION_TYPE_EEO:
+			link_expression(exp->EEO.left, false);
+			link_expression(exp->EEO.right, false);
+			break;
+		default: break;
+	}
+}
+
+// tail: nothing runs after this block in its procedure, so neither does its last item
+static void link_block(Block block, bool tail) {
+	size_t count = cvector_size(block.items);
+	for (size_t i = 0; i < count; i++) {
+		link_stmt_expr(block.items[i], tail && i == count - 1);
+	}
+}
+
+// Builds the switch's table, here because it's the one pass over the tree every engine waits for
+static void link_switch(Switch* sw, bool tail) {
+	link_expression(sw->expression, false);
+	int count = cvector_size(sw->block.cases);
+	sw_case* cases = calloc(count + 1, sizeof(sw_case));
+	sl_assert(cases, "Out of memory linking a switch");
+	bool has_default = false;
+	for (int i = 0; i < count; i++) {
+		SwitchCase* c = &sw->block.cases[i];
+		// a case runs last when its switch does
+		link_block(c->b, tail);
+		if (c->is_default) {
+			sl_assert(!has_default, "Second default in the switch at line %d, col %d\n", sw->state.line + 1, sw->state.col + 1);
+			has_default = true;
+			cases[i].is_default = true;
+			continue;
+		}
+		switch (c->value.type) {
+			case TERM_TYPE_HEX_LIT:
+			case TERM_TYPE_DEC_LIT:    cases[i].value = sn_from_int(c->value._integer); break;
+			case TERM_TYPE_CHR_LIT:    cases[i].value = ictx_char_from_sv(c->value._chr); break;
+			case TERM_TYPE_STRING_LIT: cases[i].value = ictx_string_from_pool(c->value._string); break;
+			case TERM_TYPE_DOUBLE_LIT:
+				sl_assert(0, "A double can't be a case, at line %d, col %d\n", c->state.line + 1, c->state.col + 1);
+		}
+	}
+	sw_free(sw->table);
+	sw->table = sw_build(cases, count);
+	for (int i = 0; i < count; i++) {
+		SwitchCase* c = &sw->block.cases[i];
+		sl_assert(c->is_default || sw_lookup(sw->table, cases[i].value) == i,
+				"The case at line %d, col %d repeats an earlier one\n", c->state.line + 1, c->state.col + 1);
+	}
+	free(cases);
+}
+
+static void link_stmt_expr(StatementExpression se, bool tail) {
+	if (se.type == STATEMENT_EXPR_TYPE_EXPRESSION) {
+		link_expression(se.expr, tail);
+		return;
+	}
+	if (se.stmt->type == STATEMENT_TYPE_IFF) {
+		link_expression(se.stmt->iff.expression, false);
+		link_block(se.stmt->iff.block, tail);
+	}
+	// the loop goes on after its block, so nothing in it is in tail position
+	if (se.stmt->type == STATEMENT_TYPE_WHILE) {
+		link_expression(se.stmt->whilee.expression, false);
+		link_block(se.stmt->whilee.block, false);
+	}
+	if (se.stmt->type == STATEMENT_TYPE_SWITCH) {
+		link_switch(&se.stmt->switchh, tail);
+	}
+}
+
+void interp_builtin_link_node(AST_Node n) {
+	if (n.nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION) {
+		link_stmt_expr(n.stmtExpr, false);
+	}
+	if (n.nodeType == AST_NODE_TYPE_PROCEDURE_DEF) {
+		// defined first, so it can call itself
+		cvector_push_back(procs, n.procDef);
+		link_block(n.procDef->block, true);
+	}
+}
+
+void interp_builtin_link(Program p) {
+	// every definition is known before any call is linked, so they can come in any order
+	cvector_set_size(procs, 0);
+	for (AST_Node* n = cvector_begin(p.p); n != cvector_end(p.p); n++) {
+		if (n->nodeType == AST_NODE_TYPE_PROCEDURE_DEF)
+			cvector_push_back(procs, n->procDef);
+	}
+	for (AST_Node* n = cvector_begin(p.p); n != cvector_end(p.p); n++) {
+		if (n->nodeType == AST_NODE_TYPE_PROCEDURE_DEF)
+			link_block(n->procDef->block, true);
+		else
+			interp_builtin_link_node(*n);
+	}
+}
+
+const interp_builtin* interp_builtin_resolve(const ProcedureCall* call) {
+	return call->builtin ? call->builtin : interp_builtin_find(call->name);
+}
+
+void interp_builtin_print(interpreter_ctx* ictx, stack_node sn) {
+	output_buf* out = ictx->out;
+	switch (sn_type(sn)) {
 		case INTEGER:
-			printf("%d", sn.integerLiteral);
+			ob_int(out, sn_int(sn));
 			break;
 		case CHAR:
-			printf(SV_Fmt, SV_Arg(sn.charLiteral));
+			ob_char(out, sn_char(sn));
 			break;
-		case STRING: {
-			String_View s;
-			s.data = sn.stringLiteral.data + 1;
-			s.count = sn.stringLiteral.count - 2;
-			printf(SV_Fmt, SV_Arg(s));
+		case STRING:
+			ob_write(out, sn_string(&sn));
 			break;
-		}
 		case DOUBLE:
-			printf("%0.4f", sn.doubleLiteral);
+			ob_double(out, "%0.4f", sn_double(sn));
+			break;
+		case ARRAY:
+			arr_print(out, sn_array(sn));
 			break;
-		case STACK_OP: sl_assert(0, "Printing stackop not supported yet"); break;
 		case UNDEFINED:
-			printf("type_value=%d, type=%s", sn.type, ictx_stack_node_type_to_str(UNDEFINED));
+			ob_write(out, SV("type_value="));
+			ob_int(out, UNDEFINED);
+			ob_write(out, SV(", type="));
+			ob_write(out, sv_from_cstr(ictx_stack_node_type_to_str(UNDEFINED)));
 			break;
-		default: printf("print failed. sn.type = %d\n", sn.type);
+		default:
+			ob_write(out, SV("print failed. sn.type = "));
+			ob_int(out, sn_type(sn));
+			ob_newline(out);
 	}
 }
 
-void interp_builtin_println(stack_node sn) {
-	interp_builtin_print(sn);
-	printf("\n");
+void interp_builtin_println(interpreter_ctx* ictx, stack_node sn) {
+	interp_builtin_print(ictx, sn);
+	ob_newline(ictx->out);
 } 
 
-void interp_builtin_input(stack_node* o_sn) {
+void interp_builtin_input(interpreter_ctx* ictx, stack_node* o_sn) {
 	// Should this function should be generic.
 	//   - what should happen when the user inptut is an integer,double,string, etc
-	static char buf[255];
-	fgets(buf, 255, stdin);
-	buf[strcspn(buf, "\n")] = 0; // remove newline
-	String_View input = sv_from_cstr(buf);
+	ob_flush(ictx->out);
+	input_buf* in = in_stdin();
+	String_View input = SV("");
+	in_line(in, &input);
 	if (convert_is_sv_dec(input)) {
 		int decimal = convert_decimal_sv_to_int(input);
-		o_sn->type = INTEGER;
-		o_sn->integerLiteral = decimal;
+		*o_sn = sn_from_int(decimal);
 		return;
 	}
 	if (convert_is_sv_hex(input)) {
 		int hex = convert_decimal_sv_to_int(input);
-		o_sn->type = INTEGER;
-		o_sn->integerLiteral = hex;
+		*o_sn = sn_from_int(hex);
 		return;
 	}
 	if (convert_is_sv_double(input)) {
 		double dbl = convert_double_sv_to_double(input);
-		o_sn->type = DOUBLE;
-		o_sn->doubleLiteral = dbl;
+		*o_sn = sn_from_double(dbl);
 		return;
 	}
-	o_sn->type = STRING;
-	o_sn->stringLiteral = input;
+	*o_sn = ictx_string_view(input, &in->chunk->mark);
+}
+
+void interp_builtin_readall(interpreter_ctx* ictx, stack_node* o_sn) {
+	ob_flush(ictx->out);
+	input_buf* in = in_stdin();
+	String_View all = in_all(in);
+	*o_sn = ictx_string_view(all, &in->chunk->mark);
 }
 
 void interp_builtin_showstack(interpreter_ctx* ictx) {
+	output_buf* out = ictx->out;
 	for (int i = ictx->stack_top; i >= 0; i--) {
 		stack_node n = ictx->stack[i];
-		printf("%d: ", i);
-		switch (n.type) {
-			case INTEGER:   printf("INTEGER: %d\n", n.integerLiteral); break;
-			case DOUBLE:    printf("DOUBLE:  %0.4f\n", n.doubleLiteral); break;
-			case STRING:    printf("STRING:  " SV_Fmt "\n", SV_Arg(n.stringLiteral)); break;
-			case CHAR:      printf("CHAR:    " SV_Fmt "\n", SV_Arg(n.charLiteral)); break;
-			case STACK_OP:  printf("STACKOP: " SV_Fmt "\n", SV_Arg(n.stackOp.op.op_str)); break;
-			case UNDEFINED: printf("Undefined\n"); break;
+		ob_int(out, i);
+		ob_write(out, SV(": "));
+		switch (sn_type(n)) {
+			case INTEGER:   ob_write(out, SV("INTEGER: ")); ob_int(out, sn_int(n)); break;
+			case DOUBLE:    ob_write(out, SV("DOUBLE:  ")); ob_double(out, "%0.4f", sn_double(n)); break;
+			case STRING:    ob_write(out, SV("STRING:  ")); ob_write(out, sn_string(&n)); break;
+			case CHAR:      ob_write(out, SV("CHAR:    ")); ob_char(out, sn_char(n)); break;
+			case ARRAY:     ob_write(out, SV("ARRAY:   ")); arr_print(out, sn_array(n)); break;
+			case UNDEFINED: ob_write(out, SV("Undefined")); break;
 		}
+		ob_newline(out);
 	}
 }
@@ -3,9 +3,80 @@
 
 #include "interpreter.h"
 
-void interp_builtin_print(stack_node);
-void interp_builtin_println(stack_node);
-void interp_builtin_input(stack_node*);
+// Natives registered by a host get ids from INTERP_BUILTIN_COUNT up
+typedef enum {
+	INTERP_BUILTIN_UNKNOWN = 0,
+	INTERP_BUILTIN_EXIT,
+	INTERP_BUILTIN_PRINT,
+	INTERP_BUILTIN_PRINTLN,
+	INTERP_BUILTIN_INPUT,
+	INTERP_BUILTIN_SHOWSTACK,
+	INTERP_BUILTIN_READALL,
+	INTERP_BUILTIN_ARRAY,
+	INTERP_BUILTIN_LEN,
+	INTERP_BUILTIN_GET,
+	INTERP_BUILTIN_SET,
+	INTERP_BUILTIN_SUM,
+	INTERP_BUILTIN_MINIMUM,   // min and max, INTERP_BUILTIN_MAX is the registry's size
+	INTERP_BUILTIN_MAXIMUM,
+	INTERP_BUILTIN_DOT,
+	INTERP_BUILTIN_COUNT
+} interp_builtin_id;
+
+#define INTERP_BUILTIN_MAX 256
+
+typedef void (*interp_native_fn)(interpreter_ctx*);
+
+/**
+ *  A registry entry
+ *    + in       -> how many values it needs on the stack
+ *    + out      -> how many are there once it returns, in place of those
+ *    + inspects -> it only reads its inputs and leaves them exactly as they were
+ *  so print is (1 -> 1) and inspects, it looks at the top but leaves it, and input is (0 -> 1).
+ *  Natives registered by a host never claim to inspect.
+ *  A native runs inside a safe point, anything it does that can collect (a builtin, an
+ *  operator, running another context) frees strings only a C local holds. Whatever it still
+ *  needs afterwards stays on the stack until then.
+ */
+typedef struct interp_builtin {
+	interp_builtin_id id;
+	const char*       name;
+	interp_native_fn  fn;
+	int               in, out;
+	bool              inspects;
+} interp_builtin;
+
+// Registry
+//   entries never move, so ProcedureCall.builtin can point straight at them
+const interp_builtin* interp_builtin_get(interp_builtin_id);
+const interp_builtin* interp_builtin_find(String_View);
+void                  interp_builtin_call(interpreter_ctx*, interp_builtin_id);
+
+// Host API
+//   registering a name that's already there replaces it, builtins included.
+//   Returns the id, or INTERP_BUILTIN_UNKNOWN when the registry is full.
+//   Register before linking, calls that were already linked keep what they found.
+interp_builtin_id interp_builtin_register(const char* name, interp_native_fn, int in, int out);
+
+// Linking
+//   resolves every procedure call in the tree to its registry entry, once, after parsing.
+//   A name the program defines (name { ... }) resolves to that procedure instead, also for
+//   builtins, and calls in tail position in a procedure are marked.
+//   Unknown names are left NULL and only fail if they're reached, like before.
+//   interp_builtin_link_node is for streaming: a procedure is defined once its node is
+//   linked, calls before that don't see it. Linking a whole program forgets those.
+void interp_builtin_link(Program);
+void interp_builtin_link_node(AST_Node);
+//   what a call resolves to: its linked entry, or a lookup when it was never linked
+const interp_builtin* interp_builtin_resolve(const ProcedureCall*);
+
+// Printing goes through the interpreter's output buffer, reading flushes it first.
+// input reads a line and makes a number of it when it looks like one (once stdin has ended
+// it reads like an empty line does), readall is the rest of stdin as one string
+void interp_builtin_print(interpreter_ctx*, stack_node);
+void interp_builtin_println(interpreter_ctx*, stack_node);
+void interp_builtin_input(interpreter_ctx*, stack_node*);
+void interp_builtin_readall(interpreter_ctx*, stack_node*);
 void interp_builtin_showstack(interpreter_ctx*);
 
 #endif
@@ -0,0 +1,112 @@
+#include "interpreter_stack.h"
+#include "output.h"
+#include "sl_assert.h"
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Stacks the handler knows about, a context that doesn't fit still works, it just crashes plainly
+#define INTERP_STACK_MAX_MAPPED 16
+
+typedef struct {
+	char*  low_guard;    // also the start of the mapping
+	char*  high_guard;
+	size_t page, slots;
+} mapped_stack;
+
+static mapped_stack mapped[INTERP_STACK_MAX_MAPPED];
+static char         altstack[1 << 15];
+static bool         handler_installed;
+
+// Everything from here runs in the SIGSEGV handler, so it's only async-signal-safe calls:
+// no stdio, no strlen, just write(2)
+static size_t append(char* buf, size_t at, size_t cap, const char* s) {
+	while (*s && at < cap) buf[at++] = *s++;
+	return at;
+}
+
+static size_t append_size(char* buf, size_t at, size_t cap, size_t v) {
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n > 0 && at < cap) buf[at++] = digits[--n];
+	return at;
+}
+
+static void report(const char* msg, size_t length) {
+	// what the program printed so far, stdio's stdout is line buffered (see main) so all
+	// of it is in the interpreters' own buffers, those only take a write
+	ob_flush_all();
+	write(STDERR_FILENO, msg, length);
+	_exit(90);
+}
+
+static void on_segv(int sig, siginfo_t* info, void* uctx) {
+	(void) sig;
+	(void) uctx;
+	char* addr = info->si_addr;
+	for (int i = 0; i < INTERP_STACK_MAX_MAPPED; i++) {
+		mapped_stack* m = &mapped[i];
+		if (!m->low_guard) continue;
+		char msg[128];
+		size_t n = 0;
+		if (addr >= m->low_guard && addr < m->low_guard + m->page) {
+			n = append(msg, n, sizeof(msg), "Stack underflow: popped or read past the bottom of the data stack\n");
+			report(msg, n);
+		}
+		if (addr >= m->high_guard && addr < m->high_guard + m->page) {
+			n = append(msg, n, sizeof(msg), "Stack overflow: the data stack holds ");
+			n = append_size(msg, n, sizeof(msg), m->slots);
+			n = append(msg, n, sizeof(msg), " values, see --stack-size\n");
+			report(msg, n);
+		}
+	}
+	// not ours, crash the way we would have
+	signal(SIGSEGV, SIG_DFL);
+	raise(SIGSEGV);
+}
+
+static void install_handler() {
+	stack_t ss = {.ss_sp = altstack, .ss_size = sizeof(altstack)};
+	sigaltstack(&ss, NULL);
+	struct sigaction sa = {0};
+	sa.sa_sigaction = on_segv;
+	sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGSEGV, &sa, NULL);
+	handler_installed = true;
+}
+
+stack_node* interp_stack_map(size_t* slots) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t bytes = (*slots * sizeof(stack_node) + page - 1) / page * page;
+	if (bytes == 0) bytes = page;
+	char* base = mmap(NULL, bytes + 2 * page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	sl_assert(base != MAP_FAILED, "Couldn't reserve a data stack of %zu values\n", *slots);
+	sl_assert(mprotect(base + page, bytes, PROT_READ | PROT_WRITE) == 0, "Couldn't reserve a data stack of %zu values\n", *slots);
+
+	*slots = bytes / sizeof(stack_node);
+	if (!handler_installed) install_handler();
+	for (int i = 0; i < INTERP_STACK_MAX_MAPPED; i++) {
+		if (mapped[i].low_guard) continue;
+		mapped[i] = (mapped_stack) {.low_guard = base, .high_guard = base + page + bytes, .page = page, .slots = *slots};
+		break;
+	}
+	return (stack_node*) (base + page);
+}
+
+void interp_stack_unmap(stack_node* stack, size_t slots) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	char* base = (char*) stack - page;
+	for (int i = 0; i < INTERP_STACK_MAX_MAPPED; i++) {
+		if (mapped[i].low_guard == base) mapped[i] = (mapped_stack) {0};
+	}
+	munmap(base, slots * sizeof(stack_node) + 2 * page);
+}
@@ -0,0 +1,19 @@
+#ifndef INTERPRETER_STACK_H
+#define INTERPRETER_STACK_H
+#include "interpreter.h"
+#include <stddef.h>
+
+/**
+ *  The data stack
+ *    Reserved with mmap between two PROT_NONE guard pages, so pushes and pops stay
+ *    unchecked: running off either end faults on a guard page, and a SIGSEGV handler
+ *    turns that into a normal spaz error (exit 90) instead of corrupting memory.
+ *    Pages are only backed once they're touched, so a large reservation is cheap.
+ */
+#define INTERP_STACK_DEFAULT_SLOTS (1 << 20)
+
+// Rounds *slots up to whole pages, returns the first slot
+stack_node* interp_stack_map(size_t* slots);
+void        interp_stack_unmap(stack_node*, size_t slots);
+
+#endif
@@ -0,0 +1,427 @@
+#include "jit.h"
+#include "interpreter_builtins.h"
+#include "sl_assert.h"
+#include "sl_log.h"
+#include "switch.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+
+typedef void (*jit_entry)(interpreter_ctx*);
+
+typedef struct {
+	cvector_vector_type(uint8_t) code;
+	size_t*                      at;      // bytecode offset -> machine code offset
+	cvector_vector_type(size_t)  fixups;  // rel32 to patch, the bytecode target is stored in it for now
+	cvector_vector_type(size_t)  tables;  // a switch's lea of its table, the switch's index is stored in it
+} jit_buf;
+
+#define JIT(jb, ...) jit_bytes((jb), (const uint8_t[]) {__VA_ARGS__}, sizeof((const uint8_t[]) {__VA_ARGS__}))
+
+static void jit_bytes(jit_buf* jb, const uint8_t* bytes, size_t n) {
+	// cvector grows one element at a time, so keep doubling it ourselves
+	size_t size = cvector_size(jb->code), cap = cvector_capacity(jb->code);
+	if (cap < size + n)
+		cvector_grow(jb->code, size + n > cap * 2 ? size + n : cap * 2);
+	memcpy(jb->code + size, bytes, n);
+	cvector_set_size(jb->code, size + n);
+}
+
+static void jit_u32(jit_buf* jb, uint32_t v) {
+	jit_bytes(jb, (const uint8_t*) &v, sizeof(v));
+}
+
+static void jit_u64(jit_buf* jb, uint64_t v) {
+	jit_bytes(jb, (const uint8_t*) &v, sizeof(v));
+}
+
+// =================
+// Templates
+// =================
+// stack_top = r13 - r12 in slots
+static void jit_sync_top(jit_buf* jb) {
+	JIT(jb, 0x4C, 0x89, 0xE8);              // mov rax, r13
+	JIT(jb, 0x4C, 0x29, 0xE0);              // sub rax, r12
+	JIT(jb, 0x48, 0xC1, 0xF8, 0x03);        // sar rax, 3
+	JIT(jb, 0x89, 0x83);                    // mov [rbx + stack_top], eax
+	jit_u32(jb, offsetof(interpreter_ctx, stack_top));
+}
+
+// r13 = r12 + stack_top slots, natives move stack_top themselves
+static void jit_load_top(jit_buf* jb) {
+	JIT(jb, 0x48, 0x63, 0x83);              // movsxd rax, [rbx + stack_top]
+	jit_u32(jb, offsetof(interpreter_ctx, stack_top));
+	JIT(jb, 0x4D, 0x8D, 0x2C, 0xC4);        // lea r13, [r12 + rax * 8]
+}
+
+// fn(ictx, arg) with the stack in sync around it
+static void jit_call(jit_buf* jb, const void* fn, uint64_t arg) {
+	jit_sync_top(jb);
+	JIT(jb, 0x48, 0x89, 0xDF);              // mov rdi, rbx
+	JIT(jb, 0x48, 0xBE); jit_u64(jb, arg);  // mov rsi, arg
+	JIT(jb, 0x48, 0xB8); jit_u64(jb, (uint64_t) (uintptr_t) fn);
+	JIT(jb, 0xFF, 0xD0);                    // call rax
+	jit_load_top(jb);
+}
+
+static void jit_push(jit_buf* jb, stack_node v) {
+	JIT(jb, 0x48, 0xB8); jit_u64(jb, v.bits);  // mov rax, v
+	JIT(jb, 0x49, 0x83, 0xC5, 0x08);           // add r13, 8
+	JIT(jb, 0x49, 0x89, 0x45, 0x00);           // mov [r13], rax
+}
+
+// result in rax replaces the two operands
+static void jit_store_binary(jit_buf* jb) {
+	JIT(jb, 0x49, 0x89, 0x45, 0xF8);        // mov [r13 - 8], rax
+	JIT(jb, 0x49, 0x83, 0xED, 0x08);        // sub r13, 8
+}
+
+static void jit_box_int(jit_buf* jb) {
+	JIT(jb, 0x48, 0xBA); jit_u64(jb, SN_BOXED(INTEGER));  // mov rdx, tag
+	JIT(jb, 0x48, 0x09, 0xD0);                            // or rax, rdx
+}
+
+static void jit_int_binary(jit_buf* jb, bc_op op) {
+	JIT(jb, 0x41, 0x8B, 0x45, 0xF8);        // mov eax, [r13 - 8]
+	JIT(jb, 0x41, 0x8B, 0x4D, 0x00);        // mov ecx, [r13]
+	switch (op) {
+		case BC_ADD_I:  JIT(jb, 0x01, 0xC8); break;                                  // add eax, ecx
+		case BC_SUB_I:  JIT(jb, 0x29, 0xC8); break;                                  // sub eax, ecx
+		case BC_MUL_I:  JIT(jb, 0x0F, 0xAF, 0xC1); break;                            // imul eax, ecx
+		case BC_DIV_I:  JIT(jb, 0x99, 0xF7, 0xF9); break;                            // cdq, idiv ecx
+		case BC_MOD_I:  JIT(jb, 0x99, 0xF7, 0xF9, 0x89, 0xD0); break;                // cdq, idiv ecx, mov eax, edx
+		case BC_GT_I:   JIT(jb, 0x39, 0xC8, 0x0F, 0x9F, 0xC0, 0x0F, 0xB6, 0xC0); break; // cmp, setg al, movzx
+		case BC_LT_I:   JIT(jb, 0x39, 0xC8, 0x0F, 0x9C, 0xC0, 0x0F, 0xB6, 0xC0); break; // cmp, setl al, movzx
+		case BC_EQ_I:   JIT(jb, 0x39, 0xC8, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0); break; // cmp, sete al, movzx
+		case BC_LAND_I:
+			JIT(jb, 0x85, 0xC0, 0x0F, 0x95, 0xC0);  // test eax, eax; setne al
+			JIT(jb, 0x85, 0xC9, 0x0F, 0x95, 0xC1);  // test ecx, ecx; setne cl
+			JIT(jb, 0x20, 0xC8, 0x0F, 0xB6, 0xC0);  // and al, cl; movzx eax, al
+			break;
+		case BC_LOR_I:
+			JIT(jb, 0x09, 0xC8, 0x0F, 0x95, 0xC0, 0x0F, 0xB6, 0xC0);  // or eax, ecx; setne al; movzx
+			break;
+		default: sl_assert(0, "Not an int operator: %d\n", op);
+	}
+	// writing eax cleared the top half of rax
+	jit_box_int(jb);
+	jit_store_binary(jb);
+}
+
+static void jit_double_binary(jit_buf* jb, bc_op op) {
+	JIT(jb, 0xF2, 0x41, 0x0F, 0x10, 0x45, 0xF8);  // movsd xmm0, [r13 - 8]
+	JIT(jb, 0xF2, 0x41, 0x0F, 0x10, 0x4D, 0x00);  // movsd xmm1, [r13]
+	switch (op) {
+		case BC_ADD_D: JIT(jb, 0xF2, 0x0F, 0x58, 0xC1); break;  // addsd xmm0, xmm1
+		case BC_SUB_D: JIT(jb, 0xF2, 0x0F, 0x5C, 0xC1); break;  // subsd
+		case BC_MUL_D: JIT(jb, 0xF2, 0x0F, 0x59, 0xC1); break;  // mulsd
+		case BC_DIV_D: JIT(jb, 0xF2, 0x0F, 0x5E, 0xC1); break;  // divsd
+		// comparisons are false when either side is NaN, like in C
+		case BC_GT_D:
+			JIT(jb, 0x31, 0xC0, 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x97, 0xC0);  // xor eax, eax; ucomisd xmm0, xmm1; seta al
+			jit_box_int(jb);
+			jit_store_binary(jb);
+			return;
+		case BC_LT_D:
+			JIT(jb, 0x31, 0xC0, 0x66, 0x0F, 0x2E, 0xC8, 0x0F, 0x97, 0xC0);  // xor eax, eax; ucomisd xmm1, xmm0; seta al
+			jit_box_int(jb);
+			jit_store_binary(jb);
+			return;
+		case BC_EQ_D:
+			JIT(jb, 0x31, 0xC0, 0x66, 0x0F, 0x2E, 0xC1);  // xor eax, eax; ucomisd xmm0, xmm1
+			JIT(jb, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1);  // sete al; setnp cl
+			JIT(jb, 0x20, 0xC8);                          // and al, cl
+			jit_box_int(jb);
+			jit_store_binary(jb);
+			return;
+		default: sl_assert(0, "Not a double operator: %d\n", op);
+	}
+	// sn_from_double: any NaN becomes the positive quiet one
+	JIT(jb, 0x66, 0x48, 0x0F, 0x7E, 0xC0);        // movq rax, xmm0
+	JIT(jb, 0x66, 0x0F, 0x2E, 0xC0, 0x7B, 0x0A);  // ucomisd xmm0, xmm0; jnp +10
+	JIT(jb, 0x48, 0xB8); jit_u64(jb, 0x7FF8000000000000ull);
+	jit_store_binary(jb);
+}
+
+static void jit_branch_false(jit_buf* jb, int32_t target) {
+	// falls through, popping, only on a nonzero int
+	JIT(jb, 0x49, 0x8B, 0x45, 0x00);        // mov rax, [r13]
+	JIT(jb, 0x48, 0x89, 0xC2);              // mov rdx, rax
+	JIT(jb, 0x48, 0xC1, 0xEA, 0x30);        // shr rdx, 48
+	JIT(jb, 0x81, 0xFA); jit_u32(jb, SN_BOXED(INTEGER) >> SN_TAG_SHIFT);
+	JIT(jb, 0x0F, 0x85);                    // jne target
+	cvector_push_back(jb->fixups, cvector_size(jb->code));
+	jit_u32(jb, target);
+	JIT(jb, 0x85, 0xC0);                    // test eax, eax
+	JIT(jb, 0x0F, 0x84);                    // je target
+	cvector_push_back(jb->fixups, cvector_size(jb->code));
+	jit_u32(jb, target);
+	JIT(jb, 0x49, 0x83, 0xED, 0x08);        // sub r13, 8
+}
+
+static void jit_jump(jit_buf* jb, int32_t target) {
+	JIT(jb, 0xE9);                          // jmp target
+	cvector_push_back(jb->fixups, cvector_size(jb->code));
+	jit_u32(jb, target);
+}
+
+// A procedure is a native call, its RET a native ret. Tail calls are plain jumps
+static void jit_call_proc(jit_buf* jb, int32_t target) {
+	JIT(jb, 0xFF, 0x83);                    // inc dword [rbx + call_depth]
+	jit_u32(jb, offsetof(interpreter_ctx, call_depth));
+	JIT(jb, 0x81, 0xBB);                    // cmp dword [rbx + call_depth], max
+	jit_u32(jb, offsetof(interpreter_ctx, call_depth));
+	jit_u32(jb, ICTX_CALL_DEPTH_MAX);
+	JIT(jb, 0x7E, 0x00);                    // jle past the error
+	size_t skip = cvector_size(jb->code);
+	jit_call(jb, (const void*) ictx_call_overflow, 0);
+	jb->code[skip - 1] = (uint8_t) (cvector_size(jb->code) - skip);
+	// the body runs with the same 16 byte alignment as the code here
+	JIT(jb, 0x48, 0x83, 0xEC, 0x08);        // sub rsp, 8
+	JIT(jb, 0xE8);                          // call target
+	cvector_push_back(jb->fixups, cvector_size(jb->code));
+	jit_u32(jb, target);
+	JIT(jb, 0x48, 0x83, 0xC4, 0x08);        // add rsp, 8
+	JIT(jb, 0xFF, 0x8B);                    // dec dword [rbx + call_depth]
+	jit_u32(jb, offsetof(interpreter_ctx, call_depth));
+}
+
+static int jit_rt_switch(interpreter_ctx*, const bc_switch*);
+
+// The case's index comes back from jit_rt_switch, its table of offsets goes after the code
+static void jit_switch(jit_buf* jb, int32_t index, const bc_switch* sw) {
+	jit_sync_top(jb);
+	JIT(jb, 0x48, 0x89, 0xDF);              // mov rdi, rbx
+	JIT(jb, 0x48, 0xBE); jit_u64(jb, (uintptr_t) sw);
+	JIT(jb, 0x48, 0xB8); jit_u64(jb, (uint64_t) (uintptr_t) jit_rt_switch);
+	JIT(jb, 0xFF, 0xD0);                    // call rax
+	JIT(jb, 0x89, 0xC1);                    // mov ecx, eax
+	jit_load_top(jb);
+	JIT(jb, 0x48, 0x8D, 0x05);              // lea rax, [rip + table]
+	cvector_push_back(jb->tables, cvector_size(jb->code));
+	jit_u32(jb, index);
+	JIT(jb, 0x48, 0x63, 0x0C, 0x88);        // movsxd rcx, [rax + rcx * 4]
+	JIT(jb, 0x48, 0x01, 0xC8);              // add rax, rcx
+	JIT(jb, 0xFF, 0xE0);                    // jmp rax
+}
+
+// =================
+// Runtime entry points
+// =================
+static void jit_rt_bad_operator(interpreter_ctx* ictx, const String_View* name) {
+	(void) ictx;
+	sl_assert(0, "Undefined operation \"" SV_Fmt "\"\n", SV_Arg(*name));
+}
+
+static void jit_rt_bad_call(interpreter_ctx* ictx, const String_View* name) {
+	(void) ictx;
+	sl_assert(0, "Proc call for '" SV_Fmt "' not implemented", SV_Arg(*name));
+}
+
+static void jit_rt_call_pop(interpreter_ctx* ictx, interp_builtin_id id) {
+	interp_builtin_call(ictx, id);
+	ictx->stack_top--;
+}
+
+// the entry in the switch's table, the last one is the exit
+static int jit_rt_switch(interpreter_ctx* ictx, const bc_switch* sw) {
+	int c = sw_lookup(sw->def->table, ictx->stack[ictx->stack_top--]);
+	return c < 0 ? (int) cvector_size(sw->targets) : c;
+}
+
+// =================
+// Translation
+// =================
+static void jit_insn(jit_buf* jb, const bytecode* bc, bc_op op, int32_t arg) {
+	switch (op) {
+		case BC_PUSH_INT:    jit_push(jb, sn_from_int(arg)); break;
+		case BC_PUSH_DOUBLE: jit_push(jb, sn_from_double(bc->doubles[arg])); break;
+		case BC_PUSH_STRING: jit_push(jb, ictx_string_from_pool(bc->strings[arg])); break;
+		case BC_PUSH_CHAR:   jit_push(jb, sn_from_char(arg)); break;
+
+		case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_MOD:
+		case BC_GT: case BC_LT: case BC_LAND: case BC_LOR: case BC_EQ:
+			jit_call(jb, (const void*) ictx_apply_binary, bc_binary_operator(op));
+			break;
+		case BC_ADD_I: case BC_SUB_I: case BC_MUL_I: case BC_DIV_I: case BC_MOD_I:
+		case BC_GT_I: case BC_LT_I: case BC_LAND_I: case BC_LOR_I: case BC_EQ_I:
+			jit_int_binary(jb, op);
+			break;
+		case BC_ADD_D: case BC_SUB_D: case BC_MUL_D: case BC_DIV_D:
+		case BC_GT_D: case BC_LT_D: case BC_EQ_D:
+			jit_double_binary(jb, op);
+			break;
+		case BC_BAD_OPERATOR:
+			jit_call(jb, (const void*) jit_rt_bad_operator, (uintptr_t) &bc->names[arg]);
+			break;
+
+		case BC_POP:
+			JIT(jb, 0x49, 0x81, 0xED); jit_u32(jb, (uint32_t) arg * sizeof(stack_node));  // sub r13, n * 8
+			// the slot below the stack is the lowest top there is
+			JIT(jb, 0x49, 0x8D, 0x44, 0x24, 0xF8);           // lea rax, [r12 - 8]
+			JIT(jb, 0x4C, 0x39, 0xE8);                       // cmp rax, r13
+			JIT(jb, 0x76, 0x00);                             // jbe past the error
+			{
+				size_t skip = cvector_size(jb->code);
+				jit_call(jb, (const void*) ictx_pop_underflow, 0);
+				jb->code[skip - 1] = (uint8_t) (cvector_size(jb->code) - skip);
+			}
+			break;
+		case BC_DUP:
+			if (arg <= 0) break;
+			JIT(jb, 0x49, 0x8B, 0x45, 0x00);                 // mov rax, [r13]
+			JIT(jb, 0xB9); jit_u32(jb, arg);                 // mov ecx, n
+			JIT(jb, 0x49, 0x83, 0xC5, 0x08);                 // add r13, 8
+			JIT(jb, 0x49, 0x89, 0x45, 0x00);                 // mov [r13], rax
+			JIT(jb, 0xFF, 0xC9, 0x75, 0xF4);                 // dec ecx; jnz back to the add
+			break;
+		case BC_PEEK:
+			// the value depth below the top has to be at or above the bottom
+			JIT(jb, 0x49, 0x8D, 0x84, 0x24); jit_u32(jb, (uint32_t) arg * sizeof(stack_node));  // lea rax, [r12 + depth * 8]
+			JIT(jb, 0x4C, 0x39, 0xE8);                       // cmp rax, r13
+			JIT(jb, 0x76, 0x00);                             // jbe past the error
+			{
+				size_t skip = cvector_size(jb->code);
+				jit_call(jb, (const void*) ictx_pop_underflow, 0);
+				jb->code[skip - 1] = (uint8_t) (cvector_size(jb->code) - skip);
+			}
+			JIT(jb, 0x49, 0x8B, 0x85); jit_u32(jb, (uint32_t) -arg * sizeof(stack_node));  // mov rax, [r13 - depth * 8]
+			JIT(jb, 0x49, 0x83, 0xC5, 0x08);                 // add r13, 8
+			JIT(jb, 0x49, 0x89, 0x45, 0x00);                 // mov [r13], rax
+			break;
+
+		case BC_CALL:
+			jit_call(jb, (const void*) interp_builtin_call, arg);
+			break;
+		case BC_CALL_POP:
+			jit_call(jb, (const void*) jit_rt_call_pop, arg);
+			break;
+		case BC_BAD_CALL:
+			jit_call(jb, (const void*) jit_rt_bad_call, (uintptr_t) &bc->names[arg]);
+			break;
+
+		case BC_BRANCH_FALSE:
+			jit_branch_false(jb, arg);
+			break;
+		case BC_CALL_PROC:
+			jit_call_proc(jb, arg);
+			break;
+		case BC_JUMP:
+			jit_jump(jb, arg);
+			break;
+		case BC_RET:
+			JIT(jb, 0xC3);                        // ret
+			break;
+		case BC_HALT:
+			jit_jump(jb, cvector_size(bc->code)); // the epilogue
+			break;
+		case BC_LOOP:
+			JIT(jb, 0x48, 0xB8); jit_u64(jb, (uintptr_t) &bc->loops[arg].def->iterations);  // mov rax, &iterations
+			JIT(jb, 0x48, 0xFF, 0x00);                                                     // inc qword [rax]
+			jit_jump(jb, bc->loops[arg].head);
+			break;
+		case BC_SWITCH:
+			jit_switch(jb, arg, &bc->switches[arg]);
+			break;
+		case BC_GOTO:
+			jit_jump(jb, arg);
+			break;
+	}
+}
+
+bool jit_supported() {
+	return true;
+}
+
+jit_code jit_compile(const bytecode* bc) {
+	size_t size = cvector_size(bc->code);
+	jit_buf jb = {0};
+	jb.at = calloc(size + 1, sizeof(size_t));
+	sl_assert(jb.at, "Out of memory compiling to machine code");
+
+	JIT(&jb, 0x53, 0x41, 0x54, 0x41, 0x55);  // push rbx; push r12; push r13
+	JIT(&jb, 0x48, 0x89, 0xFB);              // mov rbx, rdi
+	JIT(&jb, 0x4C, 0x8B, 0xA3);              // mov r12, [rbx + stack]
+	jit_u32(&jb, offsetof(interpreter_ctx, stack));
+	jit_load_top(&jb);
+
+	for (size_t pc = 0; pc < size; ) {
+		jb.at[pc] = cvector_size(jb.code);
+		bc_op op = bc->code[pc++];
+		int32_t arg = 0;
+		if (bc_has_arg(op)) {
+			memcpy(&arg, bc->code + pc, sizeof(arg));
+			pc += sizeof(arg);
+		}
+		jit_insn(&jb, bc, op, arg);
+	}
+	jb.at[size] = cvector_size(jb.code);
+
+	jit_sync_top(&jb);
+	JIT(&jb, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);  // pop r13; pop r12; pop rbx; ret
+
+	for (size_t* it = cvector_begin(jb.fixups); it != cvector_end(jb.fixups); it++) {
+		int32_t target;
+		memcpy(&target, jb.code + *it, sizeof(target));
+		int32_t rel = (int32_t) (jb.at[target] - (*it + sizeof(rel)));
+		memcpy(jb.code + *it, &rel, sizeof(rel));
+	}
+	// offsets from the start of each table to the cases, then the exit
+	for (size_t* it = cvector_begin(jb.tables); it != cvector_end(jb.tables); it++) {
+		int32_t index;
+		memcpy(&index, jb.code + *it, sizeof(index));
+		const bc_switch* sw = &bc->switches[index];
+		while (cvector_size(jb.code) % 4) JIT(&jb, 0xCC);
+		size_t table = cvector_size(jb.code);
+		int32_t rel = (int32_t) (table - (*it + sizeof(rel)));
+		memcpy(jb.code + *it, &rel, sizeof(rel));
+		for (size_t i = 0; i <= cvector_size(sw->targets); i++) {
+			int32_t target = i < cvector_size(sw->targets) ? sw->targets[i] : sw->exit;
+			jit_u32(&jb, (uint32_t) (int32_t) (jb.at[target] - table));
+		}
+	}
+
+	jit_code jc = {.size = cvector_size(jb.code)};
+	jc.mem = mmap(NULL, jc.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	sl_assert(jc.mem != MAP_FAILED, "Couldn't map %zu bytes for machine code\n", jc.size);
+	memcpy(jc.mem, jb.code, jc.size);
+	sl_assert(mprotect(jc.mem, jc.size, PROT_READ | PROT_EXEC) == 0, "Couldn't make the machine code executable\n");
+	sl_debug(SL_CAT_INTERP, "jit: %zu bytes of bytecode to %zu bytes of machine code", size, jc.size);
+
+	cvector_free(jb.code);
+	cvector_free(jb.fixups);
+	cvector_free(jb.tables);
+	free(jb.at);
+	return jc;
+}
+
+void jit_run(interpreter_ctx* ictx, const jit_code* jc) {
+	ictx_enter(ictx);
+	((jit_entry) (void*) jc->mem)(ictx);
+}
+
+void jit_free(jit_code* jc) {
+	if (jc->mem) munmap(jc->mem, jc->size);
+	*jc = (jit_code) {0};
+}
+
+#else
+
+bool jit_supported() {
+	return false;
+}
+
+jit_code jit_compile(const bytecode* bc) {
+	return (jit_code) {0};
+}
+
+void jit_run(interpreter_ctx* ictx, const jit_code* jc) {
+	sl_assert(0, "--jit isn't supported on this platform\n");
+}
+
+void jit_free(jit_code* jc) {}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef JIT_H
+#define JIT_H
+#include "compiler.h"
+#include "interpreter.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ *  Template JIT (--jit, Linux x86-64 only)
+ *    Translates compiled bytecode one instruction at a time into machine code, in memory
+ *    that's mapped executable once it's written.
+ *    + pushes, stack ops, typed operators, branches -> inline templates
+ *    + generic operators and calls -> a call back into the runtime (ictx_apply_binary,
+ *      interp_builtin_call), with stack_top written back before and reloaded after
+ *    + procedures -> native call/ret on the machine stack, which is the return stack,
+ *      tail calls -> jmp
+ *    + switch -> a call that finds the case, then an indirect jmp through a table of
+ *      offsets placed after the code
+ *    Registers while it runs: rbx = the context, r12 = the bottom of the stack,
+ *    r13 = the top slot. The guard pages still catch running off either end.
+ *    The bytecode has to outlive the code, unresolved names point into it.
+ */
+typedef struct {
+	uint8_t* mem;
+	size_t   size;
+} jit_code;
+
+bool     jit_supported();
+// mem is NULL when this platform isn't supported
+jit_code jit_compile(const bytecode*);
+void     jit_run(interpreter_ctx*, const jit_code*);
+void     jit_free(jit_code*);
+
+#endif
@@ -1,22 +1,143 @@
 #include "sl_log.h"
 #define DEBUG_AST 1
+#include "array.h"
 #include "ast.h"
 #include "ast_free.h"
 #include "ast_print.h"
+#include "closure.h"
+#include "compiler.h"
 #include "cvector.h"
+#include "emit_c.h"
+#include "input.h"
 #include "interpreter.h"
+#include "interpreter_builtins.h"
+#include "jit.h"
+#include "optimize.h"
+#include "profile.h"
+#include "rope.h"
+#include "verify.h"
 #include "tokenizer.h"
 #include "parser.h"
+#include "strpool.h"
+#include "vm.h"
 #include <stdio.h>
+#include <string.h>
 #include "../gengetopt/cmdline.h"
 
+typedef enum {
+	ENGINE_AST, ENGINE_VM, ENGINE_CLOSURE, ENGINE_JIT
+} engine;
+
+static void run_node(interpreter_ctx* ictx, AST_Node n, engine e) {
+	interp_builtin_link_node(n);
+	switch (e) {
+		case ENGINE_AST:
+			ictx_run_node(ictx, n);
+			break;
+		case ENGINE_VM: {
+			bytecode bc = {0};
+			bc_compile_node(&bc, n);
+			bc_compile_procs(&bc);
+			vm_run(ictx, &bc);
+			bc_free(&bc);
+			break;
+		}
+		case ENGINE_CLOSURE: {
+			closure_program cp = cl_compile_node(n);
+			cl_run(ictx, &cp);
+			cl_free(&cp);
+			break;
+		}
+		case ENGINE_JIT: {
+			bytecode bc = {0};
+			bc_compile_node(&bc, n);
+			bc_compile_procs(&bc);
+			jit_code jc = jit_compile(&bc);
+			jit_run(ictx, &jc);
+			jit_free(&jc);
+			bc_free(&bc);
+			break;
+		}
+	}
+}
+
+static void optimize(Program* p, int level, bool dump) {
+	if (level < 1) return;
+	if (dump) {
+		printf("Before -O%d\n", level);
+		printf("==========================================\n");
+		ast_print_node((AST_Node) {.nodeType = AST_NODE_TYPE_PROGRAM, .program = *p}, 0);
+		printf("==========================================\n");
+	}
+	opt_stats stats = opt_fold_program(p);
+	if (dump) {
+		printf("After -O%d (folded %zu, simplified %zu, removed %zu ifs)\n", level, stats.folded, stats.simplified, stats.ifs);
+		printf("==========================================\n");
+		ast_print_node((AST_Node) {.nodeType = AST_NODE_TYPE_PROGRAM, .program = *p}, 0);
+		printf("==========================================\n");
+	}
+}
+
+// Prints why when the program can't run
+static bool verify(Program p, struct gengetopt_args_info* ai, vfy_result* v) {
+	*v = vfy_program(p);
+	if (!v->ok && v->unknown.count) {
+		fprintf(stderr, "Unknown procedure: nothing named '" SV_Fmt "' to call\n", SV_Arg(v->unknown));
+		return false;
+	}
+	if (!v->ok) {
+		fprintf(stderr, "Stack underflow: %s needs %d value%s, at most %d are on the stack at that point\n",
+		        v->what, v->need, v->need == 1 ? "" : "s", v->have);
+		return false;
+	}
+	if (ai->stack_size_given && v->bounded && v->max_depth > ai->stack_size_arg) {
+		fprintf(stderr, "Stack overflow: the program can reach %d values, see --stack-size\n", v->max_depth);
+		return false;
+	}
+	return true;
+}
+
+// Optimizing can turn one node into several (an if that always runs becomes its block).
+// Procedures are kept in procs, later nodes can still call them. The loop counts of
+// everything else go to profile (when there is one) before it's freed
+static void run_stream_node(interpreter_ctx* ictx, AST_Node n, engine e, int level, bool dump, Program* procs, prof_report* profile) {
+	Program p = {0};
+	cvector_push_back(p.p, n);
+	optimize(&p, level, dump);
+	for (AST_Node* it = cvector_begin(p.p); it != cvector_end(p.p); it++) {
+		if (it->nodeType == AST_NODE_TYPE_PROCEDURE_DEF) {
+			interp_builtin_link_node(*it);
+			cvector_push_back(procs->p, *it);
+			*it = (AST_Node) {.nodeType = AST_NODE_TYPE_UNDEFINED};
+			continue;
+		}
+		run_node(ictx, *it, e);
+	}
+	if (profile) prof_collect(profile, p);
+	ast_free_program(p);
+	// what the statement printed goes before anything printed about the next one
+	ob_flush(ictx->out);
+}
+
 int main(int argc, char** argv) {
+	// Only diagnostics go through stdio, program output has its own buffer (output.h).
+	// Line buffering keeps stdio empty between lines, so a stack fault's handler, which
+	// can't call stdio, loses none of it
+	setvbuf(stdout, NULL, _IOLBF, 0);
 	struct gengetopt_args_info ai;
 	if (cmdline_parser(argc, argv, &ai) != 0) {
 		fprintf(stderr, "Failed to parse arguments\n");
 		return 1;
 	}
 
+	if (ai.log_given && sl_log_configure(ai.log_arg) != 0) {
+		fprintf(stderr, "Invalid log spec: %s\n", ai.log_arg);
+		return 5;
+	}
+	if (ai.log_file_given && sl_log_set_file(ai.log_file_arg) != 0) {
+		return 5;
+	}
+
 	if (argc == 1) {
 		cmdline_parser_print_help();
 		return 3;
@@ -27,6 +148,30 @@ int main(int argc, char** argv) {
 		return 2;
 	}
 
+	if (ai.optimize_arg < 0) {
+		fprintf(stderr, "Invalid optimization level: %d\n", ai.optimize_arg);
+		return 1;
+	}
+
+	if (ai.emit_c_given && ai.stream_given) {
+		fprintf(stderr, "--emit-c needs the whole program, it can't stream\n");
+		return 1;
+	}
+
+	if (ai.jit_given && !jit_supported()) {
+		fprintf(stderr, "--jit is only supported on Linux x86-64\n");
+		return 1;
+	}
+
+	if (ai.stack_size_arg <= 0) {
+		fprintf(stderr, "Invalid stack size: %ld\n", ai.stack_size_arg);
+		return 1;
+	}
+	if (ai.output_buffer_arg < 0) {
+		fprintf(stderr, "Invalid output buffer size: %ld\n", ai.output_buffer_arg);
+		return 1;
+	}
+
 	tokenizer_ctx ctx = tctx_from_file(ai.file_arg);
 	parse_ctx pctx = pctx_new(100);
 	AST_Node program = (AST_Node) {.nodeType=AST_NODE_TYPE_PROGRAM};
@@ -40,30 +185,30 @@ int main(int argc, char** argv) {
 		return 4;
 	}
 
+	// In streaming mode each top-level statement is run as soon as the parser
+	// knows it's complete, then released. Nothing accumulates in the program node.
+	// Otherwise the stack is sized once the program has been verified
+	interpreter_ctx ictx = {0};
+	Program stream_procs = {0};
+	prof_report profile = {0};
+	if (ai.stream_given) {
+		ictx = ictx_new_sized(ai.stack_size_arg);
+		ob_resize(ictx.out, ai.output_buffer_arg);
+	}
+	engine use = ai.jit_given                          ? ENGINE_JIT
+	           : strcmp(ai.engine_arg, "vm") == 0      ? ENGINE_VM
+	           : strcmp(ai.engine_arg, "closure") == 0 ? ENGINE_CLOSURE
+	           : ENGINE_AST;
+	if (ai.stream_given) {
+		printf("Interpretting program\n");
+	}
+
 	token tok;
 	while ((tok = tctx_get_next(&ctx)).type != T_EOF) {
 		tctx_advance(&ctx);
 		if (tok.type == T_EOF) break;
 
-		AST_Node n;
-		int p;
-		if ((p = try_convert_token_to_terminal(tok, &n)) != 0) {
-			pctx_push(&pctx, n);
-		}
-		else if ((p = try_convert_token_to_stackop(tok, &n)) != 0) {
-			sl_log("Converted to stack op");
-			pctx_push(&pctx, n);
-		}
-		else if ((p = try_convert_token_to_operator(tok, &n)) != 0) {
-			pctx_push(&pctx, n);
-		}
-		else if ((p = try_convert_token_to_reserved(tok, &n)) != 0) {
-			pctx_push(&pctx, n);
-		}
-		else {
-			if (tok.type == T_EOF) {
-				break;
-			}
+		if (pctx_consume_token(&pctx, tok) == 0) {
 			fprintf(stderr, "Couldn't convert the token, [str=" SV_Fmt ", v=%d] to a terminal."
 											"Continuing past it anyways.\n",
 											SV_Arg(tok.text), tok.type);
@@ -71,11 +216,17 @@ int main(int argc, char** argv) {
 			continue;
 		}
 
-		int reduceCount = 0;
-		while ((p = try_reduce(&pctx, &n)) != 0) {
-			reduceCount++;
-			pctx_pop_n(&pctx, p);
-			pctx_push(&pctx, n);
+		AST_Node n;
+		while (ai.stream_given && pctx_take_complete(&pctx, &n)) {
+			if (ai.ptree_given) ast_print_node(n, 0);
+			run_stream_node(&ictx, n, use, ai.optimize_arg, ai.fdump_given, &stream_procs, ai.profile_given ? &profile : NULL);
+		}
+	}
+	if (ai.stream_given) {
+		AST_Node n;
+		while (pctx_take_bottom(&pctx, &n)) {
+			if (ai.ptree_given) ast_print_node(n, 0);
+			run_stream_node(&ictx, n, use, ai.optimize_arg, ai.fdump_given, &stream_procs, ai.profile_given ? &profile : NULL);
 		}
 	}
 	if (ai.verbose_given) {
@@ -85,23 +236,81 @@ int main(int argc, char** argv) {
 		printf("==========================================\n");
 	}
 
+	cvector_reserve(program.program.p, pctx.pstack.length);
 	for (int i = 0; i <= pctx.pstack.top; i++) {
 		cvector_push_back(program.program.p, pctx.pstack.data[i]);
 	}
-	if (ai.ptree_given) {
+	interp_builtin_link(program.program);
+	if (!ai.stream_given) optimize(&program.program, ai.optimize_arg, ai.fdump_given);
+	if (ai.ptree_given && !ai.stream_given) {
 		printf("Printing program\n");
 		printf("==========================================\n");
 		ast_print_node(program, 0);
 		printf("==========================================\n");
 	}
 
-	if (ai.interpret_given) {
+	if (ai.emit_c_given) {
+		vfy_result v;
+		if (!verify(program.program, &ai, &v)) return 90;
+		emitc_program(stdout, program.program, ai.stack_size_given ? ai.stack_size_arg : !v.bounded ? 0 : v.max_depth > 0 ? v.max_depth : 1,
+		              v.bounded && !v.may_underflow);
+	}
+	else if (ai.interpret_given && !ai.stream_given) {
+		vfy_result v;
+		if (!verify(program.program, &ai, &v)) return 90;
+		// no path goes deeper than max_depth, the guard pages only back that up.
+		// Unless recursion hid how deep it goes, then the guard pages are all there is
+		if (ai.stack_size_given)
+			ictx = ictx_new_sized(ai.stack_size_arg);
+		else if (v.bounded)
+			ictx = ictx_new_sized(v.max_depth > 0 ? v.max_depth : 1);
+		else
+			ictx = ictx_new();
+		ictx.verified = v.bounded && !v.may_underflow;
+		ob_resize(ictx.out, ai.output_buffer_arg);
 		printf("Interpretting program\n");
-		interpreter_ctx ictx = ictx_new();
-		ictx_run(&ictx, program.program);
+		if (use == ENGINE_VM || use == ENGINE_JIT) {
+			bytecode bc = bc_compile_program(program.program);
+			if (ai.verbose_given) {
+				printf("Printing bytecode\n");
+				printf("==========================================\n");
+				bc_disassemble(&bc);
+				printf("==========================================\n");
+			}
+			if (use == ENGINE_JIT) {
+				jit_code jc = jit_compile(&bc);
+				jit_run(&ictx, &jc);
+				jit_free(&jc);
+			}
+			else {
+				vm_run(&ictx, &bc);
+			}
+			bc_free(&bc);
+		}
+		else if (use == ENGINE_CLOSURE) {
+			closure_program cp = cl_compile_program(program.program);
+			cl_run(&ictx, &cp);
+			cl_free(&cp);
+		}
+		else {
+			ictx_run(&ictx, program.program);
+		}
+	}
+
+	if (ai.profile_given && (ai.interpret_given || ai.stream_given)) {
+		prof_collect(&profile, ai.stream_given ? stream_procs : program.program);
+		prof_print(stderr, &profile);
 	}
 
+	prof_free(&profile);
 	ast_free_program(program.program);
+	ast_free_program(stream_procs);
+	ictx_free(&ictx);
+	strpool_free();
+	hs_free();
+	rope_free();
+	in_free();
+	arr_free();
 	tctx_free(&ctx);
 	pctx_free(&pctx);
 
@@ -0,0 +1,198 @@
+#include "optimize.h"
+#include "ast_free.h"
+#include "interpreter.h"
+#include "sl_log.h"
+#include <limits.h>
+#include <stdlib.h>
+
+static bool opt_literal(Expression* e, stack_node* out) {
+	if (e->type != EXPRESSION_TYPE_TERM) return false;
+	Term t = e->ETerm.term;
+	switch (t.type) {
+		case TERM_TYPE_HEX_LIT:
+		case TERM_TYPE_DEC_LIT:    *out = sn_from_int(t._integer); break;
+		case TERM_TYPE_DOUBLE_LIT: *out = sn_from_double(t._double); break;
+		case TERM_TYPE_STRING_LIT: *out = ictx_string_from_pool(t._string); break;
+		case TERM_TYPE_CHR_LIT:    *out = ictx_char_from_sv(t._chr); break;
+	}
+	return true;
+}
+
+// What e leaves on the stack if it finishes, UNDEFINED when that isn't known
+static stack_node_type opt_static_type(Expression* e) {
+	stack_node v;
+	if (opt_literal(e, &v)) return sn_type(v);
+	if (e->type == EXPRESSION_TYPE_EEO)
+		return ictx_binary_result_type(e->EEO.operation.code, opt_static_type(e->EEO.left), opt_static_type(e->EEO.right));
+	return UNDEFINED;
+}
+
+static bool opt_is_int(Expression* e, int value) {
+	stack_node v;
+	return opt_literal(e, &v) && sn_is_int(v) && sn_int(v) == value;
+}
+
+// Replaces e (an EEO) with one of its operands, freeing the rest
+static Expression* opt_keep(Expression* e, Expression* keep) {
+	ast_free_expression(keep == e->EEO.left ? e->EEO.right : e->EEO.left);
+	free(e);
+	return keep;
+}
+
+static Expression* opt_expression(Expression* e, opt_stats* stats) {
+	if (e->type != EXPRESSION_TYPE_EEO) return e;
+	e->EEO.left = opt_expression(e->EEO.left, stats);
+	e->EEO.right = opt_expression(e->EEO.right, stats);
+	Expression *left = e->EEO.left, *right = e->EEO.right;
+	OperatorCode op = e->EEO.operation.code;
+
+	stack_node l, r, res;
+	if (opt_literal(left, &l) && opt_literal(right, &r)) {
+		// integer division that would trap stays for the run time to hit
+		bool traps = (op == OPERATOR_CODE_DIV || op == OPERATOR_CODE_MOD) && sn_is_int(l) && sn_is_int(r) &&
+		             (sn_int(r) == 0 || (sn_int(l) == INT_MIN && sn_int(r) == -1));
+		if (!traps && ictx_binary_eval(op, l, r, &res) && (sn_type(res) == INTEGER || sn_type(res) == DOUBLE)) {
+			Term t = {.state = left->ETerm.term.state};
+			if (sn_type(res) == INTEGER) {
+				t.type = TERM_TYPE_DEC_LIT;
+				t._integer = sn_int(res);
+			}
+			else {
+				t.type = TERM_TYPE_DOUBLE_LIT;
+				t._double = sn_double(res);
+			}
+			ast_free_expression(left);
+			ast_free_expression(right);
+			e->type = EXPRESSION_TYPE_TERM;
+			e->ETerm.term = t;
+			stats->folded++;
+			return e;
+		}
+	}
+
+	// -0.0 + 0 is 0.0, so adding zero is only an identity for ints
+	stack_node_type lt = opt_static_type(left), rt = opt_static_type(right);
+	bool l_int = lt == INTEGER, l_num = l_int || lt == DOUBLE;
+	bool r_int = rt == INTEGER, r_num = r_int || rt == DOUBLE;
+	Expression* keep = NULL;
+	switch (op) {
+		case OPERATOR_CODE_ADD:
+			if (l_int && opt_is_int(right, 0))     keep = left;
+			else if (r_int && opt_is_int(left, 0)) keep = right;
+			break;
+		case OPERATOR_CODE_SUB:
+			if (l_int && opt_is_int(right, 0))     keep = left;
+			break;
+		case OPERATOR_CODE_MUL:
+			if (l_num && opt_is_int(right, 1))     keep = left;
+			else if (r_num && opt_is_int(left, 1)) keep = right;
+			break;
+		case OPERATOR_CODE_DIV:
+			if (l_num && opt_is_int(right, 1))     keep = left;
+			break;
+		default: break;
+	}
+	if (keep) {
+		stats->simplified++;
+		return opt_keep(e, keep);
+	}
+	return e;
+}
+
+static void opt_items(cvector_vector_type(StatementExpression) items, cvector_vector_type(StatementExpression)* out, opt_stats*);
+
+// Appends what se becomes to out, which can be nothing or several items
+static void opt_stmt_expr(StatementExpression se, cvector_vector_type(StatementExpression)* out, opt_stats* stats) {
+	if (se.type == STATEMENT_EXPR_TYPE_EXPRESSION) {
+		se.expr = opt_expression(se.expr, stats);
+		cvector_push_back(*out, se);
+		return;
+	}
+	// a loop's condition runs more than once, whatever it folds to stays a loop
+	if (se.stmt->type == STATEMENT_TYPE_WHILE) {
+		While* w = &se.stmt->whilee;
+		w->expression = opt_expression(w->expression, stats);
+		cvector_vector_type(StatementExpression) body = NULL;
+		opt_items(w->block.items, &body, stats);
+		cvector_free(w->block.items);
+		w->block.items = body;
+		cvector_push_back(*out, se);
+		return;
+	}
+	if (se.stmt->type == STATEMENT_TYPE_SWITCH) {
+		Switch* sw = &se.stmt->switchh;
+		sw->expression = opt_expression(sw->expression, stats);
+		for (SwitchCase* c = cvector_begin(sw->block.cases); c != cvector_end(sw->block.cases); c++) {
+			cvector_vector_type(StatementExpression) body = NULL;
+			opt_items(c->b.items, &body, stats);
+			cvector_free(c->b.items);
+			c->b.items = body;
+		}
+		cvector_push_back(*out, se);
+		return;
+	}
+	if (se.stmt->type != STATEMENT_TYPE_IFF) {
+		cvector_push_back(*out, se);
+		return;
+	}
+
+	Iff* iff = &se.stmt->iff;
+	iff->expression = opt_expression(iff->expression, stats);
+	cvector_vector_type(StatementExpression) body = NULL;
+	opt_items(iff->block.items, &body, stats);
+	cvector_free(iff->block.items);
+	iff->block.items = body;
+
+	stack_node cond;
+	if (!opt_literal(iff->expression, &cond)) {
+		cvector_push_back(*out, se);
+		return;
+	}
+	stats->ifs++;
+	if (sn_is_int(cond) && sn_int(cond) != 0) {
+		for (StatementExpression* it = cvector_begin(body); it != cvector_end(body); it++) {
+			cvector_push_back(*out, *it);
+		}
+		cvector_free(body);
+		ast_free_expression(iff->expression);
+	}
+	else {
+		ast_free_block(iff->block);
+		cvector_push_back(*out, ((StatementExpression) {.type = STATEMENT_EXPR_TYPE_EXPRESSION, .expr = iff->expression}));
+	}
+	free(se.stmt);
+}
+
+static void opt_items(cvector_vector_type(StatementExpression) items, cvector_vector_type(StatementExpression)* out, opt_stats* stats) {
+	for (StatementExpression* it = cvector_begin(items); it != cvector_end(items); it++) {
+		opt_stmt_expr(*it, out, stats);
+	}
+}
+
+opt_stats opt_fold_program(Program* p) {
+	opt_stats stats = {0};
+	cvector_vector_type(AST_Node) nodes = NULL;
+	cvector_vector_type(StatementExpression) items = NULL;
+	for (AST_Node* n = cvector_begin(p->p); n != cvector_end(p->p); n++) {
+		if (n->nodeType == AST_NODE_TYPE_PROCEDURE_DEF) {
+			cvector_vector_type(StatementExpression) body = NULL;
+			opt_items(n->procDef->block.items, &body, &stats);
+			cvector_free(n->procDef->block.items);
+			n->procDef->block.items = body;
+		}
+		if (n->nodeType != AST_NODE_TYPE_STATEMENT_EXPRESSION) {
+			cvector_push_back(nodes, *n);
+			continue;
+		}
+		cvector_set_size(items, 0);
+		opt_stmt_expr(n->stmtExpr, &items, &stats);
+		for (StatementExpression* it = cvector_begin(items); it != cvector_end(items); it++) {
+			cvector_push_back(nodes, ((AST_Node) {.nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION, .state = n->state, .stmtExpr = *it}));
+		}
+	}
+	cvector_free(items);
+	cvector_free(p->p);
+	p->p = nodes;
+	sl_debug(SL_CAT_AST, "folded %zu, simplified %zu, removed %zu ifs", stats.folded, stats.simplified, stats.ifs);
+	return stats;
+}
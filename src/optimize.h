@@ -0,0 +1,25 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+#include "ast.h"
+#include <stddef.h>
+
+/**
+ *  AST optimizations (-O1)
+ *    + folding: an operator whose operands are both literals becomes a literal. It's computed
+ *      with the interpreter's own operator table, so the promotions are the ones it would use
+ *    + identities: 'x 0 +', '0 x +', 'x 0 -' when x is known to be an int,
+ *      'x 1 *', '1 x *', 'x 1 /' when x is known to be an int or a double
+ *    + an if with a literal condition becomes its block when the literal is a nonzero int,
+ *      and otherwise just the literal, which is what the if would have left on the stack
+ *    + a while's condition and block are folded like any other, the loop itself stays,
+ *      and so are a switch's value and cases
+ *  Anything that would fail at run time (an operator that isn't defined for its operands,
+ *  an integer division by zero) is left as it is, so it still fails at the same point.
+ */
+typedef struct {
+	size_t folded, simplified, ifs;
+} opt_stats;
+
+opt_stats opt_fold_program(Program*);
+
+#endif
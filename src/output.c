@@ -0,0 +1,133 @@
+#include "output.h"
+#include "sl_assert.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static output_buf* live;
+static bool        atexit_registered;
+
+// Writes all of both parts, retrying partial writes. Output that can't be written
+// (a closed pipe) is dropped, like stdio drops it
+static void ob_writev(int fd, const char* a, size_t alen, const char* b, size_t blen) {
+	struct iovec iov[2] = {{(void*) a, alen}, {(void*) b, blen}};
+	int first = alen ? 0 : 1;
+	while (first < 2) {
+		ssize_t n = writev(fd, iov + first, 2 - first);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		for (; first < 2 && (size_t) n >= iov[first].iov_len; first++) n -= iov[first].iov_len;
+		if (first < 2) {
+			iov[first].iov_base = (char*) iov[first].iov_base + n;
+			iov[first].iov_len -= n;
+		}
+	}
+}
+
+static void ob_drain(output_buf* ob) {
+	if (ob->used == 0) return;
+	ob_writev(ob->fd, ob->data, ob->used, NULL, 0);
+	ob->used = 0;
+}
+
+static void ob_at_exit() {
+	fflush(stdout);
+	ob_flush_all();
+}
+
+output_buf* ob_new(int fd, size_t size) {
+	output_buf* ob = calloc(1, sizeof(output_buf));
+	sl_assert(ob, "Out of memory allocating the output buffer\n");
+	ob->fd = fd;
+	ob->tty = isatty(fd);
+	ob_resize(ob, size);
+	if (!atexit_registered) {
+		atexit(ob_at_exit);
+		atexit_registered = true;
+	}
+	ob->next = live;
+	if (live) live->prev = ob;
+	live = ob;
+	return ob;
+}
+
+void ob_free(output_buf* ob) {
+	if (!ob) return;
+	ob_flush(ob);
+	if (ob->prev) ob->prev->next = ob->next;
+	else live = ob->next;
+	if (ob->next) ob->next->prev = ob->prev;
+	free(ob->data);
+	free(ob);
+}
+
+void ob_resize(output_buf* ob, size_t size) {
+	ob_flush(ob);
+	free(ob->data);
+	ob->data = size ? malloc(size) : NULL;
+	sl_assert(!size || ob->data, "Out of memory allocating an output buffer of %zu bytes\n", size);
+	ob->size = size;
+}
+
+void ob_write(output_buf* ob, String_View sv) {
+	if (ob->used + sv.count <= ob->size) {
+		memcpy(ob->data + ob->used, sv.data, sv.count);
+		ob->used += sv.count;
+		return;
+	}
+	fflush(stdout);
+	if (sv.count * 2 < ob->size) {
+		// small, the buffer just needs the room
+		ob_drain(ob);
+		memcpy(ob->data, sv.data, sv.count);
+		ob->used = sv.count;
+		return;
+	}
+	ob_writev(ob->fd, ob->data, ob->used, sv.data, sv.count);
+	ob->used = 0;
+}
+
+void ob_char(output_buf* ob, char c) {
+	if (ob->used < ob->size) ob->data[ob->used++] = c;
+	else ob_write(ob, sv_from_parts(&c, 1));
+}
+
+void ob_int(output_buf* ob, int i) {
+	char buf[12];
+	char* p = buf + sizeof(buf);
+	unsigned u = i < 0 ? 0u - (unsigned) i : (unsigned) i;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (i < 0) *--p = '-';
+	ob_write(ob, sv_from_parts(p, buf + sizeof(buf) - p));
+}
+
+void ob_double(output_buf* ob, const char* fmt, double d) {
+	char buf[512];  // %f of DBL_MAX is 309 digits before the point
+	int n = snprintf(buf, sizeof(buf), fmt, d);
+	ob_write(ob, sv_from_parts(buf, n < (int) sizeof(buf) ? n : (int) sizeof(buf) - 1));
+}
+
+void ob_newline(output_buf* ob) {
+	ob_char(ob, '\n');
+	if (ob->tty) ob_flush(ob);
+}
+
+void ob_flush(output_buf* ob) {
+	if (ob->used == 0) return;
+	fflush(stdout);
+	ob_drain(ob);
+}
+
+void ob_flush_all() {
+	for (output_buf* ob = live; ob; ob = ob->next) {
+		ob_drain(ob);
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include "sv.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ *  Program output
+ *    Each interpreter buffers what print, println and showstack write and hands it to the
+ *    fd in one write(2) at a time, without stdio's format parsing or lock per value.
+ *    It goes out when the buffer fills, before input (so a prompt shows), on exit, and on
+ *    each newline when the fd is a terminal. A string that doesn't fit goes out together
+ *    with what's buffered in one writev(2) instead of being copied in.
+ *    Whatever stdout had buffered is flushed first, so output keeps its order.
+ *    Every live buffer is flushed when the process exits, also on an error that _exits.
+ */
+#define OB_DEFAULT_SIZE (1 << 16)
+
+typedef struct output_buf {
+	char*  data;
+	size_t size, used;   // size 0 writes everything straight through
+	int    fd;
+	bool   tty;
+
+	struct output_buf *prev, *next;   // the live buffers, see ob_flush_all
+} output_buf;
+
+output_buf* ob_new(int fd, size_t size);
+void        ob_free(output_buf*);
+//   flushes what's buffered first
+void        ob_resize(output_buf*, size_t size);
+
+void ob_write(output_buf*, String_View);
+void ob_char(output_buf*, char);
+void ob_int(output_buf*, int);
+//   like printf's "%.4f", fmt is one printf conversion for a double
+void ob_double(output_buf*, const char* fmt, double);
+//   a newline, flushes on a terminal
+void ob_newline(output_buf*);
+
+void ob_flush(output_buf*);
+//   only write(2), so errors that _exit (even from a signal handler) can call it.
+//   Flush stdout before it when that's safe
+void ob_flush_all();
+
+#endif
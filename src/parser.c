@@ -5,16 +5,18 @@
 #include "cvector.h"
 #include "sl_assert.h"
 #include "sl_log.h"
+#include "strpool.h"
 #include "tokenizer.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 parse_ctx pctx_new(int initial_capacity) {
 	parse_ctx ctx = {0};
 	ctx.pstack.top = -1;
 	ctx.pstack.length = 0;
-	ctx.pstack.data = calloc(initial_capacity, sizeof(parse_stack_node));
+	ctx.pstack.data = calloc(initial_capacity, sizeof(AST_Node));
 	ctx.pstack.capacity = initial_capacity;
 	return ctx;
 }
@@ -52,12 +54,14 @@ bool pctx_top_is(parse_ctx* pctx, AST_NodeType types[], int size) {
 
 void pctx_push(parse_ctx* pctx, AST_Node node) {
 	if (pctx->pstack.length + 1 >= pctx->pstack.capacity) {
-		pctx->pstack.data = realloc(pctx->pstack.data, pctx->pstack.capacity * 2);
 		pctx->pstack.capacity *= 2;
+		pctx->pstack.data = realloc(pctx->pstack.data, pctx->pstack.capacity * sizeof(AST_Node));
 	}
 	pctx->pstack.top++;     // must increment first as top starts at -1
 	pctx->pstack.length++;
 	pctx->pstack.data[pctx->pstack.top] = node;
+	if (pctx->pstack.length > pctx->stats.peak_depth)
+		pctx->stats.peak_depth = pctx->pstack.length;
 }
 
 AST_Node pctx_peek(parse_ctx* pctx) {
@@ -130,7 +134,8 @@ int try_convert_token_to_terminal(token tok, AST_Node* out_n) {
 			break;
 		case T_STRING_LIT:
 			nt = AST_NODE_TYPE_TERMINAL;
-			t=P_NEW_TERMINAL(TERMINAL_TYPE_STRING_LIT, .str_lit=tok.text);
+			// intern without the surrounding quotes
+			t=P_NEW_TERMINAL(TERMINAL_TYPE_STRING_LIT, .str_lit=strpool_intern(sv_from_parts(tok.text.data + 1, tok.text.count - 2)));
 			status = 1;
 			break;
 		case T_CHAR_LIT:
@@ -170,6 +175,22 @@ int try_convert_token_to_stackop(token tok, AST_Node* out_n) {
 	return status;
 }
 
+static OperatorCode operator_code_from_token(token_type type) {
+	switch (type) {
+		case T_PLUS:  return OPERATOR_CODE_ADD;
+		case T_MINUS: return OPERATOR_CODE_SUB;
+		case T_MUL:   return OPERATOR_CODE_MUL;
+		case T_DIV:   return OPERATOR_CODE_DIV;
+		case T_MOD:   return OPERATOR_CODE_MOD;
+		case T_GT:    return OPERATOR_CODE_GT;
+		case T_LT:    return OPERATOR_CODE_LT;
+		case T_LAND:  return OPERATOR_CODE_LAND;
+		case T_LOR:   return OPERATOR_CODE_LOR;
+		case T_DEQ:   return OPERATOR_CODE_EQ;
+		default:      return OPERATOR_CODE_UNDEFINED;
+	}
+}
+
 int try_convert_token_to_operator(token tok, AST_Node* out_n) {
 	AST_NodeType nt = AST_NODE_TYPE_UNDEFINED;
 	Operator op;
@@ -187,6 +208,7 @@ int try_convert_token_to_operator(token tok, AST_Node* out_n) {
 			break;
 		default: break;
 	}
+	op.code = operator_code_from_token(tok.type);
 	*out_n = (AST_Node) {.nodeType=nt, .op = op, .state=tok.state};
 	return status;
 }
@@ -197,6 +219,7 @@ int try_convert_token_to_reserved(token tok, AST_Node* out_n) {
 	int status = 0; // 0 indicates no reduction
 	switch (tok.type) {
 		case T_RESERVE_BEG...T_RESERVE_END:
+		case T_COLON:  // only ever ends a switch case's label
 			nt = AST_NODE_TYPE_RESERVED;
 			res=P_NEW_RESERVED(tok);
 			status = 1;
@@ -207,6 +230,91 @@ int try_convert_token_to_reserved(token tok, AST_Node* out_n) {
 	return status;
 }
 
+int pctx_convert_token(token tok, AST_Node* out_n) {
+	if (try_convert_token_to_terminal(tok, out_n) != 0) return 1;
+	if (try_convert_token_to_stackop(tok, out_n) != 0) {
+		sl_trace(SL_CAT_PARSER, "Converted to stack op");
+		return 1;
+	}
+	if (try_convert_token_to_operator(tok, out_n) != 0) return 1;
+	if (try_convert_token_to_reserved(tok, out_n) != 0) return 1;
+	return 0;
+}
+
+static bool is_reserved(AST_Node n, token_type type) {
+	return n.nodeType == AST_NODE_TYPE_RESERVED && n.reserved.token.type == type;
+}
+
+static bool is_expression(AST_Node n) {
+	return n.nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION && n.stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION;
+}
+
+int pctx_consume_token(parse_ctx* pctx, token tok) {
+	AST_Node n;
+	int p;
+	if (pctx_convert_token(tok, &n) == 0) {
+		return 0;
+	}
+	// A name left bare (at the start, or after a statement) names a procedure only when a
+	// block follows it, anything else makes it a call
+	if (pctx->pstack.length > 0 && !is_reserved(n, T_LBRC)) {
+		AST_Node* top = &pctx->pstack.data[pctx->pstack.top];
+		if (top->nodeType == AST_NODE_TYPE_TERMINAL && top->terminal.type == TERMINAL_TYPE_IDENTIFIER) {
+			Expression* call = calloc(1, sizeof(Expression));
+			call->type = EXPRESSION_TYPE_PROC_CALL;
+			call->EProcCall.proc_call.name = top->terminal.id;
+			call->state = top->state;
+			*top = (AST_Node) {.nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION, .state = call->state,
+				.stmtExpr = {.type = STATEMENT_EXPR_TYPE_EXPRESSION, .expr = call}};
+		}
+	}
+	pctx_push(pctx, n);
+	pctx->stats.shifts++;
+
+	while ((p = try_reduce(pctx, &n)) != 0) {
+		pctx->stats.reductions++;
+		pctx_pop_n(pctx, p);
+		pctx_push(pctx, n);
+	}
+	return 1;
+}
+
+int pctx_take_complete(parse_ctx* pctx, AST_Node* out_n) {
+	// The bottom node is final once no later reduction can consume it. Reductions run eagerly
+	// on every shift, so nothing is left waiting to reduce, and what can still reach down is:
+	//  - the fixed-shape rules ('expression expression op', 'if'/'while' expression block,
+	//    'expression id', 'id block'), which look at most PCTX_STREAM_LOOKBEHIND nodes below
+	//    the one shifted. With more than that above it the bottom is out of their reach
+	//  - blocks and switches, which scan down only as far as their own '{' or 'switch', and
+	//    every open construct has its keyword, '{' or name below everything it consumes. So
+	//    only a finished statement or expression, or a procedure definition, is taken: a
+	//    keyword, brace or bare name at the bottom is still open
+	//  - 'id block', whose name can be a call already reduced below a '{', checked below.
+	// An operator that arrives after its left operand was taken finds only one expression
+	// above it and reduces through 'operator -> expression', which takes that operand from
+	// the data stack at run time instead, so '1 2 3 + +' evaluates the same either way
+	if (pctx->pstack.length <= PCTX_STREAM_LOOKBEHIND)
+		return 0;
+	if (pctx->pstack.data[0].nodeType != AST_NODE_TYPE_STATEMENT_EXPRESSION &&
+			pctx->pstack.data[0].nodeType != AST_NODE_TYPE_PROCEDURE_DEF)
+		return 0;
+	// A call with a block opening right above it can still turn out to be a procedure's name
+	if (pctx->pstack.data[1].nodeType == AST_NODE_TYPE_RESERVED &&
+			pctx->pstack.data[1].reserved.token.type == T_LBRC)
+		return 0;
+	return pctx_take_bottom(pctx, out_n);
+}
+
+int pctx_take_bottom(parse_ctx* pctx, AST_Node* out_n) {
+	if (pctx->pstack.length == 0)
+		return 0;
+	*out_n = pctx->pstack.data[0];
+	memmove(pctx->pstack.data, pctx->pstack.data + 1, (pctx->pstack.length - 1) * sizeof(AST_Node));
+	pctx->pstack.top--;
+	pctx->pstack.length--;
+	return 1;
+}
+
 // See ast.h for grammar reference
 int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 	*out_n = (AST_Node){0};
@@ -244,7 +352,7 @@ int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 
 	// stack_op -> expression
 	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_STACK_OPERATOR) {
-		sl_log("Stack Operator: " SV_Fmt "\n", SV_Arg(pctx_peek_offset(pctx, 0).stackOp.op.op_str));
+		sl_trace(SL_CAT_PARSER, "Stack Operator: " SV_Fmt, SV_Arg(pctx_peek_offset(pctx, 0).stackOp.op.op_str));
 		AST_Node expr1 = pctx_peek_offset(pctx, 0);
 		out_n->nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION;
 		out_n->stmtExpr.type = STATEMENT_EXPR_TYPE_EXPRESSION;
@@ -255,14 +363,11 @@ int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 		return 1;
 	}
 
-	// operator -> expression
-	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_OPERATOR) {
-	
-	}
-
 	// expression expression op -> expression
 	if (pctx_peek_offset(pctx, 2).nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION &&
+			pctx_peek_offset(pctx, 2).stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION &&
 			pctx_peek_offset(pctx, 1).nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION &&
+			pctx_peek_offset(pctx, 1).stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION &&
 			pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_OPERATOR)
 	{
 		AST_Node expr1 = pctx_peek_offset(pctx, 2);
@@ -279,6 +384,21 @@ int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 		return 3;
 	}
 
+	// operator -> expression
+	//   Only when the operands aren't both on the parse stack (otherwise the rule above wins).
+	//   The operands are whatever the previous expressions left on the data stack,
+	//   which is what happens when those expressions were already handed to the interpreter.
+	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_OPERATOR) {
+		AST_Node operator = pctx_peek_offset(pctx, 0);
+		out_n->nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION;
+		out_n->stmtExpr.type = STATEMENT_EXPR_TYPE_EXPRESSION;
+		out_n->stmtExpr.expr = malloc(sizeof(Expression));
+		out_n->stmtExpr.expr->type = EXPRESSION_TYPE_OPERATOR;
+		out_n->stmtExpr.expr->EOp.operation = operator.op;
+		out_n->stmtExpr.expr->state = operator.state;
+		return 1;
+	}
+
 	// expression id -> procedure_call 
 	if (pctx_peek_offset(pctx, 1).nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION &&
 			pctx_peek_offset(pctx, 1).stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION &&
@@ -288,13 +408,71 @@ int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 		AST_Node id = pctx_peek_offset(pctx, 0);
 		out_n->nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION;
 		out_n->stmtExpr.type = STATEMENT_EXPR_TYPE_EXPRESSION;
-		out_n->stmtExpr.expr = malloc(sizeof(Expression));
+		out_n->stmtExpr.expr = calloc(1, sizeof(Expression));
 		out_n->stmtExpr.expr->type = EXPRESSION_TYPE_PROC_CALL;
 		out_n->stmtExpr.expr->EProcCall.proc_call.name = id.terminal.id;
 		out_n->stmtExpr.expr->state = expr.state;
 		return 1;
 	}
 
+	// '{' id -> procedure_call
+	//   A block can't hold a definition, so a name that starts one is always a call
+	if (pctx_peek_offset(pctx, 1).nodeType == AST_NODE_TYPE_RESERVED &&
+			pctx_peek_offset(pctx, 1).reserved.token.type == T_LBRC &&
+			pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_TERMINAL &&
+			pctx_peek_offset(pctx, 0).terminal.type == TERMINAL_TYPE_IDENTIFIER) {
+		AST_Node id = pctx_peek_offset(pctx, 0);
+		out_n->nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION;
+		out_n->stmtExpr.type = STATEMENT_EXPR_TYPE_EXPRESSION;
+		out_n->stmtExpr.expr = calloc(1, sizeof(Expression));
+		out_n->stmtExpr.expr->type = EXPRESSION_TYPE_PROC_CALL;
+		out_n->stmtExpr.expr->EProcCall.proc_call.name = id.terminal.id;
+		out_n->stmtExpr.expr->state = id.state;
+		return 1;
+	}
+
+	// 'switch' expression '{' switch_case* '}' -> switch
+	// 'switch' expression '{' switch_case* 'default' ':' '}' -> switch
+	//   Checked before the block rule below, which only takes statements and expressions.
+	//   A default with nothing after its ':' can only be told apart once the '}' is here
+	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_RESERVED &&
+			pctx_peek_offset(pctx, 0).reserved.token.type == T_RBRC) {
+		bool bare_default = is_reserved(pctx_peek_offset(pctx, 1), T_COLON) &&
+			is_reserved(pctx_peek_offset(pctx, 2), T_DEFAULT);
+		int first = bare_default ? 3 : 1;
+		int offset = first;
+		while (pctx_peek_offset(pctx, offset).nodeType == AST_NODE_TYPE_CASE) offset++;
+		if (pctx_peek_offset(pctx, offset).nodeType == AST_NODE_TYPE_RESERVED &&
+				pctx_peek_offset(pctx, offset).reserved.token.type == T_LBRC &&
+				pctx_peek_offset(pctx, offset + 1).nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION &&
+				pctx_peek_offset(pctx, offset + 1).stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION &&
+				pctx_peek_offset(pctx, offset + 2).nodeType == AST_NODE_TYPE_RESERVED &&
+				pctx_peek_offset(pctx, offset + 2).reserved.token.type == T_SWITCH) {
+			AST_Node keyword = pctx_peek_offset(pctx, offset + 2);
+			AST_Node expr = pctx_peek_offset(pctx, offset + 1);
+			out_n->nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION;
+			out_n->stmtExpr.type = STATEMENT_EXPR_TYPE_STATEMENT;
+			out_n->stmtExpr.stmt = calloc(1, sizeof(Statement));
+			out_n->stmtExpr.stmt->type = STATEMENT_TYPE_SWITCH;
+			Switch* sw = &out_n->stmtExpr.stmt->switchh;
+			sw->state = keyword.reserved.token.state;
+			sw->expression = expr.stmtExpr.expr;
+			cvector_reserve(sw->block.cases, offset - 1);
+			for (int i = offset - 1; i >= first; i--) {
+				SwitchCase* c = pctx_peek_offset(pctx, i).casef;
+				cvector_push_back(sw->block.cases, *c);
+				free(c);
+			}
+			if (bare_default) {
+				tokenizer_state state = pctx_peek_offset(pctx, 2).reserved.token.state;
+				cvector_push_back(sw->block.cases, ((SwitchCase) {.state = state, .is_default = true, .b = {.state = state}}));
+			}
+			sl_trace(SL_CAT_PARSER, "switch with %zu cases", cvector_size(sw->block.cases));
+			// the cases, the braces, the expression and 'switch'
+			return offset + 3;
+		}
+	}
+
 	// reduce block (simple block for now)
 	// <block>       := '{' <expressions> '}'
 	//  expressions is just a sequence of expressions
@@ -341,14 +519,16 @@ int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 		}
 		// subtract 1 because we dont want to count the expression for the if condition
 		// printf("Number of expressions in block: %d\n", offset - 1); 
-		sl_log("offset: %d\n", offset);
+		sl_trace(SL_CAT_PARSER, "offset: %d", offset);
 		// Put the expressions and statements into the block node
+		cvector_reserve(out_n->block.items, offset - 1);
 		for (int i = 0; i < offset - 1; i++) {
 			AST_Node n = pctx_peek_offset(pctx, offset - 1 - i);
 			cvector_push_back(out_n->block.items, n.stmtExpr);
 		}
 
-		pctx_print_stack_lite(pctx);
+		if (sl_log_enabled(SL_CAT_AST, SL_LEVEL_TRACE))
+			pctx_print_stack_lite(pctx);
 		// Return with the number of nodes to pop (the inner expressions + the '{' and '}')
 		return offset + 1;
 	}
@@ -356,9 +536,9 @@ int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_BLOCK) {
 		AST_Node n = pctx_peek_offset(pctx, 1);
 		AST_Node n1 = pctx_peek_offset(pctx, 2);
-		sl_log("Found <block>");
-		sl_log("1 -> %d", n.nodeType);
-		sl_log("2 -> %d", n1.nodeType);
+		sl_trace(SL_CAT_PARSER, "Found <block>");
+		sl_trace(SL_CAT_PARSER, "1 -> %d", n.nodeType);
+		sl_trace(SL_CAT_PARSER, "2 -> %d", n1.nodeType);
 	}
 
 	// 'if' expression block -> if
@@ -379,6 +559,103 @@ int try_reduce(parse_ctx* pctx, AST_Node* out_n) {
 		return 3;
 	}
 
+	// 'while' expression block -> while
+	if (pctx_peek_offset(pctx, 2).nodeType == AST_NODE_TYPE_RESERVED &&
+			pctx_peek_offset(pctx, 2).reserved.token.type == T_WHILE &&
+			pctx_peek_offset(pctx, 1).nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION &&
+			pctx_peek_offset(pctx, 1).stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION &&
+			pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_BLOCK) {
+		AST_Node keyword = pctx_peek_offset(pctx, 2);
+		AST_Node expr = pctx_peek_offset(pctx, 1);
+		AST_Node block = pctx_peek_offset(pctx, 0);
+		out_n->nodeType = AST_NODE_TYPE_STATEMENT_EXPRESSION;
+		out_n->stmtExpr.stmt = calloc(1, sizeof(Statement));
+		out_n->stmtExpr.type = STATEMENT_EXPR_TYPE_STATEMENT;
+		out_n->stmtExpr.stmt->type = STATEMENT_TYPE_WHILE;
+		out_n->stmtExpr.stmt->whilee.state = keyword.reserved.token.state;
+		out_n->stmtExpr.stmt->whilee.block = block.block;
+		out_n->stmtExpr.stmt->whilee.expression = expr.stmtExpr.expr;
+		return 3;
+	}
+
+	// term ':' block -> switch_case
+	// 'default' ':' block -> switch_case
+	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_BLOCK &&
+			pctx_peek_offset(pctx, 1).nodeType == AST_NODE_TYPE_RESERVED &&
+			pctx_peek_offset(pctx, 1).reserved.token.type == T_COLON) {
+		AST_Node label = pctx_peek_offset(pctx, 2);
+		AST_Node block = pctx_peek_offset(pctx, 0);
+		bool is_default = label.nodeType == AST_NODE_TYPE_RESERVED && label.reserved.token.type == T_DEFAULT;
+		bool is_term = label.nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION &&
+			label.stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION &&
+			label.stmtExpr.expr->type == EXPRESSION_TYPE_TERM;
+		sl_assert(is_default || is_term, "A switch case starts with a literal or 'default', then ':'\n");
+		out_n->nodeType = AST_NODE_TYPE_CASE;
+		out_n->casef = calloc(1, sizeof(SwitchCase));
+		out_n->casef->is_default = is_default;
+		out_n->casef->b = block.block;
+		if (is_default) {
+			out_n->casef->state = label.reserved.token.state;
+		}
+		else {
+			out_n->casef->value = label.stmtExpr.expr->ETerm.term;
+			out_n->casef->state = label.stmtExpr.expr->ETerm.term.state;
+			free(label.stmtExpr.expr);
+		}
+		out_n->state = out_n->casef->state;
+		return 3;
+	}
+
+	// term expression -> switch_case
+	//   The short form, the expression is the whole case. Only straight inside a switch's
+	//   braces, after its '{' or the case before, anywhere else two expressions are just two
+	if (is_expression(pctx_peek_offset(pctx, 0)) &&
+			is_expression(pctx_peek_offset(pctx, 1)) &&
+			pctx_peek_offset(pctx, 1).stmtExpr.expr->type == EXPRESSION_TYPE_TERM &&
+			(pctx_peek_offset(pctx, 2).nodeType == AST_NODE_TYPE_CASE ||
+			 (is_reserved(pctx_peek_offset(pctx, 2), T_LBRC) &&
+			  is_expression(pctx_peek_offset(pctx, 3)) &&
+			  is_reserved(pctx_peek_offset(pctx, 4), T_SWITCH)))) {
+		AST_Node label = pctx_peek_offset(pctx, 1);
+		AST_Node body = pctx_peek_offset(pctx, 0);
+		out_n->nodeType = AST_NODE_TYPE_CASE;
+		out_n->casef = calloc(1, sizeof(SwitchCase));
+		out_n->casef->value = label.stmtExpr.expr->ETerm.term;
+		out_n->casef->state = label.stmtExpr.expr->ETerm.term.state;
+		out_n->casef->b.state = body.stmtExpr.expr->state;
+		cvector_push_back(out_n->casef->b.items, body.stmtExpr);
+		free(label.stmtExpr.expr);
+		out_n->state = out_n->casef->state;
+		return 2;
+	}
+
+	// id block -> procedure
+	//   At the start of the program or after a statement the name is still a bare identifier.
+	//   After an expression 'expression id -> procedure_call' already took it, the call is
+	//   taken back here. Right after 'if' or 'while' the identifier is the condition, not a name
+	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_BLOCK &&
+			!(pctx_peek_offset(pctx, 2).nodeType == AST_NODE_TYPE_RESERVED &&
+			  (pctx_peek_offset(pctx, 2).reserved.token.type == T_IF ||
+			   pctx_peek_offset(pctx, 2).reserved.token.type == T_WHILE))) {
+		AST_Node name = pctx_peek_offset(pctx, 1);
+		AST_Node block = pctx_peek_offset(pctx, 0);
+		bool bare = name.nodeType == AST_NODE_TYPE_TERMINAL && name.terminal.type == TERMINAL_TYPE_IDENTIFIER;
+		bool call = name.nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION &&
+			name.stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION &&
+			name.stmtExpr.expr->type == EXPRESSION_TYPE_PROC_CALL;
+		if (bare || call) {
+			out_n->nodeType = AST_NODE_TYPE_PROCEDURE_DEF;
+			out_n->state = name.state;
+			out_n->procDef = calloc(1, sizeof(ProcedureDef));
+			out_n->procDef->state = name.state;
+			out_n->procDef->name = bare ? name.terminal.id : name.stmtExpr.expr->EProcCall.proc_call.name;
+			out_n->procDef->call = bare ? NULL : name.stmtExpr.expr;
+			out_n->procDef->block = block.block;
+			sl_trace(SL_CAT_PARSER, "procedure " SV_Fmt, SV_Arg(out_n->procDef->name));
+			return 2;
+		}
+	}
+
 	// reduce terminals
 	if (pctx_peek_offset(pctx, 0).nodeType == AST_NODE_TYPE_TERMINAL) {
 		AST_Node n = pctx_peek(pctx);
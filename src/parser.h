@@ -7,6 +7,9 @@
 #define PSNODE_NEW_TERM(ttype, v) (parse_stack_node) {.node.type=PSNT_TERM, .term=(Term){.type=(ttype), (v)}}
 #define NT_LIST(...) (AST_NodeType[]) { __VA_ARGS__ }
 
+// How many nodes at the top of the parse stack a reduction can still reach back into
+#define PCTX_STREAM_LOOKBEHIND 2
+
 #define P_NEW_TERMINAL(type_, expr) \
 	(Terminal) {.type=type_, expr}
 #define P_NEW_TERM(type_, expr) \
@@ -27,8 +30,15 @@ typedef struct {
 	int capacity, length, top;
 } stack;
 
+// Counters for the shift/reduce loop (see bench/bench_parser.c)
+typedef struct {
+	size_t shifts, reductions;
+	int    peak_depth;
+} parse_stats;
+
 typedef struct {
 	stack pstack;
+	parse_stats stats;
 } parse_ctx;
 
 parse_stack_node  create_stack_node_terminal(token);
@@ -59,4 +69,16 @@ int               try_convert_token_to_stackop(token, AST_Node*);
 int               try_convert_token_to_operator(token, AST_Node*);
 int               try_convert_token_to_reserved(token, AST_Node*);
 int 							try_reduce(parse_ctx*, AST_Node*);
+
+// Parse driver
+//   - pctx_convert_token turns a token into the node that gets shifted for it
+//     returns 0 if the token couldn't be converted to anything
+//   - pctx_consume_token shifts one token and reduces as far as possible
+//     returns 0 if the token couldn't be converted to anything
+//   - pctx_take_complete removes the bottom node of the stack if no later token can change it
+//   - pctx_take_bottom removes the bottom node unconditionally (for draining at EOF)
+int               pctx_convert_token(token, AST_Node*);
+int               pctx_consume_token(parse_ctx*, token);
+int               pctx_take_complete(parse_ctx*, AST_Node*);
+int               pctx_take_bottom(parse_ctx*, AST_Node*);
 #endif
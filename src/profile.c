@@ -0,0 +1,59 @@
+#include "profile.h"
+#include <stdlib.h>
+
+static void prof_block(prof_report*, Block);
+
+static void prof_stmt_expr(prof_report* r, StatementExpression se) {
+	if (se.type != STATEMENT_EXPR_TYPE_STATEMENT) return;
+	if (se.stmt->type == STATEMENT_TYPE_IFF) {
+		prof_block(r, se.stmt->iff.block);
+	}
+	if (se.stmt->type == STATEMENT_TYPE_WHILE) {
+		While* w = &se.stmt->whilee;
+		cvector_push_back(r->loops, ((prof_loop) {.state = w->state, .iterations = w->iterations}));
+		prof_block(r, w->block);
+	}
+	if (se.stmt->type == STATEMENT_TYPE_SWITCH) {
+		for (SwitchCase* c = cvector_begin(se.stmt->switchh.block.cases); c != cvector_end(se.stmt->switchh.block.cases); c++) {
+			prof_block(r, c->b);
+		}
+	}
+}
+
+static void prof_block(prof_report* r, Block b) {
+	for (StatementExpression* it = cvector_begin(b.items); it != cvector_end(b.items); it++) {
+		prof_stmt_expr(r, *it);
+	}
+}
+
+void prof_collect(prof_report* r, Program p) {
+	for (AST_Node* n = cvector_begin(p.p); n != cvector_end(p.p); n++) {
+		if (n->nodeType == AST_NODE_TYPE_STATEMENT_EXPRESSION)
+			prof_stmt_expr(r, n->stmtExpr);
+		if (n->nodeType == AST_NODE_TYPE_PROCEDURE_DEF)
+			prof_block(r, n->procDef->block);
+	}
+}
+
+static int prof_hottest_first(const void* a, const void* b) {
+	const prof_loop* l = a, *r = b;
+	if (l->iterations != r->iterations) return l->iterations < r->iterations ? 1 : -1;
+	if (l->state.line != r->state.line) return l->state.line - r->state.line;
+	return l->state.col - r->state.col;
+}
+
+void prof_print(FILE* out, prof_report* r) {
+	qsort(r->loops, cvector_size(r->loops), sizeof(prof_loop), prof_hottest_first);
+	fprintf(out, "Loop profile\n");
+	fprintf(out, "==========================================\n");
+	fprintf(out, "%20s  %s\n", "iterations", "loop at");
+	for (prof_loop* it = cvector_begin(r->loops); it != cvector_end(r->loops); it++) {
+		fprintf(out, "%20llu  line %d, col %d\n", (unsigned long long) it->iterations, it->state.line + 1, it->state.col + 1);
+	}
+	fprintf(out, "==========================================\n");
+}
+
+void prof_free(prof_report* r) {
+	cvector_free(r->loops);
+	*r = (prof_report) {0};
+}
@@ -0,0 +1,26 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include "ast.h"
+#include <stdio.h>
+
+/**
+ *  Loop profile (--profile)
+ *    Every engine counts how often each while's block runs, in the While node itself.
+ *    prof_collect gathers the counts of a program that has run (procedure bodies included),
+ *    prof_print lists them hottest first, by where each loop starts.
+ *    Streaming mode collects every statement right after it ran, before it's freed.
+ */
+typedef struct {
+	tokenizer_state state;
+	uint64_t        iterations;
+} prof_loop;
+
+typedef struct {
+	cvector_vector_type(prof_loop) loops;
+} prof_report;
+
+void prof_collect(prof_report*, Program);
+void prof_print(FILE*, prof_report*);
+void prof_free(prof_report*);
+
+#endif
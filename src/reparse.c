@@ -0,0 +1,318 @@
+#include "reparse.h"
+#include "cvector.h"
+#include "parser.h"
+#include "sl_log.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// cvector grows one element at a time, which makes a large document quadratic to build
+#define RCTX_RESERVE(vec, n) \
+	do {\
+		size_t cap__ = cvector_capacity(vec);\
+		if (cap__ < (size_t) (n))\
+			cvector_grow((vec), (size_t) (n) > cap__ * 2 ? (size_t) (n) : cap__ * 2);\
+	} while (0)
+#define RCTX_PUSH(vec, v) \
+	do {\
+		RCTX_RESERVE((vec), cvector_size(vec) + 1);\
+		cvector_push_back((vec), (v));\
+	} while (0)
+
+#define E(i) (ctx->entries[(i)])
+
+// Everything try_reduce can tell apart about a node it peeks at
+static uint32_t rctx_shape(AST_Node n) {
+	uint32_t sub = 0;
+	switch (n.nodeType) {
+		case AST_NODE_TYPE_STATEMENT_EXPRESSION: sub = n.stmtExpr.type; break;
+		case AST_NODE_TYPE_RESERVED:             sub = n.reserved.token.type; break;
+		case AST_NODE_TYPE_TERMINAL:             sub = n.terminal.type; break;
+		default: break;
+	}
+	return (uint32_t) (n.nodeType + 1) << 16 | sub;
+}
+
+static void rctx_below(reparse_ctx* ctx, uint32_t out[2]) {
+	out[0] = rctx_shape(pctx_peek_offset(&ctx->pctx, 0));
+	out[1] = rctx_shape(pctx_peek_offset(&ctx->pctx, 1));
+}
+
+// Frees what the reduction that built this node allocated. Its children are entries of their own
+static void rctx_free_shell(AST_Node n) {
+	switch (n.nodeType) {
+		case AST_NODE_TYPE_STATEMENT_EXPRESSION:
+			if (n.stmtExpr.type == STATEMENT_EXPR_TYPE_EXPRESSION) free(n.stmtExpr.expr);
+			else free(n.stmtExpr.stmt);
+			break;
+		case AST_NODE_TYPE_BLOCK:
+			cvector_free(n.block.items); // an if shares this with its block entry
+			break;
+		case AST_NODE_TYPE_PROCEDURE_DEF:
+			free(n.procDef);             // so does a procedure, and its call is an entry too
+			break;
+		default: break;
+	}
+}
+
+static int rctx_new_entry(reparse_ctx* ctx, AST_Node n, int start, int end) {
+	int e;
+	if (!cvector_empty(ctx->free_entries)) {
+		e = ctx->free_entries[cvector_size(ctx->free_entries) - 1];
+		cvector_pop_back(ctx->free_entries);
+	}
+	else {
+		e = cvector_size(ctx->entries);
+		RCTX_RESERVE(ctx->entries, e + 1);
+		cvector_set_size(ctx->entries, e + 1);
+	}
+	E(e) = (reparse_entry) {
+		.node = n, .start = start, .end = end, .parent = -1,
+		.generation = ctx->generation, .live = true
+	};
+	return e;
+}
+
+// Frees an old subtree, except for whatever this edit reused out of it
+static void rctx_kill(reparse_ctx* ctx, int root) {
+	cvector_vector_type(int) todo = NULL;
+	RCTX_PUSH(todo, root);
+	while (!cvector_empty(todo)) {
+		int e = todo[cvector_size(todo) - 1];
+		cvector_pop_back(todo);
+		if (E(e).generation == ctx->generation)
+			continue;
+		rctx_free_shell(E(e).node);
+		for (int i = 0; i < E(e).nchildren; i++) {
+			RCTX_PUSH(todo, ctx->child_pool[E(e).children + i]);
+		}
+		ctx->child_garbage += E(e).nchildren;
+		E(e).live = false;
+		RCTX_PUSH(ctx->free_entries, e);
+	}
+	cvector_free(todo);
+}
+
+static void rctx_compact_children(reparse_ctx* ctx) {
+	if (ctx->child_garbage < 4096 || ctx->child_garbage * 2 < cvector_size(ctx->child_pool))
+		return;
+	cvector_vector_type(int) pool = NULL;
+	RCTX_RESERVE(pool, cvector_size(ctx->child_pool) - ctx->child_garbage);
+	for (size_t e = 0; e < cvector_size(ctx->entries); e++) {
+		if (!E(e).live || E(e).nchildren == 0) continue;
+		int at = cvector_size(pool);
+		for (int i = 0; i < E(e).nchildren; i++) {
+			cvector_push_back(pool, ctx->child_pool[E(e).children + i]);
+		}
+		E(e).children = at;
+	}
+	cvector_free(ctx->child_pool);
+	ctx->child_pool = pool;
+	ctx->child_garbage = 0;
+}
+
+// Put a node back on the parse stack exactly as it was, no reductions
+static void rctx_restore(reparse_ctx* ctx, int e) {
+	E(e).generation = ctx->generation;
+	E(e).parent = -1;
+	pctx_push(&ctx->pctx, E(e).node);
+	RCTX_PUSH(ctx->slots, e);
+}
+
+// Shift a node and reduce as far as possible, recording an entry for every reduction
+static void rctx_shift(reparse_ctx* ctx, int e) {
+	E(e).parent = -1;
+	pctx_push(&ctx->pctx, E(e).node);
+	RCTX_PUSH(ctx->slots, e);
+	ctx->pctx.stats.shifts++;
+
+	AST_Node n;
+	int p;
+	while ((p = try_reduce(&ctx->pctx, &n)) != 0) {
+		ctx->pctx.stats.reductions++;
+		int* children = ctx->slots + cvector_size(ctx->slots) - p;
+		int r = rctx_new_entry(ctx, n, E(children[0]).start, E(children[p - 1]).end);
+		memcpy(E(r).below, E(children[0]).below, sizeof(E(r).below));
+		E(r).children = cvector_size(ctx->child_pool);
+		E(r).nchildren = p;
+		RCTX_RESERVE(ctx->child_pool, cvector_size(ctx->child_pool) + p);
+		for (int i = 0; i < p; i++) {
+			cvector_push_back(ctx->child_pool, children[i]);
+			E(children[i]).parent = r;
+		}
+
+		pctx_pop_n(&ctx->pctx, p);
+		cvector_set_size(ctx->slots, cvector_size(ctx->slots) - p);
+		pctx_push(&ctx->pctx, n);
+		RCTX_PUSH(ctx->slots, r);
+	}
+}
+
+static cvector_vector_type(token) rctx_tokenize(reparse_ctx* ctx, const char* text) {
+	// The tokenizer stops one character short of the end and turns trailing
+	// whitespace into an unknown token, so trim it and end on a newline
+	size_t length = strlen(text);
+	while (length > 0 && isspace((unsigned char) text[length - 1])) length--;
+	char* source = malloc(length + 2);
+	memcpy(source, text, length);
+	source[length] = '\n';
+	source[length + 1] = '\0';
+	RCTX_PUSH(ctx->sources, source);
+
+	tokenizer_ctx t = ctx->tctx;
+	t.content = source;
+	t.content_length = length + 1;
+	t.state = (tokenizer_state) {.cursor = source};
+
+	cvector_vector_type(token) out = NULL;
+	token tok;
+	while ((tok = tctx_get_next(&t)).type != T_EOF) {
+		tctx_advance(&t);
+		RCTX_PUSH(out, tok);
+	}
+	return out;
+}
+
+reparse_ctx rctx_new(const char* text) {
+	reparse_ctx ctx = {0};
+	ctx.pctx = pctx_new(100);
+	ctx.tctx = tctx_from_cstr(""); // just for the compiled regexes, see rctx_tokenize
+	rctx_edit(&ctx, 0, 0, text);
+	return ctx;
+}
+
+void rctx_free(reparse_ctx* ctx) {
+	for (size_t e = 0; e < cvector_size(ctx->entries); e++) {
+		if (E(e).live) rctx_free_shell(E(e).node);
+	}
+	for (char** it = cvector_begin(ctx->sources); it != cvector_end(ctx->sources); it++) {
+		free(*it);
+	}
+	cvector_free(ctx->sources);
+	cvector_free(ctx->tokens);
+	cvector_free(ctx->token_entry);
+	cvector_free(ctx->slots);
+	cvector_free(ctx->entries);
+	cvector_free(ctx->free_entries);
+	cvector_free(ctx->child_pool);
+	pctx_free(&ctx->pctx);
+	tctx_free(&ctx->tctx);
+}
+
+int rctx_token_count(reparse_ctx* ctx) {
+	return cvector_size(ctx->tokens);
+}
+
+int rctx_edit(reparse_ctx* ctx, int first, int removed, const char* text) {
+	int ntokens = cvector_size(ctx->tokens);
+	if (first < 0 || removed < 0 || first + removed > ntokens)
+		return -1;
+	ctx->generation++;
+
+	cvector_vector_type(token) inserted = rctx_tokenize(ctx, text);
+	int ninserted = cvector_size(inserted);
+	int delta = ninserted - removed;
+
+	cvector_vector_type(int) old_top = ctx->slots;
+	int nold = cvector_size(old_top);
+	ctx->slots = NULL;
+	ctx->pctx.pstack.length = 0;
+	ctx->pctx.pstack.top = -1;
+
+	// Rebuild the parse stack as it was right before token 'first': the top-level nodes that end
+	// before it, then going down the spine of nodes that straddle it, their children that end before it
+	int r = 0;
+	while (r < nold && E(old_top[r]).end <= first) {
+		rctx_restore(ctx, old_top[r++]);
+	}
+	for (int e = r < nold && E(old_top[r]).start < first ? old_top[r] : -1; e != -1; ) {
+		int next = -1;
+		for (int i = 0; i < E(e).nchildren; i++) {
+			int c = ctx->child_pool[E(e).children + i];
+			if (E(c).end <= first) {
+				rctx_restore(ctx, c);
+				continue;
+			}
+			if (E(c).start < first) next = c;
+			break;
+		}
+		e = next;
+	}
+
+	// Splice the new tokens in and move the spans after the edit over
+	RCTX_RESERVE(ctx->tokens, ntokens + delta);
+	RCTX_RESERVE(ctx->token_entry, ntokens + delta);
+	memmove(ctx->tokens + first + ninserted, ctx->tokens + first + removed,
+			(ntokens - first - removed) * sizeof(token));
+	memmove(ctx->token_entry + first + ninserted, ctx->token_entry + first + removed,
+			(ntokens - first - removed) * sizeof(int));
+	for (int i = 0; i < ninserted; i++) {
+		ctx->tokens[first + i] = inserted[i];
+		ctx->token_entry[first + i] = -1;
+	}
+	ntokens += delta;
+	cvector_set_size(ctx->tokens, ntokens);
+	cvector_set_size(ctx->token_entry, ntokens);
+	for (size_t e = 0; delta != 0 && e < cvector_size(ctx->entries); e++) {
+		if (E(e).live && E(e).start >= first + removed) {
+			E(e).start += delta;
+			E(e).end += delta;
+		}
+	}
+
+	// Parse from the edit on, pushing old subtrees whole wherever they'd reduce the same way
+	int damage_end = first + ninserted;
+	int resync = nold;
+	for (int i = first; i < ntokens; ) {
+		uint32_t below[2];
+		rctx_below(ctx, below);
+
+		int e = ctx->token_entry[i];
+		if (i >= damage_end && e != -1) {
+			// the largest old node starting here. They were all shifted on top of the same nodes
+			while (E(e).parent != -1 && E(E(e).parent).start == E(e).start) {
+				e = E(e).parent;
+			}
+			if (below[0] == E(e).below[0] && below[1] == E(e).below[1]) {
+				if (E(e).parent == -1) {
+					// an old top-level node: it and everything after it comes out the same
+					for (resync = r; old_top[resync] != e; resync++);
+					for (int j = resync; j < nold; j++) {
+						rctx_restore(ctx, old_top[j]);
+					}
+					break;
+				}
+				E(e).generation = ctx->generation;
+				rctx_shift(ctx, e);
+				i = E(e).end;
+				continue;
+			}
+		}
+
+		AST_Node n;
+		if (pctx_convert_token(ctx->tokens[i], &n) == 0) {
+			sl_warn(SL_CAT_PARSER, "Couldn't convert the token, [str=" SV_Fmt ", v=%d] to a terminal. Skipping it.",
+					SV_Arg(ctx->tokens[i].text), ctx->tokens[i].type);
+			ctx->token_entry[i] = -1;
+			i++;
+			continue;
+		}
+		int t = rctx_new_entry(ctx, n, i, i + 1);
+		memcpy(E(t).below, below, sizeof(below));
+		ctx->token_entry[i] = t;
+		rctx_shift(ctx, t);
+		i++;
+	}
+
+	// Whatever wasn't reused from the old top-level nodes the reparse went through is gone
+	for (int j = r; j < resync; j++) {
+		rctx_kill(ctx, old_top[j]);
+	}
+	rctx_compact_children(ctx);
+
+	sl_debug(SL_CAT_PARSER, "reparse: %d tokens replaced by %d, %d of %d top-level nodes kept",
+			removed, ninserted, r + nold - resync, nold);
+	cvector_free(old_top);
+	cvector_free(inserted);
+	return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef REPARSE_H
+#define REPARSE_H
+#include "ast.h"
+#include "parser.h"
+#include "tokenizer.h"
+#include <stdint.h>
+
+/**
+ *  Incremental reparsing
+ *    A reparse_ctx keeps the token array of a document along with every node the parser
+ *    shifted or reduced for it (an entry), and the token span each node covers.
+ *    rctx_edit replaces a range of tokens and brings the tree up to date:
+ *      + the parse stack as it was right before the edit is rebuilt from the old tree
+ *        (the nodes left of the edit along the spine from the top-level statement down to it)
+ *      + the edited tokens are shifted and reduced as usual
+ *      + after the edit, each old subtree (block, if, eeo chain, ...) is pushed whole instead of
+ *        being reparsed, as long as the two parse stack nodes under it look the same as when it
+ *        was first built. No rule looks further down than that, so it would reduce the same way
+ *      + once an old top-level statement can be pushed that way, every later one is unchanged
+ *        and gets copied over as is
+ *    Reductions and allocations scale with the edit (plus the siblings of any block it's in,
+ *    since a block is reduced all at once). Moving the tokens and spans over is a plain memmove.
+ *
+ *    Reused nodes keep pointing into the source they were lexed from, so every source
+ *    generation stays alive until rctx_free. Their tokenizer_state (line/col) is from that
+ *    generation too.
+ */
+
+typedef struct reparse_entry {
+	AST_Node node;
+	int      start, end;           // token span [start, end)
+	int      parent;               // entry that reduced this one away, -1 while it's on the parse stack
+	int      children, nchildren;  // range in reparse_ctx.child_pool
+	uint32_t below[2];             // shape of the two parse stack nodes under 'start' when it was shifted
+	int      generation;           // edit that last reused this entry
+	bool     live;
+} reparse_entry;
+
+typedef struct reparse_ctx {
+	parse_ctx     pctx;            // pctx.pstack holds the top-level nodes, same as a normal parse
+	tokenizer_ctx tctx;            // only for the compiled regexes, content is swapped per edit
+	int           generation;
+
+	cvector_vector_type(char*)         sources;      // every source generation
+	cvector_vector_type(token)         tokens;
+	cvector_vector_type(int)           token_entry;  // entry each token was shifted as, -1 if none
+	cvector_vector_type(int)           slots;        // entry of each parse stack slot
+	cvector_vector_type(reparse_entry) entries;
+	cvector_vector_type(int)           free_entries;
+	cvector_vector_type(int)           child_pool;
+	size_t                             child_garbage;
+} reparse_ctx;
+
+// Initialization/Destruction
+//   rctx_new parses 'text' as the initial document
+reparse_ctx rctx_new(const char*);
+void        rctx_free(reparse_ctx*);
+
+// Editing
+//   replaces tokens [first, first + removed) with the tokens of 'text' and reparses
+//   returns 0 on success, -1 if the range is out of bounds
+int         rctx_edit(reparse_ctx*, int first, int removed, const char* text);
+int         rctx_token_count(reparse_ctx*);
+
+#endif
@@ -0,0 +1,115 @@
+#include "rope.h"
+#include "cvector.h"
+#include "sl_assert.h"
+#include <stdlib.h>
+#include <string.h>
+
+static rope* ropes;
+
+static rope* rope_new(stack_node l, stack_node r, size_t length) {
+	rope* n = malloc(sizeof(rope));
+	sl_assert(n, "Out of memory concatenating strings");
+	*n = (rope) {.left = l, .right = r, .length = length, .next = ropes};
+	ropes = n;
+	hs_made(sizeof(rope));
+	return n;
+}
+
+size_t rope_length(stack_node v) {
+	if (sn_is_rope(v)) return sn_rope(v)->length;
+	return sn_string(&v).count;
+}
+
+stack_node rope_concat(stack_node l, stack_node r) {
+	size_t llen = rope_length(l), rlen = rope_length(r), length = llen + rlen;
+	if (rlen == 0) return l;
+	if (llen == 0) return r;
+	if (length <= SN_STRING_INLINE_MAX) {
+		// both halves are inline
+		char buf[SN_STRING_INLINE_MAX];
+		String_View a = sn_string(&l), b = sn_string(&r);
+		memcpy(buf, a.data, a.count);
+		memcpy(buf + a.count, b.data, b.count);
+		return ictx_string_from_sv(sv_from_parts(buf, length));
+	}
+	rope* n = rope_new(l, r, length);
+	return (stack_node) {SN_BOXED(STRING) | (uintptr_t) n | SN_STRING_ROPE};
+}
+
+const stack_node* rope_flatten(stack_node v) {
+	rope* root = sn_rope(v);
+	if (root->flat.bits) return &root->flat;
+
+	// Filled from the end, right halves first, with a stack instead of recursion since
+	// appending in a loop makes ropes as deep as the loop ran
+	heapstr* flat = hs_alloc(root->length);
+	char* buf = flat->data;
+	size_t end = root->length;
+	cvector_vector_type(stack_node) todo = NULL;
+	cvector_push_back(todo, root->left);
+	cvector_push_back(todo, root->right);
+	while (!cvector_empty(todo)) {
+		stack_node n = todo[cvector_size(todo) - 1];
+		cvector_pop_back(todo);
+		if (sn_is_rope(n) && !sn_rope(n)->flat.bits) {
+			cvector_push_back(todo, sn_rope(n)->left);
+			cvector_push_back(todo, sn_rope(n)->right);
+			continue;
+		}
+		String_View s = sn_string(&n);
+		end -= s.count;
+		memcpy(buf + end, s.data, s.count);
+	}
+	cvector_free(todo);
+	hs_finish(flat);
+	root->flat = (stack_node) {SN_BOXED(STRING) | (uintptr_t) flat | SN_STRING_HEAP};
+	root->left = root->right = SN_UNDEFINED;
+	return &root->flat;
+}
+
+void rope_mark(stack_node v) {
+	// the same halves can be in a rope many times over (a + of a string with itself),
+	// each node is only walked once
+	cvector_vector_type(stack_node) todo = NULL;
+	cvector_push_back(todo, v);
+	while (!cvector_empty(todo)) {
+		stack_node n = todo[cvector_size(todo) - 1];
+		cvector_pop_back(todo);
+		if (sn_is_heapstr(n)) {
+			hs_mark(sn_heapstr(n));
+			continue;
+		}
+		if (!sn_is_rope(n) || !hs_stamp(&sn_rope(n)->mark)) continue;
+		rope* r = sn_rope(n);
+		if (r->flat.bits) {
+			hs_mark(sn_heapstr(r->flat));
+			continue;
+		}
+		cvector_push_back(todo, r->left);
+		cvector_push_back(todo, r->right);
+	}
+	cvector_free(todo);
+}
+
+void rope_sweep() {
+	size_t kept = 0;
+	for (rope** it = &ropes; *it;) {
+		rope* r = *it;
+		if (hs_stamped(r->mark)) {
+			kept += sizeof(rope);
+			it = &r->next;
+			continue;
+		}
+		*it = r->next;
+		free(r);
+	}
+	hs_kept(kept);
+}
+
+void rope_free() {
+	while (ropes) {
+		rope* r = ropes;
+		ropes = r->next;
+		free(r);
+	}
+}
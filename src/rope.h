@@ -0,0 +1,44 @@
+#ifndef ROPE_H
+#define ROPE_H
+#include "interpreter.h"
+#include <stddef.h>
+
+/**
+ *  Ropes, what + makes of two strings
+ *    A rope is a STRING value pointing at a node that only holds its two halves and the
+ *    total length (the pointer has its low bit set, see interpreter.h), so each + costs the
+ *    same however long the strings are and building one by appending stays linear.
+ *    The bytes are put together the first time something needs them (printing, ==, a
+ *    switch) into a heap string kept in the node, so that only happens once, and the
+ *    halves are let go.
+ *    Nodes are collected like heap strings (see heapstr.h): one the stack doesn't reach
+ *    anymore is freed by the next collection, its flat string with it unless something
+ *    else holds that too.
+ */
+typedef struct rope {
+	stack_node   left, right;  // UNDEFINED once flattened
+	size_t       length;
+	stack_node   flat;         // the heap string once flattened, 0 bits before
+	uint32_t     mark;         // the last collection that walked it, see heapstr.h
+	struct rope* next;         // every node, for the sweep
+} rope;
+
+static inline bool sn_is_rope(stack_node v) {
+	return (v.bits & (SN_STRING_INLINE | SN_STRING_ROPE)) == SN_STRING_ROPE;
+}
+static inline rope* sn_rope(stack_node v) {
+	return (rope*) (uintptr_t) (v.bits & SN_PAYLOAD & ~SN_STRING_ROPE);
+}
+
+// l + r for two strings, short enough results are made inline straight away
+stack_node        rope_concat(stack_node l, stack_node r);
+size_t            rope_length(stack_node);
+// the flat value of a rope, which stays where it is as long as the rope does
+const stack_node* rope_flatten(stack_node);
+// stamps the rope and every node under it, hs_mark on the heap strings they hold
+void              rope_mark(stack_node);
+// frees the nodes the collection running didn't stamp
+void              rope_sweep();
+void              rope_free();
+
+#endif
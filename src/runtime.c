@@ -0,0 +1,36 @@
+#include "runtime.h"
+#include "array.h"
+#include "input.h"
+#include "rope.h"
+#include "sl_assert.h"
+#include "strpool.h"
+
+static interpreter_ctx rt_ctx;
+
+interpreter_ctx* rt_start(size_t slots, bool verified) {
+	rt_ctx = slots == 0 ? ictx_new() : ictx_new_sized(slots);
+	rt_ctx.verified = verified;
+	ictx_enter(&rt_ctx);
+	return &rt_ctx;
+}
+
+void rt_finish(interpreter_ctx* ictx) {
+	ictx_free(ictx);
+	strpool_free();
+	hs_free();
+	rope_free();
+	in_free();
+	arr_free();
+}
+
+stack_node rt_string(const char* s, size_t length) {
+	return ictx_string_from_sv(sv_from_parts(s, length));
+}
+
+void rt_bad_call(const char* name) {
+	sl_assert(0, "Proc call for '%s' not implemented", name);
+}
+
+void rt_bad_operator(const char* name) {
+	sl_assert(0, "Undefined operation \"%s\"\n", name);
+}
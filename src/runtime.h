@@ -0,0 +1,91 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+#include "interpreter.h"
+#include "interpreter_builtins.h"
+#include "switch.h"
+
+/**
+ *  Runtime for programs translated to C (--emit-c)
+ *    What the generated code calls. Values, the operator table and the builtins are the
+ *    interpreter's own, so a translated program behaves exactly like the engines do.
+ *    Built into out/libspaz.a with the rest of the interpreter (make build-runtime):
+ *      spaz -f prog.lang --emit-c > prog.c
+ *      gcc -O2 -Isrc prog.c out/libspaz.a -lm -o prog
+ */
+
+// the stack holds exactly `slots` values, see verify.h. 0 when the depth isn't known,
+// the stack gets the default size. Calls skip their depth check only when verified
+interpreter_ctx* rt_start(size_t slots, bool verified);
+void             rt_finish(interpreter_ctx*);
+stack_node       rt_string(const char*, size_t);
+void             rt_bad_call(const char* name);
+void             rt_bad_operator(const char* name);
+
+static inline void rt_push(interpreter_ctx* ictx, stack_node v) {
+	ictx->stack[++ictx->stack_top] = v;
+}
+
+static inline void rt_pop(interpreter_ctx* ictx, int n) {
+	ictx->stack_top -= n;
+	if (ictx->stack_top < -1) ictx_pop_underflow();
+}
+
+static inline void rt_dup(interpreter_ctx* ictx, int n) {
+	stack_node top = ictx->stack[ictx->stack_top];
+	for (int i = 0; i < n; i++) {
+		ictx->stack[++ictx->stack_top] = top;
+	}
+}
+
+static inline void rt_peek(interpreter_ctx* ictx, int depth) {
+	if (ictx->stack_top < depth) ictx_pop_underflow();
+	stack_node n = ictx->stack[ictx->stack_top - depth];
+	ictx->stack[++ictx->stack_top] = n;
+}
+
+// around a call that isn't in tail position, the same limit the engines have
+static inline void rt_enter(interpreter_ctx* ictx) {
+	if (++ictx->call_depth > ICTX_CALL_DEPTH_MAX) ictx_call_overflow();
+}
+
+static inline void rt_leave(interpreter_ctx* ictx) {
+	ictx->call_depth--;
+}
+
+// op is always a constant in generated code, so only its own case is left after inlining
+static inline void rt_binary(interpreter_ctx* ictx, OperatorCode op) {
+	stack_node* l = &ictx->stack[ictx->stack_top - 1];
+	stack_node* r = &ictx->stack[ictx->stack_top];
+	if (sn_is_int(*l) && sn_is_int(*r)) {
+		int a = sn_int(*l), b = sn_int(*r);
+		switch (op) {
+			case OPERATOR_CODE_ADD:  *l = sn_from_int(a + b);  ictx->stack_top--; return;
+			case OPERATOR_CODE_SUB:  *l = sn_from_int(a - b);  ictx->stack_top--; return;
+			case OPERATOR_CODE_MUL:  *l = sn_from_int(a * b);  ictx->stack_top--; return;
+			case OPERATOR_CODE_GT:   *l = sn_from_int(a > b);  ictx->stack_top--; return;
+			case OPERATOR_CODE_LT:   *l = sn_from_int(a < b);  ictx->stack_top--; return;
+			case OPERATOR_CODE_LAND: *l = sn_from_int(a && b); ictx->stack_top--; return;
+			case OPERATOR_CODE_LOR:  *l = sn_from_int(a || b); ictx->stack_top--; return;
+			case OPERATOR_CODE_EQ:   *l = sn_from_int(a == b); ictx->stack_top--; return;
+			default: break;
+		}
+	}
+	ictx_apply_binary(ictx, op);
+}
+
+// an if: true, with the condition popped, only for a nonzero int
+static inline bool rt_branch(interpreter_ctx* ictx) {
+	stack_node top = ictx->stack[ictx->stack_top];
+	if (sn_is_int(top) && sn_int(top) != 0) {
+		ictx->stack_top--;
+		return true;
+	}
+	return false;
+}
+
+// a switch: pops the value, the case to run or -1
+static inline int rt_switch(interpreter_ctx* ictx, const sw_table* t) {
+	return sw_lookup(t, ictx->stack[ictx->stack_top--]);
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include "sl_log.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/***
+ *  Ring buffer sink for sl_log
+ *    Producers claim a slot by bumping head with a CAS, format into it, then publish it by
+ *    advancing the slot's sequence number. The drain walks from tail writing every published
+ *    record to the sink fd. No locks are taken anywhere, and a producer that finds the ring
+ *    full drains it itself (or drops the record if someone else is already draining).
+ */
+
+#define SL_LOG_RING_SLOTS   256   // must be a power of two
+#define SL_LOG_RECORD_SIZE  256
+
+typedef struct sl_log_record {
+	atomic_size_t seq;
+	int           length;
+	char          text[SL_LOG_RECORD_SIZE];
+} sl_log_record;
+
+static struct {
+	sl_log_record slots[SL_LOG_RING_SLOTS];
+	atomic_size_t head;
+	atomic_size_t tail;
+	atomic_flag   draining;
+	atomic_size_t dropped;
+	atomic_int    initialized;
+	int           fd;
+} sl_ring = { .draining = ATOMIC_FLAG_INIT, .fd = STDERR_FILENO };
+
+unsigned char sl_log_levels[SL_CAT_COUNT] = {
+	[SL_CAT_MAIN]      = SL_LEVEL_WARN,
+	[SL_CAT_TOKENIZER] = SL_LEVEL_WARN,
+	[SL_CAT_PARSER]    = SL_LEVEL_WARN,
+	[SL_CAT_AST]       = SL_LEVEL_WARN,
+	[SL_CAT_INTERP]    = SL_LEVEL_WARN,
+	[SL_CAT_FREE]      = SL_LEVEL_WARN,
+};
+
+static const char* sl_log_category_names[SL_CAT_COUNT] = {
+	[SL_CAT_MAIN]      = "main",
+	[SL_CAT_TOKENIZER] = "tokenizer",
+	[SL_CAT_PARSER]    = "parser",
+	[SL_CAT_AST]       = "ast",
+	[SL_CAT_INTERP]    = "interp",
+	[SL_CAT_FREE]      = "free",
+};
+
+static const char* sl_log_level_names[] = {
+	[SL_LEVEL_OFF]   = "off",
+	[SL_LEVEL_ERROR] = "error",
+	[SL_LEVEL_WARN]  = "warn",
+	[SL_LEVEL_INFO]  = "info",
+	[SL_LEVEL_DEBUG] = "debug",
+	[SL_LEVEL_TRACE] = "trace",
+};
+
+static void sl_log_init() {
+	int expected = 0;
+	if (!atomic_compare_exchange_strong(&sl_ring.initialized, &expected, 1))
+		return;
+	for (size_t i = 0; i < SL_LOG_RING_SLOTS; i++) {
+		atomic_store(&sl_ring.slots[i].seq, i);
+	}
+	atexit(sl_log_flush);
+}
+
+static int sl_log_parse_level(const char* s, size_t n) {
+	for (int lvl = SL_LEVEL_OFF; lvl <= SL_LEVEL_TRACE; lvl++) {
+		if (strlen(sl_log_level_names[lvl]) == n && strncmp(s, sl_log_level_names[lvl], n) == 0)
+			return lvl;
+	}
+	return -1;
+}
+
+static int sl_log_parse_category(const char* s, size_t n) {
+	for (int cat = 0; cat < SL_CAT_COUNT; cat++) {
+		if (strlen(sl_log_category_names[cat]) == n && strncmp(s, sl_log_category_names[cat], n) == 0)
+			return cat;
+	}
+	return -1;
+}
+
+int sl_log_configure(const char* spec) {
+	sl_log_init();
+	while (*spec) {
+		const char* end = strchr(spec, ',');
+		size_t n = end ? (size_t)(end - spec) : strlen(spec);
+		const char* eq = memchr(spec, '=', n);
+		if (eq) {
+			int cat = sl_log_parse_category(spec, eq - spec);
+			int lvl = sl_log_parse_level(eq + 1, n - (eq - spec) - 1);
+			if (cat == -1 || lvl == -1) return -1;
+			sl_log_levels[cat] = lvl;
+		}
+		else {
+			// bare level applies to every category
+			int lvl = sl_log_parse_level(spec, n);
+			if (lvl == -1) return -1;
+			memset(sl_log_levels, lvl, sizeof(sl_log_levels));
+		}
+		spec += n;
+		if (*spec == ',') spec++;
+	}
+	return 0;
+}
+
+int sl_log_set_file(const char* path) {
+	sl_log_init();
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		fprintf(stderr, "Failed to open log file: %s\n", path);
+		return -1;
+	}
+	sl_log_flush();
+	if (sl_ring.fd != STDERR_FILENO) close(sl_ring.fd);
+	sl_ring.fd = fd;
+	return 0;
+}
+
+void sl_log_flush() {
+	if (atomic_flag_test_and_set(&sl_ring.draining))
+		return; // someone else is draining
+	size_t pos = atomic_load(&sl_ring.tail);
+	for (;;) {
+		sl_log_record* r = &sl_ring.slots[pos & (SL_LOG_RING_SLOTS - 1)];
+		if (atomic_load_explicit(&r->seq, memory_order_acquire) != pos + 1)
+			break; // not published yet
+		write(sl_ring.fd, r->text, r->length);
+		atomic_store_explicit(&r->seq, pos + SL_LOG_RING_SLOTS, memory_order_release);
+		pos++;
+	}
+	atomic_store(&sl_ring.tail, pos);
+	size_t dropped = atomic_exchange(&sl_ring.dropped, 0);
+	if (dropped) {
+		char note[64];
+		int n = snprintf(note, sizeof(note), "[sl_log] dropped %zu records\n", dropped);
+		write(sl_ring.fd, note, n);
+	}
+	atomic_flag_clear(&sl_ring.draining);
+}
+
+static sl_log_record* sl_log_claim(size_t* out_pos) {
+	for (int attempt = 0; attempt < 2; attempt++) {
+		size_t pos = atomic_load_explicit(&sl_ring.head, memory_order_relaxed);
+		for (;;) {
+			sl_log_record* r = &sl_ring.slots[pos & (SL_LOG_RING_SLOTS - 1)];
+			size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+			if (seq == pos) {
+				if (atomic_compare_exchange_weak(&sl_ring.head, &pos, pos + 1)) {
+					*out_pos = pos;
+					return r;
+				}
+			}
+			else if (seq < pos) {
+				break; // full
+			}
+			else {
+				pos = atomic_load_explicit(&sl_ring.head, memory_order_relaxed);
+			}
+		}
+		sl_log_flush();
+	}
+	atomic_fetch_add(&sl_ring.dropped, 1);
+	return NULL;
+}
+
+void sl_log_emit(sl_log_category cat, sl_log_level lvl, const char* file, int line, const char* fmt, ...) {
+	sl_log_init();
+	size_t pos;
+	sl_log_record* r = sl_log_claim(&pos);
+	if (!r) return;
+
+	int n = snprintf(r->text, SL_LOG_RECORD_SIZE, "[%-5s %-9s] (%s, %3d): ",
+			sl_log_level_names[lvl], sl_log_category_names[cat], file, line);
+	va_list args;
+	va_start(args, fmt);
+	if (n < SL_LOG_RECORD_SIZE)
+		n += vsnprintf(r->text + n, SL_LOG_RECORD_SIZE - n, fmt, args);
+	va_end(args);
+	if (n > SL_LOG_RECORD_SIZE - 1) n = SL_LOG_RECORD_SIZE - 1; // truncated
+	if (r->text[n - 1] != '\n') r->text[n++] = '\n';
+	r->length = n;
+
+	atomic_store_explicit(&r->seq, pos + 1, memory_order_release);
+	if (pos - atomic_load(&sl_ring.tail) >= SL_LOG_RING_SLOTS / 2)
+		sl_log_flush();
+}
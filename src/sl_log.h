@@ -1,24 +1,78 @@
 #ifndef SL_LOG_H
 #define SL_LOG_H
 #include <stdio.h>
+#include <string.h>
+
+/**
+ *  Leveled, per-subsystem logging
+ *    + every record belongs to a category (subsystem) and has a level
+ *    + SL_LOG_MAX_LEVEL caps what gets compiled in. Anything above it turns into a
+ *      constant false branch, so release builds (-DSL_LOG_MAX_LEVEL=0) carry no logging at all
+ *    + below the cap, each category can be raised/lowered at runtime (see sl_log_configure)
+ *    + records are formatted into a ring buffer and drained to stderr (or a file),
+ *      never to stdout, so they can't interleave with program output
+ */
+typedef enum sl_log_level {
+	SL_LEVEL_OFF = 0,
+	SL_LEVEL_ERROR,
+	SL_LEVEL_WARN,
+	SL_LEVEL_INFO,
+	SL_LEVEL_DEBUG,
+	SL_LEVEL_TRACE,
+} sl_log_level;
+
+typedef enum sl_log_category {
+	SL_CAT_MAIN,
+	SL_CAT_TOKENIZER,
+	SL_CAT_PARSER,
+	SL_CAT_AST,
+	SL_CAT_INTERP,
+	SL_CAT_FREE,
+	SL_CAT_COUNT
+} sl_log_category;
+
+#ifndef SL_LOG_MAX_LEVEL
+#define SL_LOG_MAX_LEVEL 5 // SL_LEVEL_TRACE
+#endif
+
+extern unsigned char sl_log_levels[SL_CAT_COUNT];
+
+// Initialization/Destruction
+//   sl_log_configure takes a spec like "parser=trace,interp=debug" or just "debug" (all categories)
+//   returns 0 on success, -1 if the spec couldn't be understood
+int  sl_log_configure(const char*);
+int  sl_log_set_file(const char*);
+void sl_log_flush();
+
+void sl_log_emit(sl_log_category, sl_log_level, const char*, int, const char*, ...)
+	__attribute__((format(printf, 5, 6)));
 
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
-#define sl_log(fmt, ...) \
-	fprintf(stdout, "(%s, %3d): " fmt "\n", (__FILENAME__), __LINE__, ##__VA_ARGS__)
 
+#define sl_log_enabled(cat, lvl) \
+	((lvl) <= SL_LOG_MAX_LEVEL && sl_log_levels[(cat)] >= (lvl))
+
+#define sl_logc(cat, lvl, fmt, ...) \
+	do {\
+		if (sl_log_enabled(cat, lvl))\
+			sl_log_emit(cat, lvl, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__);\
+	} while (0)
+
+#define sl_error(cat, fmt, ...) sl_logc(cat, SL_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define sl_warn(cat, fmt, ...)  sl_logc(cat, SL_LEVEL_WARN,  fmt, ##__VA_ARGS__)
+#define sl_info(cat, fmt, ...)  sl_logc(cat, SL_LEVEL_INFO,  fmt, ##__VA_ARGS__)
+#define sl_debug(cat, fmt, ...) sl_logc(cat, SL_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define sl_trace(cat, fmt, ...) sl_logc(cat, SL_LEVEL_TRACE, fmt, ##__VA_ARGS__)
 
 /**
  *  Macro for logging the memory freeing progress
  */
-#if defined(DEBUG_FREE) && DEBUG_FREE==1
-#define sl_log_free(fmt, ...) sl_log("(FREE)" fmt, ##__VA_ARGS__)
-#else
-#define sl_log_free(fmt, ...) {}
-#endif
+#define sl_log_free(fmt, ...) sl_trace(SL_CAT_FREE, fmt, ##__VA_ARGS__)
 
 /**
- *  Macro for logging the generated parse tree
+ *  Macro for printing the generated parse tree (-p, -v)
+ *    This is output the user asked for rather than a log record, so it goes straight to stdout
  */
-#define sl_log_ast(fmt, ...)  sl_log("(AST) " fmt, ##__VA_ARGS__)
+#define sl_log_ast(fmt, ...)  fprintf(stdout, "(AST) " fmt "\n", ##__VA_ARGS__)
 
 #endif // SL_LOG_H
@@ -0,0 +1,74 @@
+#include "strpool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Open addressing table of entries, kept at most half full
+static struct {
+	strpool_entry** slots;
+	size_t          capacity;
+	size_t          count;
+} pool;
+
+// FNV-1a
+uint64_t strpool_hash(const char* data, size_t length) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < length; i++) {
+		h ^= (unsigned char) data[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static void strpool_grow() {
+	size_t new_capacity = pool.capacity ? pool.capacity * 2 : 64;
+	strpool_entry** new_slots = calloc(new_capacity, sizeof(strpool_entry*));
+	for (size_t i = 0; i < pool.capacity; i++) {
+		strpool_entry* e = pool.slots[i];
+		if (!e) continue;
+		size_t j = e->hash & (new_capacity - 1);
+		while (new_slots[j]) j = (j + 1) & (new_capacity - 1);
+		new_slots[j] = e;
+	}
+	free(pool.slots);
+	pool.slots = new_slots;
+	pool.capacity = new_capacity;
+}
+
+const strpool_entry* strpool_intern(String_View sv) {
+	if ((pool.count + 1) * 2 > pool.capacity)
+		strpool_grow();
+	uint64_t h = strpool_hash(sv.data, sv.count);
+	size_t i = h & (pool.capacity - 1);
+	for (; pool.slots[i]; i = (i + 1) & (pool.capacity - 1)) {
+		strpool_entry* e = pool.slots[i];
+		if (e->hash == h && e->length == sv.count && memcmp(e->data, sv.data, sv.count) == 0)
+			return e;
+	}
+	strpool_entry* e = malloc(sizeof(strpool_entry) + sv.count + 1);
+	e->hash = h;
+	e->length = sv.count;
+	memcpy(e->data, sv.data, sv.count);
+	e->data[sv.count] = 0;
+	pool.slots[i] = e;
+	pool.count++;
+	return e;
+}
+
+const strpool_entry* strpool_find(String_View sv, uint64_t hash) {
+	if (pool.capacity == 0) return NULL;
+	for (size_t i = hash & (pool.capacity - 1); pool.slots[i]; i = (i + 1) & (pool.capacity - 1)) {
+		strpool_entry* e = pool.slots[i];
+		if (e->hash == hash && e->length == sv.count && memcmp(e->data, sv.data, sv.count) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+void strpool_free() {
+	for (size_t i = 0; i < pool.capacity; i++) {
+		free(pool.slots[i]);
+	}
+	free(pool.slots);
+	pool.slots = NULL;
+	pool.capacity = pool.count = 0;
+}
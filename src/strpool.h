@@ -0,0 +1,28 @@
+#ifndef STRPOOL_H
+#define STRPOOL_H
+#include "sv.h"
+#include <stdint.h>
+
+/***
+ *  Interned strings
+ *    Every string literal in the source is stored once, without its quotes, along with its
+ *    length and hash, so two literals with the same contents share an entry and comparing
+ *    them is a pointer compare. Switch cases are literals, so they're in here too.
+ *    Strings made at run time that are too long to go inline are heap strings instead
+ *    (see heapstr.h), entries stay until strpool_free.
+ */
+typedef struct strpool_entry {
+	uint64_t hash;
+	size_t   length;
+	char     data[];    // NUL terminated
+} strpool_entry;
+
+#define STRPOOL_SV(e) sv_from_parts((e)->data, (e)->length)
+
+uint64_t             strpool_hash(const char*, size_t);
+const strpool_entry* strpool_intern(String_View);
+// the entry with these contents and hash if there is one, nothing is added
+const strpool_entry* strpool_find(String_View, uint64_t hash);
+void                 strpool_free();
+
+#endif
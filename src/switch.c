@@ -0,0 +1,170 @@
+#include "switch.h"
+#include "rope.h"
+#include "sl_assert.h"
+#include <stdlib.h>
+
+// ints go in a table when it has at most this many slots per case (plus a few)
+#define SW_DENSE_PER_CASE 4
+#define SW_DENSE_EXTRA    16
+// seeds tried per hash size, then it doubles, SW_GROWTHS times at most
+#define SW_SEED_TRIES     64
+#define SW_GROWTHS        4
+
+static uint64_t sw_splitmix(uint64_t* state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static uint64_t sw_home(const sw_table* t, uint64_t key) {
+	return (key * t->mul) >> t->shift;
+}
+
+// Linear probing into slots, the number of probes it took
+static int sw_insert(sw_table* t, uint64_t key, int32_t index) {
+	uint64_t mask = (1ull << (64 - t->shift)) - 1;
+	uint64_t i = sw_home(t, key);
+	int probes = 1;
+	while (t->slots[i].index >= 0) {
+		i = (i + 1) & mask;
+		probes++;
+	}
+	t->slots[i] = (sw_slot) {.key = key, .index = index};
+	return probes;
+}
+
+static int sw_hash_find(const sw_table* t, uint64_t key) {
+	if (!t->slots) return -1;
+	uint64_t mask = (1ull << (64 - t->shift)) - 1;
+	uint64_t i = sw_home(t, key);
+	for (int p = 0; p < t->probes; p++, i = (i + 1) & mask) {
+		if (t->slots[i].index < 0) return -1;
+		if (t->slots[i].key == key) return t->slots[i].index;
+	}
+	return -1;
+}
+
+// Tries seeds until no key shares its home slot with another. Keys are distinct, so that
+// practically always happens within a few tries, if it doesn't the last try probes
+static void sw_build_hash(sw_table* t, const uint64_t* keys, const int32_t* index, int count) {
+	int bits = 1;
+	while ((1 << bits) < 2 * count) bits++;
+	uint64_t state = 0x5357495443480000ull;  // same seeds every run
+	for (int growth = 0; growth <= SW_GROWTHS; growth++, bits++) {
+		size_t size = (size_t) 1 << bits;
+		t->slots = realloc(t->slots, size * sizeof(sw_slot));
+		sl_assert(t->slots, "Out of memory building a switch table");
+		t->shift = 64 - bits;
+		for (int tries = 0; tries < SW_SEED_TRIES; tries++) {
+			for (size_t i = 0; i < size; i++) t->slots[i].index = -1;
+			t->mul = sw_splitmix(&state) | 1;
+			t->probes = 1;
+			for (int k = 0; k < count; k++) {
+				int p = sw_insert(t, keys[k], index[k]);
+				if (p > t->probes) t->probes = p;
+			}
+			if (t->probes == 1) return;
+		}
+	}
+}
+
+sw_table* sw_build(const sw_case* cases, int count) {
+	sw_table* t = calloc(1, sizeof(sw_table));
+	sl_assert(t, "Out of memory building a switch table");
+	t->count = count;
+	t->default_case = -1;
+
+	int32_t lo = INT32_MAX, hi = INT32_MIN;
+	int ints = 0;
+	for (int i = 0; i < count; i++) {
+		if (cases[i].is_default) {
+			if (t->default_case < 0) t->default_case = i;
+			continue;
+		}
+		if (sn_is_int(cases[i].value)) {
+			int32_t v = sn_int(cases[i].value);
+			if (v < lo) lo = v;
+			if (v > hi) hi = v;
+			ints++;
+		}
+	}
+	uint64_t span = ints ? (uint64_t) ((int64_t) hi - lo) + 1 : 0;
+	bool dense = ints && span <= (uint64_t) ints * SW_DENSE_PER_CASE + SW_DENSE_EXTRA;
+	if (dense) {
+		t->int_min = lo;
+		t->int_span = (uint32_t) span;
+		t->ints = malloc(span * sizeof(int32_t));
+		sl_assert(t->ints, "Out of memory building a switch table");
+		for (uint64_t i = 0; i < span; i++) t->ints[i] = -1;
+	}
+
+	uint64_t* keys  = malloc((count + 1) * sizeof(uint64_t));
+	int32_t*  index = malloc((count + 1) * sizeof(int32_t));
+	sl_assert(keys && index, "Out of memory building a switch table");
+	int hashed = 0;
+	for (int i = 0; i < count; i++) {
+		stack_node v = cases[i].value;
+		if (cases[i].is_default) continue;
+		// the earlier case keeps a value
+		if (sw_lookup(t, v) != t->default_case) continue;
+		switch (sn_type(v)) {
+			case INTEGER:
+				if (dense) {
+					t->ints[sn_int(v) - lo] = i;
+					break;
+				}
+				// fallthrough
+			case STRING: {
+				bool seen = false;
+				for (int k = 0; k < hashed; k++) seen |= keys[k] == v.bits;
+				if (seen) break;
+				keys[hashed] = v.bits;
+				index[hashed++] = i;
+				break;
+			}
+			case CHAR:
+				if (!t->chars) {
+					t->chars = malloc(256 * sizeof(int32_t));
+					sl_assert(t->chars, "Out of memory building a switch table");
+					for (int c = 0; c < 256; c++) t->chars[c] = -1;
+				}
+				t->chars[(unsigned char) sn_char(v)] = i;
+				break;
+			default:
+				sl_assert(0, "A switch case has to be an int, a char or a string, not a %s\n", ictx_stack_node_type_to_str(sn_type(v)));
+		}
+	}
+	if (hashed > 0) sw_build_hash(t, keys, index, hashed);
+	free(keys);
+	free(index);
+	return t;
+}
+
+int sw_lookup(const sw_table* t, stack_node v) {
+	int c = -1;
+	switch (sn_type(v)) {
+		case INTEGER: {
+			uint32_t i = (uint32_t) sn_int(v) - (uint32_t) t->int_min;
+			c = t->int_span ? (i < t->int_span ? t->ints[i] : -1) : sw_hash_find(t, v.bits);
+			break;
+		}
+		case CHAR:   c = t->chars ? t->chars[(unsigned char) sn_char(v)] : -1; break;
+		case STRING: {
+			// a string that isn't in the pool isn't any case's literal
+			stack_node literal;
+			if (ictx_string_literal(v, &literal)) c = sw_hash_find(t, literal.bits);
+			break;
+		}
+		default: break;
+	}
+	return c < 0 ? t->default_case : c;
+}
+
+void sw_free(sw_table* t) {
+	if (!t) return;
+	free(t->ints);
+	free(t->chars);
+	free(t->slots);
+	free(t);
+}
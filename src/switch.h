@@ -0,0 +1,51 @@
+#ifndef SWITCH_H
+#define SWITCH_H
+#include "interpreter.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ *  Dispatch tables for switch
+ *    Built once per switch (when it's linked) and shared by every engine. Finding the case
+ *    for a value costs the same however many cases there are:
+ *    + ints -> a dense table from the smallest case up when they're close together,
+ *      otherwise the hash below
+ *    + chars -> a table over all 256 of them
+ *    + strings -> equal literals have equal bits (inline or interned), so the bits are the
+ *      key. A rope is flattened first and a heap string looked up in the pool by its hash,
+ *      without adding it. The hash is seeded until every key has a slot of its own, a
+ *      lookup is then a single compare
+ *    A value only matches a case of its own type, a double never matches.
+ */
+typedef struct {
+	stack_node value;       // an int, char or string
+	bool       is_default;
+} sw_case;
+
+typedef struct {
+	uint64_t key;           // stack_node bits
+	int32_t  index;         // -1 for an empty slot
+} sw_slot;
+
+struct sw_table {
+	int      count;
+	int      default_case;  // -1 without one
+
+	int32_t  int_min;
+	uint32_t int_span;      // 0 when the ints went in the hash
+	int32_t* ints;          // case index per int_min + i, -1 where there's none
+	int32_t* chars;         // 256 entries, NULL without char cases
+
+	sw_slot* slots;         // NULL when nothing is hashed
+	uint64_t mul;           // odd multiplier, the seed
+	int      shift;         // 64 - log2(slot count)
+	int      probes;        // 1 once the hash is perfect, which it practically always is
+};
+
+// A later case with the same value as an earlier one is left out, the earlier one wins
+sw_table* sw_build(const sw_case*, int count);
+// The index of the case to run, the default's when nothing else matches, -1 without one
+int       sw_lookup(const sw_table*, stack_node);
+void      sw_free(sw_table*);
+
+#endif
@@ -13,9 +13,13 @@ regex_t rnew(const char* r) {
 	return reg;
 }
 
-int rmatch(const char* s, regex_t r, int* length_out) {
+// [s, end) is the text left to match. Passing the end with REG_STARTEND keeps
+// regexec from running strlen over the rest of the file on every call
+int rmatch(const char* s, const char* end, regex_t r, int* length_out) {
 	regmatch_t match[1];
-	if (regexec(&r, s, 1, match, 0) == 0) {
+	match[0].rm_so = 0;
+	match[0].rm_eo = end - s;
+	if (regexec(&r, s, 1, match, REG_STARTEND) == 0) {
 		// make sure the match was immediately at s
 		if (match[0].rm_so != 0)
 			return -1;
@@ -60,6 +64,7 @@ const char* token_str(token_type t) {
 		case T_FN:      		return "FN";
 		case T_IF:      		return "IF";
 		case T_ELSE: 				return "ELSE";
+		case T_WHILE: 			return "WHILE";
 		case T_SWITCH:      return "SWITCH";
 		case T_BREAK: 			return "BREAK";
 		case T_DEFAULT: 		return "DEFAULT";
@@ -101,27 +106,29 @@ const char* token_str(token_type t) {
 	}
 }
 
+// Every pattern is anchored so regexec fails at the cursor instead of scanning the rest of the file
 void tctx_internal_init_regex(tokenizer_ctx* ctx) {
-	ctx->regex_store.r_string_lit = rnew("\\\"([^\\\"]|\n)*\\\"");
-	ctx->regex_store.r_char_lit   = rnew("\\\'(.)\\\'");
-	ctx->regex_store.r_fn         = rnew("fn");
-	ctx->regex_store.r_if         = rnew("if");
-	ctx->regex_store.r_else       = rnew("else");
-	ctx->regex_store.r_switch     = rnew("switch");
-	ctx->regex_store.r_break      = rnew("break");
-	ctx->regex_store.r_default    = rnew("default");
-	ctx->regex_store.r_hexlit     = rnew("0x[0-9a-fA-F]+");
-	ctx->regex_store.r_dbllit     = rnew("[0-9]+\\.[0-9]+");
-	ctx->regex_store.r_declit     = rnew("[0-9]+");
-	ctx->regex_store.r_id         = rnew("[a-zA-Z_][a-zA-Z0-9_]*");
-	ctx->regex_store.r_lor        = rnew("\\|\\|");
-	ctx->regex_store.r_land       = rnew("&&");
-	ctx->regex_store.r_gteq       = rnew(">=");
-	ctx->regex_store.r_lteq       = rnew("<=");
-	ctx->regex_store.r_deq        = rnew("==");
-	ctx->regex_store.r_comma_seq  = rnew("[,]+");
-	ctx->regex_store.r_period_seq = rnew("[.]+");
-	ctx->regex_store.r_semi_seq   = rnew("[;]+");
+	ctx->regex_store.r_string_lit = rnew("^\\\"([^\\\"]|\n)*\\\"");
+	ctx->regex_store.r_char_lit   = rnew("^'(.)'");
+	ctx->regex_store.r_fn         = rnew("^fn");
+	ctx->regex_store.r_if         = rnew("^if");
+	ctx->regex_store.r_else       = rnew("^else");
+	ctx->regex_store.r_while      = rnew("^while");
+	ctx->regex_store.r_switch     = rnew("^switch");
+	ctx->regex_store.r_break      = rnew("^break");
+	ctx->regex_store.r_default    = rnew("^default");
+	ctx->regex_store.r_hexlit     = rnew("^0x[0-9a-fA-F]+");
+	ctx->regex_store.r_dbllit     = rnew("^[0-9]+\\.[0-9]+");
+	ctx->regex_store.r_declit     = rnew("^[0-9]+");
+	ctx->regex_store.r_id         = rnew("^[a-zA-Z_][a-zA-Z0-9_]*");
+	ctx->regex_store.r_lor        = rnew("^\\|\\|");
+	ctx->regex_store.r_land       = rnew("^&&");
+	ctx->regex_store.r_gteq       = rnew("^>=");
+	ctx->regex_store.r_lteq       = rnew("^<=");
+	ctx->regex_store.r_deq        = rnew("^==");
+	ctx->regex_store.r_comma_seq  = rnew("^[,]+");
+	ctx->regex_store.r_period_seq = rnew("^[.]+");
+	ctx->regex_store.r_semi_seq   = rnew("^[;]+");
 }
 
 void tctx_internal_free_regex(tokenizer_ctx* ctx) {
@@ -130,6 +137,7 @@ void tctx_internal_free_regex(tokenizer_ctx* ctx) {
 	regfree(&ctx->regex_store.r_fn);
 	regfree(&ctx->regex_store.r_if);
 	regfree(&ctx->regex_store.r_else);
+	regfree(&ctx->regex_store.r_while);
 	regfree(&ctx->regex_store.r_switch);
 	regfree(&ctx->regex_store.r_break);
 	regfree(&ctx->regex_store.r_default);
@@ -141,6 +149,7 @@ void tctx_internal_free_regex(tokenizer_ctx* ctx) {
 	regfree(&ctx->regex_store.r_land);
 	regfree(&ctx->regex_store.r_gteq);
 	regfree(&ctx->regex_store.r_lteq);
+	regfree(&ctx->regex_store.r_deq);
 	regfree(&ctx->regex_store.r_comma_seq);
 	regfree(&ctx->regex_store.r_period_seq);
 	regfree(&ctx->regex_store.r_semi_seq);
@@ -160,6 +169,7 @@ tokenizer_ctx tctx_from_cstr(const char* cstr) {
 	ctx.content = strdup(cstr);
 	ctx.content_length = strlen(cstr);
 	ctx.state.cursor = ctx.content;
+	tctx_internal_init_regex(&ctx);
 	return ctx;
 }
 
@@ -171,7 +181,7 @@ void tctx_free(tokenizer_ctx* ctx) {
 #define RMATCH(str, t) \
 	do {\
 		int length;\
-		if (rmatch(ctx->state.cursor, str, &length) != -1) {\
+		if (rmatch(ctx->state.cursor, ctx->content + ctx->content_length, str, &length) != -1) {\
 			const char* was = ctx->state.cursor;\
 			/* ctx->state.cursor += length;*/\
 			return (token) {\
@@ -198,6 +208,16 @@ void tctx_free(tokenizer_ctx* ctx) {
 
 token tctx_advance(tokenizer_ctx* ctx) {
 	token t = tctx_get_next(ctx);
+	// string literals can span lines
+	for (size_t i = 0; i < t.text.count; i++) {
+		if (t.text.data[i] == '\n') {
+			ctx->state.line++;
+			ctx->state.col = 0;
+		}
+		else {
+			ctx->state.col++;
+		}
+	}
 	ctx->state.cursor += t.text.count;
 	return t;
 }
@@ -210,24 +230,26 @@ token tctx_get_next(tokenizer_ctx* ctx) {
 		return (token) {.type=T_EOF };
 
 	tokenizer_state s = ctx->state;
-	// Consume comments
-	if (strncmp(s.cursor, "//", 2) == 0) {
-		const char* begin = s.cursor;
-		while (*s.cursor != '\n') {
+	// Consume spaces and comments, any number of them in any order
+	for (;;) {
+		while (isspace(*s.cursor) != 0) {
+			if (*s.cursor == '\n') {
+				s.line++;
+				s.col = 0;
+			}
+			else {
+				s.col++;
+			}
+			s.cursor++;
+		}
+		if (strncmp(s.cursor, "//", 2) != 0) break;
+		while (*s.cursor != '\n' && *s.cursor != '\0') {
 			s.cursor++;
 		}
-		s.cursor++;
-	}
-	// Consume spaces
-	while (isspace(*s.cursor) != 0) {
-		s.cursor++;
-		s.col++;
-	}
-	if (*s.cursor == '\n') {
-		s.cursor++;
-		s.line++;
 	}
 	ctx->state = s;
+	if (*s.cursor == '\0')
+		return (token) {.type=T_EOF };
 
 	// Match code
 	//   To see the actual regex strings, view tctx_internal_init_regex(..)
@@ -236,6 +258,7 @@ token tctx_get_next(tokenizer_ctx* ctx) {
 	RMATCH(ctx->regex_store.r_fn, T_FN);
 	RMATCH(ctx->regex_store.r_if, T_IF);
 	RMATCH(ctx->regex_store.r_else, T_ELSE);
+	RMATCH(ctx->regex_store.r_while, T_WHILE);
 	RMATCH(ctx->regex_store.r_switch, T_SWITCH);
 	RMATCH(ctx->regex_store.r_break, T_BREAK);
 	RMATCH(ctx->regex_store.r_default, T_DEFAULT);
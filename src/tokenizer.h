@@ -13,7 +13,7 @@ typedef enum token_type {
 
 	// Reserved tokens
 	T_RESERVE_BEG = 100,
-	T_FN, T_IF, T_ELSE,
+	T_FN, T_IF, T_ELSE, T_WHILE,
 	T_SWITCH, T_BREAK, T_DEFAULT,
 	T_SQUOTE, T_DQUOTE,
 	T_LP, T_RP,
@@ -44,13 +44,13 @@ typedef enum token_type {
 
 typedef struct tokenizer_state {
 	char const *cursor;
-	int line, col, index;
+	int line, col, index;  // line and col count from 0
 } tokenizer_state;
 
 typedef struct tokenizer_regex_store {
 	regex_t r_string_lit;
 	regex_t r_char_lit;
-	regex_t r_fn, r_if, r_else, r_switch, r_break, r_default;
+	regex_t r_fn, r_if, r_else, r_while, r_switch, r_break, r_default;
 	regex_t r_hexlit, r_dbllit, r_declit, r_id;
 	regex_t r_lor, r_land, r_gteq, r_lteq, r_deq;
 	regex_t r_comma_seq, r_period_seq, r_semi_seq;
@@ -70,7 +70,7 @@ typedef struct tokenizer_ctx {
 } tokenizer_ctx;
 
 regex_t       rnew(const char*);
-int           rmatch(const char*, regex_t, int*);
+int           rmatch(const char*, const char*, regex_t, int*);
 
 const char*   token_str(token_type);
 
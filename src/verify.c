@@ -0,0 +1,203 @@
+#include "verify.h"
+#include "interpreter_builtins.h"
+#include "sl_log.h"
+#include <limits.h>
+
+// Depths the stack can have at one point, dead once nothing can reach it
+typedef struct {
+	int  lo, hi;
+	bool dead;
+} vfy_range;
+
+// Past this many procedure bodies walked, the rest count as recursive
+#define VFY_MAX_CALLS 100000
+// A loop whose range still moves after this many passes over it moves the stack every time round
+#define VFY_LOOP_PASSES 8
+
+typedef struct {
+	vfy_result res;
+	bool       failed;
+	cvector_vector_type(const ProcedureDef*) active;  // bodies being walked, innermost last
+	int        calls;
+} vfy_ctx;
+
+// A point that needs `need` values then moves the depth by `delta`
+static void vfy_apply(vfy_ctx* ctx, vfy_range* r, int need, int delta, const char* what) {
+	if (r->dead || ctx->failed) return;
+	if (r->hi < need) {
+		ctx->failed = true;
+		ctx->res.what = what;
+		ctx->res.need = need;
+		ctx->res.have = r->hi;
+		return;
+	}
+	// only the paths that had enough get past this point, the others need the runtime check
+	if (r->lo < need) {
+		ctx->res.may_underflow = true;
+		r->lo = need;
+	}
+	r->lo += delta;
+	r->hi += delta;
+	if (r->hi > ctx->res.max_depth) ctx->res.max_depth = r->hi;
+}
+
+static void vfy_stmt_expr(vfy_ctx*, vfy_range*, StatementExpression);
+
+static void vfy_call(vfy_ctx* ctx, vfy_range* r, const ProcedureDef* proc) {
+	if (r->dead || ctx->failed) return;
+	bool recursive = ++ctx->calls > VFY_MAX_CALLS;
+	for (const ProcedureDef** it = cvector_begin(ctx->active); it != cvector_end(ctx->active); it++) {
+		recursive |= *it == proc;
+	}
+	if (recursive) {
+		ctx->res.bounded = false;
+		r->dead = true;
+		return;
+	}
+	cvector_push_back(ctx->active, proc);
+	for (StatementExpression* it = cvector_begin(proc->block.items); it != cvector_end(proc->block.items); it++) {
+		vfy_stmt_expr(ctx, r, *it);
+	}
+	cvector_pop_back(ctx->active);
+}
+
+static void vfy_operator(vfy_ctx* ctx, vfy_range* r, OperatorCode op) {
+	if (op == OPERATOR_CODE_UNDEFINED)
+		r->dead = true;
+	else
+		vfy_apply(ctx, r, 2, -1, ictx_operator_str[op]);
+}
+
+static void vfy_expression(vfy_ctx* ctx, vfy_range* r, Expression* exp) {
+	switch (exp->type) {
+		case EXPRESSION_TYPE_TERM:
+			vfy_apply(ctx, r, 0, 1, "a literal");
+			break;
+		case EXPRESSION_TYPE_STACK_OP: {
+			int n = exp->stackOp.op.op_str.count;
+			switch (exp->stackOp.type) {
+				case STACK_OP_TYPE_PERIOD_SEQ: vfy_apply(ctx, r, n, -n, "'.'"); break;
+				case STACK_OP_TYPE_SEMI_SEQ:   vfy_apply(ctx, r, 1, n, "';'"); break;
+				case STACK_OP_TYPE_COMMA_SEQ:  if (n > 1) vfy_apply(ctx, r, n, 1, "','"); break;
+			}
+			break;
+		}
+		case EXPRESSION_TYPE_PROC_CALL: {
+			if (exp->EProcCall.proc_call.proc) {
+				vfy_call(ctx, r, exp->EProcCall.proc_call.proc);
+				break;
+			}
+			const interp_builtin* b = interp_builtin_resolve(&exp->EProcCall.proc_call);
+			if (!b) {
+				if (!r->dead && !ctx->failed) {
+					ctx->failed = true;
+					ctx->res.unknown = exp->EProcCall.proc_call.name;
+				}
+				r->dead = true;
+				break;
+			}
+			vfy_apply(ctx, r, b->in, b->out - b->in, b->name);
+			if (b->id == INTERP_BUILTIN_EXIT) r->dead = true;
+			break;
+		}
+		case EXPRESSION_TYPE_OPERATOR:
+			vfy_operator(ctx, r, exp->EOp.operation.code);
+			break;
+		case EXPRESSION_TYPE_EEO:
+			vfy_expression(ctx, r, exp->EEO.left);
+			vfy_expression(ctx, r, exp->EEO.right);
+			vfy_operator(ctx, r, exp->EEO.operation.code);
+			break;
+	}
+}
+
+static vfy_range vfy_join(vfy_range a, vfy_range b) {
+	if (a.dead) return b;
+	if (b.dead) return a;
+	return (vfy_range) {.lo = a.lo < b.lo ? a.lo : b.lo, .hi = a.hi > b.hi ? a.hi : b.hi};
+}
+
+static void vfy_iff(vfy_ctx* ctx, vfy_range* r, Iff iff) {
+	vfy_expression(ctx, r, iff.expression);
+	// the condition stays unless it's a nonzero integer, then it's popped and the block runs
+	vfy_apply(ctx, r, 1, 0, "if");
+	vfy_range taken = *r;
+	vfy_apply(ctx, &taken, 1, -1, "if");
+	for (StatementExpression* it = cvector_begin(iff.block.items); it != cvector_end(iff.block.items); it++) {
+		vfy_stmt_expr(ctx, &taken, *it);
+	}
+	*r = vfy_join(*r, taken);
+}
+
+// The value is always popped, after that one case or none runs
+static void vfy_switch(vfy_ctx* ctx, vfy_range* r, Switch* sw) {
+	vfy_expression(ctx, r, sw->expression);
+	vfy_apply(ctx, r, 1, -1, "switch");
+	vfy_range out = {.dead = true};
+	bool has_default = false;
+	for (SwitchCase* c = cvector_begin(sw->block.cases); c != cvector_end(sw->block.cases); c++) {
+		vfy_range taken = *r;
+		for (StatementExpression* it = cvector_begin(c->b.items); it != cvector_end(c->b.items); it++) {
+			vfy_stmt_expr(ctx, &taken, *it);
+		}
+		out = vfy_join(out, taken);
+		has_default |= c->is_default;
+	}
+	if (!has_default) out = vfy_join(out, *r);
+	*r = out;
+}
+
+// The range at the head has to cover every number of iterations, so the body is walked until
+// joining what it leaves back into the head doesn't change it anymore
+static void vfy_while(vfy_ctx* ctx, vfy_range* r, While* w) {
+	vfy_range head = *r, out = *r;
+	for (int pass = 0; pass < VFY_LOOP_PASSES && !ctx->failed; pass++) {
+		// the condition stays when the loop ends, like an if's
+		out = head;
+		vfy_expression(ctx, &out, w->expression);
+		vfy_apply(ctx, &out, 1, 0, "while");
+		vfy_range body = out;
+		vfy_apply(ctx, &body, 1, -1, "while");
+		for (StatementExpression* it = cvector_begin(w->block.items); it != cvector_end(w->block.items); it++) {
+			vfy_stmt_expr(ctx, &body, *it);
+		}
+		vfy_range next = vfy_join(head, body);
+		if (next.lo == head.lo && next.hi == head.hi && next.dead == head.dead) {
+			*r = out;
+			return;
+		}
+		head = next;
+	}
+	// it grows without bound, anything after it can have any depth
+	ctx->res.bounded = false;
+	if (!out.dead) out.hi = INT_MAX / 2;
+	*r = out;
+}
+
+static void vfy_stmt_expr(vfy_ctx* ctx, vfy_range* r, StatementExpression se) {
+	switch (se.type) {
+		case STATEMENT_EXPR_TYPE_EXPRESSION:
+			vfy_expression(ctx, r, se.expr);
+			break;
+		case STATEMENT_EXPR_TYPE_STATEMENT:
+			if (se.stmt->type == STATEMENT_TYPE_IFF) vfy_iff(ctx, r, se.stmt->iff);
+			if (se.stmt->type == STATEMENT_TYPE_WHILE) vfy_while(ctx, r, &se.stmt->whilee);
+			if (se.stmt->type == STATEMENT_TYPE_SWITCH) vfy_switch(ctx, r, &se.stmt->switchh);
+			break;
+	}
+}
+
+vfy_result vfy_program(Program p) {
+	vfy_ctx ctx = {.res.bounded = true};
+	vfy_range r = {0};
+	// same as ictx_run_node, anything else left on the parse stack never runs
+	for (AST_Node* n = cvector_begin(p.p); n != cvector_end(p.p) && !ctx.failed && !r.dead; n++) {
+		if (n->nodeType != AST_NODE_TYPE_STATEMENT_EXPRESSION) continue;
+		vfy_stmt_expr(&ctx, &r, n->stmtExpr);
+	}
+	ctx.res.ok = !ctx.failed;
+	cvector_free(ctx.active);
+	sl_debug(SL_CAT_INTERP, "verify: %s, max depth %d%s%s", ctx.res.ok ? "ok" : "underflow", ctx.res.max_depth,
+	         ctx.res.bounded ? "" : " (unbounded)", ctx.res.may_underflow ? " (may underflow)" : "");
+	return ctx.res;
+}
@@ -0,0 +1,41 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+#include "ast.h"
+#include <stdbool.h>
+
+/**
+ *  Stack effect verifier
+ *    Walks the program once, tracking the range of depths the stack can have at every
+ *    point: each literal, stack op, operator and call has a fixed effect (calls take theirs
+ *    from the builtin registry), and after an if the range covers both the taken and the
+ *    skipped path. A while is walked until the range at its head covers any number of
+ *    iterations; one whose body keeps growing the stack leaves the depth unbounded. After a
+ *    switch the range covers every case, and no case at all when there's no default.
+ *    + a point that needs more values than the range could ever hold underflows on every
+ *      path that reaches it, so the program is rejected before it runs
+ *    + a point that needs more values than the bottom of the range underflows on some paths
+ *      only, the program runs but keeps its runtime checks
+ *    + the top of the range over the whole program is the deepest the stack can get
+ *    Anything that stops the program (exit, an unknown operator) ends the path, nothing
+ *    after it is checked.
+ *    + a call that reaches a name that's neither a builtin nor a procedure is rejected too,
+ *      linking only warns about it since code nothing reaches may name anything
+ *    A call to a procedure of the program is checked through its body, where it's called.
+ *    A recursive call can't be followed: the path ends there and the depth isn't bounded,
+ *    so the program runs with the stack checks it has without verification.
+ */
+typedef struct {
+	bool        ok;
+	bool        bounded;    // max_depth holds on every path, false once recursion or a growing loop got in the way
+	bool        may_underflow;  // some path reaches a point without the values it needs
+	int         max_depth;
+	// when !ok: what underflowed, how many values it needed and the most there could be
+	const char* what;
+	int         need, have;
+	// or when !ok and it isn't empty, the name a call reaches that nothing has
+	String_View unknown;
+} vfy_result;
+
+vfy_result vfy_program(Program);
+
+#endif
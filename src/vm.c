@@ -0,0 +1,192 @@
+#include "vm.h"
+#include "interpreter_builtins.h"
+#include "sl_assert.h"
+#include "switch.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline int32_t vm_arg(const uint8_t* pc) {
+	int32_t arg;
+	memcpy(&arg, pc, sizeof(arg));
+	return arg;
+}
+
+// Integer operands are by far the common case, anything else goes through ictx_apply_binary
+#define VM_INT_BINARY(expr) \
+	do {\
+		stack_node* l = &ictx->stack[ictx->stack_top - 1];\
+		stack_node* r = &ictx->stack[ictx->stack_top];\
+		if (sn_is_int(*l) && sn_is_int(*r)) {\
+			int a = sn_int(*l), b = sn_int(*r);\
+			*l = sn_from_int(expr);\
+			ictx->stack_top--;\
+		}\
+		else {\
+			ictx_apply_binary(ictx, bc_binary_operator(op));\
+		}\
+	} while (0)
+
+// Typed opcodes, the compiler already knows what the operands are
+#define VM_TYPED_BINARY(get, make, expr) \
+	do {\
+		stack_node* l = &ictx->stack[ictx->stack_top - 1];\
+		stack_node* r = &ictx->stack[ictx->stack_top];\
+		*l = make(get(*l) expr get(*r));\
+		ictx->stack_top--;\
+	} while (0)
+#define VM_INT(expr)     VM_TYPED_BINARY(sn_int, sn_from_int, expr)
+#define VM_DOUBLE(expr)  VM_TYPED_BINARY(sn_double, sn_from_double, expr)
+#define VM_DOUBLE_CMP(expr) VM_TYPED_BINARY(sn_double, sn_from_int, expr)
+
+void vm_run(interpreter_ctx* ictx, bytecode* bc) {
+	const uint8_t* code = bc->code;
+	const uint8_t* pc = code;
+	const uint8_t* end = code + cvector_size(bc->code);
+	// return addresses, only allocated once something calls a procedure
+	const uint8_t** returns = NULL;
+	int             depth = 0;
+	ictx_enter(ictx);
+
+	while (pc < end) {
+		bc_op op = *pc++;
+		switch (op) {
+			case BC_PUSH_INT:
+				ictx->stack[++ictx->stack_top] = sn_from_int(vm_arg(pc));
+				pc += 4;
+				break;
+			case BC_PUSH_DOUBLE:
+				ictx->stack[++ictx->stack_top] = sn_from_double(bc->doubles[vm_arg(pc)]);
+				pc += 4;
+				break;
+			case BC_PUSH_STRING:
+				ictx->stack[++ictx->stack_top] = ictx_string_from_pool(bc->strings[vm_arg(pc)]);
+				pc += 4;
+				break;
+			case BC_PUSH_CHAR:
+				ictx->stack[++ictx->stack_top] = sn_from_char(vm_arg(pc));
+				pc += 4;
+				break;
+
+			case BC_ADD:  VM_INT_BINARY(a + b);  break;
+			case BC_SUB:  VM_INT_BINARY(a - b);  break;
+			case BC_MUL:  VM_INT_BINARY(a * b);  break;
+			case BC_GT:   VM_INT_BINARY(a > b);  break;
+			case BC_LT:   VM_INT_BINARY(a < b);  break;
+			case BC_LAND: VM_INT_BINARY(a && b); break;
+			case BC_LOR:  VM_INT_BINARY(a || b); break;
+			case BC_EQ:   VM_INT_BINARY(a == b); break;
+			case BC_DIV:
+			case BC_MOD:
+				ictx_apply_binary(ictx, bc_binary_operator(op));
+				break;
+
+			case BC_ADD_I:  VM_INT(+);  break;
+			case BC_SUB_I:  VM_INT(-);  break;
+			case BC_MUL_I:  VM_INT(*);  break;
+			case BC_DIV_I:  VM_INT(/);  break;
+			case BC_MOD_I:  VM_INT(%);  break;
+			case BC_GT_I:   VM_INT(>);  break;
+			case BC_LT_I:   VM_INT(<);  break;
+			case BC_LAND_I: VM_INT(&&); break;
+			case BC_LOR_I:  VM_INT(||); break;
+			case BC_EQ_I:   VM_INT(==); break;
+			case BC_ADD_D:  VM_DOUBLE(+); break;
+			case BC_SUB_D:  VM_DOUBLE(-); break;
+			case BC_MUL_D:  VM_DOUBLE(*); break;
+			case BC_DIV_D:  VM_DOUBLE(/); break;
+			case BC_GT_D:   VM_DOUBLE_CMP(>);  break;
+			case BC_LT_D:   VM_DOUBLE_CMP(<);  break;
+			case BC_EQ_D:   VM_DOUBLE_CMP(==); break;
+
+			case BC_BAD_OPERATOR: {
+				String_View name = bc->names[vm_arg(pc)];
+				sl_assert(0, "Undefined operation \"" SV_Fmt "\"\n", SV_Arg(name));
+				break;
+			}
+
+			case BC_POP:
+				ictx->stack_top -= vm_arg(pc);
+				if (ictx->stack_top < -1) ictx_pop_underflow();
+				pc += 4;
+				break;
+			case BC_DUP: {
+				stack_node top = ictx->stack[ictx->stack_top];
+				for (int32_t n = vm_arg(pc); n > 0; n--) {
+					ictx->stack[++ictx->stack_top] = top;
+				}
+				pc += 4;
+				break;
+			}
+			case BC_PEEK: {
+				int32_t depth = vm_arg(pc);
+				if (ictx->stack_top < depth) ictx_pop_underflow();
+				stack_node n = ictx->stack[ictx->stack_top - depth];
+				ictx->stack[++ictx->stack_top] = n;
+				pc += 4;
+				break;
+			}
+
+			case BC_CALL:
+				interp_builtin_call(ictx, vm_arg(pc));
+				pc += 4;
+				break;
+			case BC_CALL_POP:
+				interp_builtin_call(ictx, vm_arg(pc));
+				ictx->stack_top--;
+				pc += 4;
+				break;
+			case BC_BAD_CALL: {
+				String_View name = bc->names[vm_arg(pc)];
+				sl_assert(0, "Proc call for '" SV_Fmt "' not implemented", SV_Arg(name));
+				break;
+			}
+
+			case BC_BRANCH_FALSE: {
+				stack_node* top = &ictx->stack[ictx->stack_top];
+				if (sn_is_int(*top) && sn_int(*top) != 0) {
+					ictx->stack_top--;
+					pc += 4;
+				}
+				else {
+					pc = code + vm_arg(pc);
+				}
+				break;
+			}
+
+			case BC_CALL_PROC:
+				if (!returns) {
+					returns = malloc(ICTX_CALL_DEPTH_MAX * sizeof(*returns));
+					sl_assert(returns, "Out of memory for the return stack\n");
+				}
+				if (depth == ICTX_CALL_DEPTH_MAX) ictx_call_overflow();
+				returns[depth++] = pc + 4;
+				pc = code + vm_arg(pc);
+				break;
+			case BC_JUMP:
+				pc = code + vm_arg(pc);
+				break;
+			case BC_RET:
+				pc = returns[--depth];
+				break;
+			case BC_HALT:
+				pc = end;
+				break;
+			case BC_LOOP: {
+				bc_loop* loop = &bc->loops[vm_arg(pc)];
+				loop->def->iterations++;
+				pc = code + loop->head;
+				break;
+			}
+			case BC_SWITCH: {
+				const bc_switch* sw = &bc->switches[vm_arg(pc)];
+				int c = sw_lookup(sw->def->table, ictx->stack[ictx->stack_top--]);
+				pc = code + (c < 0 ? sw->exit : sw->targets[c]);
+				break;
+			}
+			case BC_GOTO:
+				pc = code + vm_arg(pc);
+				break;
+		}
+	}
+	free(returns);
+}
@@ -0,0 +1,9 @@
+#ifndef VM_H
+#define VM_H
+#include "compiler.h"
+#include "interpreter.h"
+
+// Runs bytecode on the interpreter's data stack, so it can pick up where earlier code left off
+void vm_run(interpreter_ctx*, bytecode*);
+
+#endif
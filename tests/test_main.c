@@ -1,16 +1,87 @@
 #include "munit/munit.h"
+#include "../src/ast_free.h"
+#include "../src/convert.h"
 #include "../src/interpreter.h"
 #include "../src/parser.h"
+#include "../src/reparse.h"
+#include "../src/closure.h"
+#include "../src/compiler.h"
+#include "../src/vm.h"
+#include "../src/optimize.h"
+#include "../src/jit.h"
+#include "../src/verify.h"
+#include "../src/emit_c.h"
+#include "../src/profile.h"
+#include "../src/switch.h"
+#include "../src/rope.h"
+#include "../src/output.h"
+#include "../src/input.h"
+#include "../src/array.h"
+#include "../src/sl_log.h"
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 MunitResult decimal_sv_to_int     (const MunitParameter params[], void* fixture);
 MunitResult hex_sv_to_int         (const MunitParameter params[], void* fixture);
 MunitResult double_sv_to_double   (const MunitParameter params[], void* fixture);
+MunitResult reparse_matches_full  (const MunitParameter params[], void* fixture);
+MunitResult reparse_reuses_nodes  (const MunitParameter params[], void* fixture);
+MunitResult engines_agree         (const MunitParameter params[], void* fixture);
+MunitResult binary_dispatch       (const MunitParameter params[], void* fixture);
+MunitResult host_natives          (const MunitParameter params[], void* fixture);
+MunitResult value_boxing          (const MunitParameter params[], void* fixture);
+MunitResult string_pool           (const MunitParameter params[], void* fixture);
+MunitResult stack_guards          (const MunitParameter params[], void* fixture);
+MunitResult constant_folding      (const MunitParameter params[], void* fixture);
+MunitResult stack_op_runs         (const MunitParameter params[], void* fixture);
+MunitResult stack_effects         (const MunitParameter params[], void* fixture);
+MunitResult typed_opcodes         (const MunitParameter params[], void* fixture);
+MunitResult jit_differential      (const MunitParameter params[], void* fixture);
+MunitResult emit_c                (const MunitParameter params[], void* fixture);
+MunitResult streaming             (const MunitParameter params[], void* fixture);
+MunitResult procedures            (const MunitParameter params[], void* fixture);
+MunitResult loops                 (const MunitParameter params[], void* fixture);
+MunitResult switch_dispatch       (const MunitParameter params[], void* fixture);
+MunitResult string_concat         (const MunitParameter params[], void* fixture);
+MunitResult buffered_output       (const MunitParameter params[], void* fixture);
+MunitResult buffered_input        (const MunitParameter params[], void* fixture);
+MunitResult typed_arrays          (const MunitParameter params[], void* fixture);
+MunitResult logging               (const MunitParameter params[], void* fixture);
 
 MunitTest tests[] = {
 	{"/decimal_sv_to_int",   		decimal_sv_to_int, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 	{"/hex_sv_to_int",       		hex_sv_to_int, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 	{"/double_sv_to_double", 		double_sv_to_double, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/reparse_matches_full",		reparse_matches_full, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/reparse_reuses_nodes",		reparse_reuses_nodes, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/engines_agree",       		engines_agree, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/binary_dispatch",     		binary_dispatch, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/host_natives",        		host_natives, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/value_boxing",        		value_boxing, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/string_pool",         		string_pool, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/stack_guards",        		stack_guards, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/constant_folding",    		constant_folding, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/stack_op_runs",       		stack_op_runs, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/stack_effects",       		stack_effects, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/typed_opcodes",       		typed_opcodes, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/jit_differential",    		jit_differential, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/emit_c",              		emit_c, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/streaming",           		streaming, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/procedures",          		procedures, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/loops",               		loops, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/switch_dispatch",     		switch_dispatch, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/string_concat",       		string_concat, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/buffered_output",     		buffered_output, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/buffered_input",      		buffered_input, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/typed_arrays",        		typed_arrays, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{"/logging",             		logging, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+	{NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 };
 
 static const MunitSuite suite = {
@@ -22,47 +93,1484 @@ int main(int argc, char *const *argv) {
 }
 
 MunitResult decimal_sv_to_int  (const MunitParameter params[], void* fixture) {
-	int v = interpret_decimal_sv_to_int(SV("453"));
+	int v = convert_decimal_sv_to_int(SV("453"));
 	munit_assert_int(v, ==, 453);
-	v = interpret_decimal_sv_to_int(SV("293"));
+	v = convert_decimal_sv_to_int(SV("293"));
 	munit_assert_int(v, ==, 293);
-	v = interpret_decimal_sv_to_int(SV("12345324"));
+	v = convert_decimal_sv_to_int(SV("12345324"));
 	munit_assert_int(v, ==, 12345324);
-	v = interpret_decimal_sv_to_int(SV("9725"));
+	v = convert_decimal_sv_to_int(SV("9725"));
 	munit_assert_int(v, ==, 9725);
-	v = interpret_decimal_sv_to_int(SV("624517357"));
+	v = convert_decimal_sv_to_int(SV("624517357"));
 	munit_assert_int(v, ==, 624517357);
-	v = interpret_decimal_sv_to_int(SV("8637645"));
+	v = convert_decimal_sv_to_int(SV("8637645"));
 	munit_assert_int(v, ==, 8637645);
 	return MUNIT_OK;
 }
 
 MunitResult hex_sv_to_int  (const MunitParameter params[], void* fixture) {
-	int v = interpret_hex_sv_to_int(SV("0x3a"));
+	int v = convert_hex_sv_to_int(SV("0x3a"));
 	munit_assert_int(v, ==, 0x3a);
-	v = interpret_hex_sv_to_int(SV("0x20"));
+	v = convert_hex_sv_to_int(SV("0x20"));
 	munit_assert_int(v, ==, 0x20);
-	v = interpret_hex_sv_to_int(SV("0x2ac8"));
+	v = convert_hex_sv_to_int(SV("0x2ac8"));
 	munit_assert_int(v, ==, 0x2ac8);
-	v = interpret_hex_sv_to_int(SV("0x9c2ac8"));
+	v = convert_hex_sv_to_int(SV("0x9c2ac8"));
 	munit_assert_int(v, ==, 0x9c2ac8);
-	v = interpret_hex_sv_to_int(SV("0x5c35aa"));
+	v = convert_hex_sv_to_int(SV("0x5c35aa"));
 	munit_assert_int(v, ==, 0x5c35aa);
-	v = interpret_hex_sv_to_int(SV("0x9c2ac8"));
+	v = convert_hex_sv_to_int(SV("0x9c2ac8"));
 	munit_assert_int(v, ==, 0x9c2ac8);
-	v = interpret_hex_sv_to_int(SV("0x31942ff8"));
+	v = convert_hex_sv_to_int(SV("0x31942ff8"));
 	munit_assert_int(v, ==, 0x31942ff8);
 	return MUNIT_OK;
 }
 
 MunitResult double_sv_to_double(const MunitParameter params[], void* fixture) {
-	double d = interpret_double_sv_to_double(SV("5.646247363"));
+	double d = convert_double_sv_to_double(SV("5.646247363"));
 	munit_assert_double(d, ==, 5.646247363);
-	d = interpret_double_sv_to_double(SV("5423.864213"));
+	d = convert_double_sv_to_double(SV("5423.864213"));
 	munit_assert_double(d, ==, 5423.864213);
-	d = interpret_double_sv_to_double(SV("46843134.9753947"));
+	d = convert_double_sv_to_double(SV("46843134.9753947"));
 	munit_assert_double(d, ==, 46843134.9753947);
-	d = interpret_double_sv_to_double(SV("4684134.9753947"));
+	d = convert_double_sv_to_double(SV("4684134.9753947"));
 	munit_assert_double(d, ==, 4684134.9753947);
 	return MUNIT_OK;
 }
+
+static bool expr_eq(Expression*, Expression*);
+static bool block_eq(Block, Block);
+
+static bool stmt_expr_eq(StatementExpression a, StatementExpression b) {
+	if (a.type != b.type) return false;
+	if (a.type == STATEMENT_EXPR_TYPE_EXPRESSION) return expr_eq(a.expr, b.expr);
+	return a.stmt->type == b.stmt->type &&
+		expr_eq(a.stmt->iff.expression, b.stmt->iff.expression) &&
+		block_eq(a.stmt->iff.block, b.stmt->iff.block);
+}
+
+static bool block_eq(Block a, Block b) {
+	if (cvector_size(a.items) != cvector_size(b.items)) return false;
+	for (size_t i = 0; i < cvector_size(a.items); i++) {
+		if (!stmt_expr_eq(a.items[i], b.items[i])) return false;
+	}
+	return true;
+}
+
+static bool expr_eq(Expression* a, Expression* b) {
+	if (a->type != b->type) return false;
+	switch (a->type) {
+		case EXPRESSION_TYPE_PROC_CALL: return sv_eq(a->EProcCall.proc_call.name, b->EProcCall.proc_call.name);
+		case EXPRESSION_TYPE_STACK_OP:  return sv_eq(a->stackOp.op.op_str, b->stackOp.op.op_str);
+		case EXPRESSION_TYPE_OPERATOR:  return sv_eq(a->EOp.operation.op_str, b->EOp.operation.op_str);
+		case EXPRESSION_TYPE_EEO:
+			return sv_eq(a->EEO.operation.op_str, b->EEO.operation.op_str) &&
+				expr_eq(a->EEO.left, b->EEO.left) && expr_eq(a->EEO.right, b->EEO.right);
+		case EXPRESSION_TYPE_TERM:
+			if (a->ETerm.term.type != b->ETerm.term.type) return false;
+			switch (a->ETerm.term.type) {
+				case TERM_TYPE_DOUBLE_LIT: return a->ETerm.term._double == b->ETerm.term._double;
+				case TERM_TYPE_STRING_LIT: return a->ETerm.term._string == b->ETerm.term._string;
+				case TERM_TYPE_CHR_LIT:    return sv_eq(a->ETerm.term._chr, b->ETerm.term._chr);
+				default:                   return a->ETerm.term._integer == b->ETerm.term._integer;
+			}
+	}
+	return false;
+}
+
+static bool node_eq(AST_Node a, AST_Node b) {
+	if (a.nodeType != b.nodeType) return false;
+	switch (a.nodeType) {
+		case AST_NODE_TYPE_STATEMENT_EXPRESSION: return stmt_expr_eq(a.stmtExpr, b.stmtExpr);
+		case AST_NODE_TYPE_BLOCK:                return block_eq(a.block, b.block);
+		case AST_NODE_TYPE_RESERVED:             return a.reserved.token.type == b.reserved.token.type;
+		case AST_NODE_TYPE_TERMINAL:             return a.terminal.type == b.terminal.type;
+		default:                                 return true;
+	}
+}
+
+// Parses the edited tokens from scratch and checks the incremental tree is the same
+static void assert_same_as_full_parse(reparse_ctx* rctx) {
+	size_t length = 0;
+	for (int i = 0; i < rctx_token_count(rctx); i++) length += rctx->tokens[i].text.count + 1;
+	char* text = calloc(length + 1, 1);
+	for (int i = 0, at = 0; i < rctx_token_count(rctx); i++) {
+		memcpy(text + at, rctx->tokens[i].text.data, rctx->tokens[i].text.count);
+		at += rctx->tokens[i].text.count;
+		text[at++] = ' ';
+	}
+	reparse_ctx full = rctx_new(text);
+	munit_assert_int(full.pctx.pstack.length, ==, rctx->pctx.pstack.length);
+	for (int i = 0; i < full.pctx.pstack.length; i++) {
+		munit_assert_true(node_eq(full.pctx.pstack.data[i], rctx->pctx.pstack.data[i]));
+	}
+	rctx_free(&full);
+	free(text);
+}
+
+// A random token of the given type, -1 if there isn't one
+static int random_token(reparse_ctx* rctx, token_type type) {
+	int n = rctx_token_count(rctx);
+	int start = munit_rand_int_range(0, n - 1);
+	for (int i = 0; i < n; i++) {
+		int t = (start + i) % n;
+		if (rctx->tokens[t].type == type) return t;
+	}
+	return -1;
+}
+
+MunitResult reparse_matches_full(const MunitParameter params[], void* fixture) {
+	reparse_ctx rctx = rctx_new(
+		"1 2 + println\n"
+		"if 1 {\n"
+		"  \"a\" println 3 4 * 5 - .\n"
+		"  if 2 3 < { 7 ; 8 , 9 .. }\n"
+		"  1.5 2.5 + println\n"
+		"}\n"
+		"4 5 6 + + println\n"
+		"if 0 { 0x10 . }\n");
+	assert_same_as_full_parse(&rctx);
+
+	// Every edit keeps the program valid, so a full parse never hits a parse error
+	for (int round = 0; round < 200; round++) {
+		int t;
+		switch (munit_rand_int_range(0, 6)) {
+			case 0: // replace an operand
+				if ((t = random_token(&rctx, T_DECIMAL_LIT)) != -1)
+					rctx_edit(&rctx, t, 1, munit_rand_int_range(0, 1) ? "42" : "2 3 +");
+				break;
+			case 1: // extend an expression
+				if ((t = random_token(&rctx, T_DECIMAL_LIT)) != -1)
+					rctx_edit(&rctx, t + 1, 0, "4 *");
+				break;
+			case 2: // add statements to a block
+				if ((t = random_token(&rctx, T_RBRC)) != -1)
+					rctx_edit(&rctx, t, 0, munit_rand_int_range(0, 1) ? "7 println" : "if 1 { 2 . }");
+				break;
+			case 3: // drop a call
+				if ((t = random_token(&rctx, T_ID)) != -1)
+					rctx_edit(&rctx, t, 1, "");
+				break;
+			case 4: // swap an operator
+				if ((t = random_token(&rctx, T_PLUS)) != -1)
+					rctx_edit(&rctx, t, 1, "*");
+				break;
+			case 5: // new statement at the end
+				rctx_edit(&rctx, rctx_token_count(&rctx), 0, "8 9 - println");
+				break;
+			case 6: // an operator with nothing under it, or operands for one that was
+				if ((t = random_token(&rctx, T_LBRC)) != -1)
+					rctx_edit(&rctx, t + 1, 0, munit_rand_int_range(0, 1) ? "+" : "1 2");
+				break;
+		}
+		assert_same_as_full_parse(&rctx);
+	}
+	rctx_free(&rctx);
+	return MUNIT_OK;
+}
+
+MunitResult reparse_reuses_nodes(const MunitParameter params[], void* fixture) {
+	// 1000 statements in a block followed by 1000 at the top level
+	size_t length = 0;
+	char* text = calloc(64 * 1000 + 64, 1);
+	length += sprintf(text + length, "if 1 {\n");
+	for (int i = 0; i < 1000; i++) length += sprintf(text + length, "  %d 2 + println\n", i);
+	length += sprintf(text + length, "}\n");
+	for (int i = 0; i < 1000; i++) length += sprintf(text + length, "%d 3 * println\n", i);
+	reparse_ctx rctx = rctx_new(text);
+
+	// change one operand at the top level, then one inside the block
+	size_t before = rctx.pctx.stats.reductions;
+	munit_assert_int(rctx_edit(&rctx, 4 + 4000 + 1 + 4 * 500, 1, "7"), ==, 0);
+	munit_assert_size(rctx.pctx.stats.reductions - before, <, 10);
+	assert_same_as_full_parse(&rctx);
+
+	before = rctx.pctx.stats.reductions;
+	munit_assert_int(rctx_edit(&rctx, 3 + 4 * 500, 1, "7 8 +"), ==, 0);
+	munit_assert_size(rctx.pctx.stats.reductions - before, <, 20);
+	assert_same_as_full_parse(&rctx);
+
+	munit_assert_int(rctx_edit(&rctx, rctx_token_count(&rctx), 1, ""), ==, -1);
+	rctx_free(&rctx);
+	free(text);
+	return MUNIT_OK;
+}
+
+static void run_with(interpreter_ctx* ictx, Program program, const char* engine) {
+	if (strncmp(engine, "vm", 2) == 0) {
+		bytecode bc = bc_compile_program(program);
+		vm_run(ictx, &bc);
+		bc_free(&bc);
+	}
+	else if (strncmp(engine, "jit", 3) == 0) {
+		bytecode bc = bc_compile_program(program);
+		jit_code jc = jit_compile(&bc);
+		jit_run(ictx, &jc);
+		jit_free(&jc);
+		bc_free(&bc);
+	}
+	else if (strncmp(engine, "closure", 7) == 0) {
+		closure_program cp = cl_compile_program(program);
+		cl_run(ictx, &cp);
+		cl_free(&cp);
+	}
+	else {
+		ictx_run(ictx, program);
+	}
+}
+
+// Runs what the parser says is complete, the way main does with --stream: procedures are
+// linked and kept, everything else runs as soon as it's taken, the rest once the input ends
+static void run_taken(interpreter_ctx* ictx, AST_Node n, const char* engine) {
+	interp_builtin_link_node(n);
+	if (n.nodeType == AST_NODE_TYPE_PROCEDURE_DEF) return;
+	Program p = {0};
+	cvector_push_back(p.p, n);
+	run_with(ictx, p, engine);
+	ob_flush(ictx->out);
+}
+
+// Runs one example in a child process (the builtins can exit) with fixed input,
+// returns the exit status and leaves whatever it printed in out_path.
+// An engine name ending in -O1 runs the optimizer first, one ending in -stream runs
+// each statement as soon as the parser has taken it
+static int run_example(const char* path, const char* engine, const char* in_path, const char* out_path) {
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		if (!freopen(in_path, "r", stdin) || !freopen(out_path, "w", stdout)) _exit(127);
+		freopen("/dev/null", "w", stderr);
+		tokenizer_ctx tctx = tctx_from_file(path);
+		parse_ctx pctx = pctx_new(100);
+		interpreter_ctx ictx = ictx_new();
+		bool stream = strstr(engine, "-stream") != NULL;
+		token tok;
+		AST_Node n;
+		while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+			tctx_advance(&tctx);
+			pctx_consume_token(&pctx, tok);
+			while (stream && pctx_take_complete(&pctx, &n)) run_taken(&ictx, n, engine);
+		}
+		if (stream) {
+			while (pctx_take_bottom(&pctx, &n)) run_taken(&ictx, n, engine);
+			exit(0);
+		}
+		Program program = {0};
+		for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+		interp_builtin_link(program);
+		if (strstr(engine, "-O1")) opt_fold_program(&program);
+		run_with(&ictx, program, engine);
+		exit(0);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	return status;
+}
+
+static char* read_all(const char* path) {
+	FILE* f = fopen(path, "r");
+	munit_assert_not_null(f);
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* buf = calloc(size + 1, 1);
+	munit_assert_size(fread(buf, 1, size, f), ==, size);
+	fclose(f);
+	return buf;
+}
+
+MunitResult logging(const MunitParameter params[], void* fixture) {
+	char path[] = "/tmp/spaz_logXXXXXX";
+	close(mkstemp(path));
+	munit_assert_int(sl_log_set_file(path), ==, 0);
+
+	// a bare level sets every category, category=level one of them, the last one wins
+	munit_assert_int(sl_log_configure("info,parser=trace,interp=error"), ==, 0);
+	sl_trace(SL_CAT_PARSER, "parser trace %d", 1);
+	sl_debug(SL_CAT_PARSER, "parser debug");
+	sl_info(SL_CAT_MAIN, "main info");
+	sl_debug(SL_CAT_MAIN, "main debug");
+	sl_warn(SL_CAT_INTERP, "interp warn");
+	sl_error(SL_CAT_INTERP, "interp error");
+	munit_assert_int(sl_log_levels[SL_CAT_TOKENIZER], ==, SL_LEVEL_INFO);
+	// a spec it can't read is rejected
+	munit_assert_int(sl_log_configure("parser=loud"), ==, -1);
+	munit_assert_int(sl_log_configure("nothing=debug"), ==, -1);
+	munit_assert_int(sl_log_configure("chatty"), ==, -1);
+	sl_log_flush();
+	char* log = read_all(path);
+	munit_assert_not_null(strstr(log, "[trace parser   ]"));
+	munit_assert_not_null(strstr(log, "parser trace 1\n"));
+	munit_assert_not_null(strstr(log, "parser debug\n"));
+	munit_assert_not_null(strstr(log, "main info\n"));
+	munit_assert_null(strstr(log, "main debug"));
+	munit_assert_null(strstr(log, "interp warn"));
+	munit_assert_not_null(strstr(log, "interp error\n"));
+	free(log);
+
+	// more records than the ring holds all arrive, in order
+	munit_assert_int(sl_log_set_file(path), ==, 0);
+	for (int i = 0; i < 1000; i++) sl_info(SL_CAT_MAIN, "record %d", i);
+	sl_log_flush();
+	log = read_all(path);
+	char* at = log;
+	for (int i = 0; i < 1000; i++) {
+		char want[32];
+		snprintf(want, sizeof(want), "record %d\n", i);
+		at = strstr(at, want);
+		munit_assert_not_null(at);
+	}
+	munit_assert_null(strstr(log, "dropped"));
+	free(log);
+
+	// what's still in the ring when a stack error ends the process isn't lost
+	munit_assert_int(sl_log_set_file(path), ==, 0);
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		freopen("/dev/null", "w", stderr);
+		sl_error(SL_CAT_INTERP, "before the underflow");
+		ictx_pop_underflow();
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	munit_assert_int(WEXITSTATUS(status), ==, 90);
+	log = read_all(path);
+	munit_assert_not_null(strstr(log, "before the underflow\n"));
+	free(log);
+
+	sl_log_configure("warn");
+	unlink(path);
+	return MUNIT_OK;
+}
+
+MunitResult engines_agree(const MunitParameter params[], void* fixture) {
+	// every example, run through each engine, optimized or not, has to print the same thing and exit the same way
+	char in_path[] = "/tmp/spaz_inXXXXXX", ast_path[] = "/tmp/spaz_astXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(ast_path));
+	close(mkstemp(out_path));
+	int in_fd = mkstemp(in_path);
+	munit_assert_int(write(in_fd, "5\n3\n*\n", 6), ==, 6);
+	close(in_fd);
+
+	glob_t g;
+	munit_assert_int(glob("ex/*.lang", 0, NULL, &g), ==, 0);
+	for (size_t i = 0; i < g.gl_pathc; i++) {
+		int ast_status = run_example(g.gl_pathv[i], "ast", in_path, ast_path);
+		char* ast_out = read_all(ast_path);
+		for (const char** engine = (const char*[]) {"vm", "closure", "ast-O1", "vm-O1", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+			int status = run_example(g.gl_pathv[i], *engine, in_path, out_path);
+			char* out = read_all(out_path);
+			munit_assert_int(status, ==, ast_status);
+			munit_assert_string_equal(out, ast_out);
+			free(out);
+		}
+		free(ast_out);
+	}
+	globfree(&g);
+	unlink(in_path);
+	unlink(ast_path);
+	unlink(out_path);
+	return MUNIT_OK;
+}
+
+static stack_node apply(OperatorCode op, stack_node l, stack_node r) {
+	interpreter_ctx ictx = ictx_new();
+	ictx.stack[++ictx.stack_top] = l;
+	ictx.stack[++ictx.stack_top] = r;
+	ictx_apply_binary(&ictx, op);
+	munit_assert_int(ictx.stack_top, ==, 0);
+	stack_node res = ictx.stack[0];
+	ictx_free(&ictx);
+	return res;
+}
+
+MunitResult binary_dispatch(const MunitParameter params[], void* fixture) {
+	// operators are resolved by the parser
+	AST_Node n;
+	munit_assert_int(pctx_convert_token((token) {.type = T_PLUS, .text = SV("+")}, &n), ==, 1);
+	munit_assert_int(n.op.code, ==, OPERATOR_CODE_ADD);
+	munit_assert_int(pctx_convert_token((token) {.type = T_DEQ, .text = SV("==")}, &n), ==, 1);
+	munit_assert_int(n.op.code, ==, OPERATOR_CODE_EQ);
+	munit_assert_int(pctx_convert_token((token) {.type = T_GTEQ, .text = SV(">=")}, &n), ==, 1);
+	munit_assert_int(n.op.code, ==, OPERATOR_CODE_UNDEFINED);
+
+	stack_node i = sn_from_int(3);
+	stack_node d = sn_from_double(1.5);
+	stack_node res = apply(OPERATOR_CODE_ADD, d, d);
+	munit_assert_int(sn_type(res), ==, DOUBLE);
+	munit_assert_double(sn_double(res), ==, 3.0);
+	res = apply(OPERATOR_CODE_SUB, i, d);
+	munit_assert_int(sn_type(res), ==, DOUBLE);
+	munit_assert_double(sn_double(res), ==, 1.5);
+	res = apply(OPERATOR_CODE_GT, i, d);
+	munit_assert_int(sn_type(res), ==, INTEGER);
+	munit_assert_int(sn_int(res), ==, 1);
+	res = apply(OPERATOR_CODE_MOD, i, sn_from_int(2));
+	munit_assert_int(sn_int(res), ==, 1);
+	res = apply(OPERATOR_CODE_EQ, ictx_string_from_sv(SV("ab")), ictx_string_from_sv(SV("ab")));
+	munit_assert_int(sn_int(res), ==, 1);
+	return MUNIT_OK;
+}
+
+static void native_square(interpreter_ctx* ictx) {
+	int n = sn_int(ictx->stack[ictx->stack_top]);
+	ictx->stack[ictx->stack_top] = sn_from_int(n * n);
+}
+
+MunitResult host_natives(const MunitParameter params[], void* fixture) {
+	interp_builtin_id id = interp_builtin_register("square", native_square, 1, 1);
+	munit_assert_int(id, >=, INTERP_BUILTIN_COUNT);
+	munit_assert_int(interp_builtin_register("square", native_square, 1, 1), ==, id);
+
+	tokenizer_ctx tctx = tctx_from_cstr("7 square 2 +");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	// '7' then 'square 2 +'
+	munit_assert_int(pctx.pstack.top, ==, 1);
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	interp_builtin_link(program);
+	ProcedureCall call = program.p[1].stmtExpr.expr->EEO.left->EProcCall.proc_call;
+	munit_assert_ptr_equal(call.builtin, interp_builtin_get(id));
+
+	// every engine calls straight into it
+	for (int engine = 0; engine < 3; engine++) {
+		interpreter_ctx ictx = ictx_new();
+		if (engine == 0) {
+			ictx_run(&ictx, program);
+		}
+		else if (engine == 1) {
+			bytecode bc = bc_compile_program(program);
+			vm_run(&ictx, &bc);
+			bc_free(&bc);
+		}
+		else {
+			closure_program cp = cl_compile_program(program);
+			cl_run(&ictx, &cp);
+			cl_free(&cp);
+		}
+		munit_assert_int(ictx.stack_top, ==, 0);
+		munit_assert_int(sn_int(ictx.stack[0]), ==, 51);
+		ictx_free(&ictx);
+	}
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	return MUNIT_OK;
+}
+
+MunitResult value_boxing(const MunitParameter params[], void* fixture) {
+	munit_assert_size(sizeof(stack_node), ==, 8);
+
+	int ints[] = {0, 1, -1, 2147483647, -2147483647 - 1};
+	for (size_t k = 0; k < sizeof(ints) / sizeof(ints[0]); k++) {
+		munit_assert_int(sn_type(sn_from_int(ints[k])), ==, INTEGER);
+		munit_assert_true(sn_is_int(sn_from_int(ints[k])));
+		munit_assert_int(sn_int(sn_from_int(ints[k])), ==, ints[k]);
+	}
+	double doubles[] = {0.0, -0.0, 1.5, -1e300, 1.0 / 0.0, -1.0 / 0.0};
+	for (size_t k = 0; k < sizeof(doubles) / sizeof(doubles[0]); k++) {
+		munit_assert_int(sn_type(sn_from_double(doubles[k])), ==, DOUBLE);
+		munit_assert_false(sn_is_int(sn_from_double(doubles[k])));
+		munit_assert_double(sn_double(sn_from_double(doubles[k])), ==, doubles[k]);
+	}
+	// any NaN, including the negative one 0.0/0.0 gives on x86, stays a double
+	volatile double zero = 0.0;
+	stack_node nan = sn_from_double(zero / zero);
+	munit_assert_int(sn_type(nan), ==, DOUBLE);
+	munit_assert_true(sn_double(nan) != sn_double(nan));
+	nan = sn_from_double(-(zero / zero));
+	munit_assert_int(sn_type(nan), ==, DOUBLE);
+
+	munit_assert_int(sn_type(ictx_char_from_sv(SV("'x'"))), ==, CHAR);
+	munit_assert_char(sn_char(ictx_char_from_sv(SV("'x'"))), ==, 'x');
+	munit_assert_int(sn_type(SN_UNDEFINED), ==, UNDEFINED);
+
+	stack_node s = ictx_string_from_sv(SV("hello"));
+	munit_assert_int(sn_type(s), ==, STRING);
+	munit_assert_true(sv_eq(sn_string(&s), SV("hello")));
+	munit_assert_true(ictx_string_eq(s, ictx_string_from_sv(SV("hello"))));
+	munit_assert_false(ictx_string_eq(s, ictx_string_from_sv(SV("hellO"))));
+
+	// up to 5 bytes go inline without touching the pool, longer ones share an entry
+	munit_assert_true(s.bits & SN_STRING_INLINE);
+	stack_node empty = ictx_string_from_sv(SV(""));
+	munit_assert_int(sn_string(&empty).count, ==, 0);
+	munit_assert_false(ictx_string_eq(empty, ictx_string_from_sv(sv_from_parts("\0", 1))));
+	char buf[] = "hello world";
+	stack_node l = ictx_string_from_sv(sv_from_cstr(buf));
+	munit_assert_false(l.bits & SN_STRING_INLINE);
+	buf[0] = 'j';
+	munit_assert_true(sv_eq(sn_string(&l), SV("hello world")));
+	munit_assert_true(ictx_string_eq(l, ictx_string_from_pool(strpool_intern(SV("hello world")))));
+	// the same string from a literal's entry is stored the same way
+	munit_assert_true(ictx_string_eq(s, ictx_string_from_pool(strpool_intern(SV("hello")))));
+
+	// made at run time, a long string is a heap string that equals the literal by its bytes,
+	// and is freed once the stack doesn't hold it
+	stack_node h = ictx_string_new(SV("hello world"));
+	munit_assert_true(sn_is_heapstr(h));
+	munit_assert_true(ictx_string_eq(h, l));
+	munit_assert_true(ictx_string_eq(h, ictx_string_new(SV("hello world"))));
+	munit_assert_false(ictx_string_eq(h, ictx_string_new(SV("hello worlD"))));
+	stack_node literal;
+	munit_assert_true(ictx_string_literal(h, &literal));
+	munit_assert_true(literal.bits == l.bits);
+	munit_assert_false(ictx_string_literal(ictx_string_new(SV("not a literal")), &literal));
+	// five bytes go inline, six are a heap string, made or viewed, and len agrees either way
+	const char six[] = "abcdef";
+	for (size_t n = 0; n <= sizeof(six) - 1; n++) {
+		uint32_t unused = 0;
+		stack_node made = ictx_string_new(sv_from_parts(six, n));
+		stack_node viewed = ictx_string_view(sv_from_parts(six, n), &unused);
+		munit_assert_int(sn_is_heapstr(made), ==, n > SN_STRING_INLINE_MAX);
+		munit_assert_int(sn_is_heapstr(viewed), ==, n > SN_STRING_INLINE_MAX);
+		munit_assert_int(!!(made.bits & SN_STRING_INLINE), ==, n <= SN_STRING_INLINE_MAX);
+		munit_assert_true(sv_eq(sn_string(&made), sv_from_parts(six, n)));
+		munit_assert_true(ictx_string_eq(made, viewed));
+		munit_assert_true(ictx_string_eq(made, ictx_string_from_sv(sv_from_parts(six, n))));
+		munit_assert_size(rope_length(made), ==, n);
+		munit_assert_size(rope_length(viewed), ==, n);
+	}
+	// a view isn't a copy, the collection stamps what it points into
+	uint32_t owner = 0;
+	stack_node v = ictx_string_view(sv_from_cstr(buf + 1), &owner);
+	munit_assert_true(sn_string(&v).data == buf + 1);
+	munit_assert_true(ictx_string_eq(v, ictx_string_new(SV("ello world"))));
+
+	interpreter_ctx ictx = ictx_new_sized(10);
+	ictx.stack[++ictx.stack_top] = h;
+	ictx.stack[++ictx.stack_top] = rope_concat(ictx_string_new(SV("in a rope")), h);
+	ictx.stack[++ictx.stack_top] = v;
+	ictx_collect(&ictx);
+	munit_assert_true(sv_eq(sn_string(&h), SV("hello world")));
+	munit_assert_true(sv_eq(sn_string(&ictx.stack[1]), SV("in a ropehello world")));
+	munit_assert_true(hs_stamped(owner));
+
+	// every context that has run is a root, not just the one collecting
+	interpreter_ctx other = ictx_new_sized(10);
+	stack_node kept = ictx_string_new(SV("only the other stack has this"));
+	other.stack[++other.stack_top] = kept;
+	ictx_enter(&other);
+	ictx_collect(&ictx);
+	munit_assert_true(hs_stamped(sn_heapstr(kept)->mark));
+	munit_assert_true(hs_stamped(sn_heapstr(h)->mark));
+	ictx_free(&ictx);
+
+	// a collection forced at the first safe point, on every engine, keeps what the program
+	// and the other context still hold
+	tokenizer_ctx tctx = tctx_from_cstr("\"abc\" \"defgh\" + ; len");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	interp_builtin_link(program);
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		ictx = ictx_new_sized(10);
+		hs_due = true;
+		run_with(&ictx, program, *engine);
+		munit_assert_false(hs_due);
+		munit_assert_int(ictx.stack_top, ==, 1);
+		munit_assert_true(sv_eq(sn_string(&ictx.stack[0]), SV("abcdefgh")));
+		munit_assert_int(sn_int(ictx.stack[1]), ==, 8);
+		munit_assert_true(sv_eq(sn_string(&kept), SV("only the other stack has this")));
+		ictx_free(&ictx);
+	}
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	ictx_free(&other);
+	hs_free();
+	rope_free();
+	return MUNIT_OK;
+}
+
+// Runs fn in a child and returns how it ended
+static int in_child(void (*fn)(void)) {
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		freopen("/dev/null", "w", stderr);
+		fn();
+		_exit(0);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	return status;
+}
+
+static void push_forever(void) {
+	interpreter_ctx ictx = ictx_new_sized(10);
+	for (int i = 0;; i++) ictx.stack[++ictx.stack_top] = sn_from_int(i);
+}
+
+static void pop_empty(void) {
+	interpreter_ctx ictx = ictx_new_sized(10);
+	ictx.stack[++ictx.stack_top] = sn_from_int(1);
+	ictx.stack_top -= 2;
+	volatile stack_node* stack = ictx.stack;
+	ictx.stack[0] = stack[ictx.stack_top + 1];
+}
+
+static void wild_pointer(void) {
+	interpreter_ctx ictx = ictx_new_sized(10);
+	*(volatile int*) (uintptr_t) 16 = ictx.stack_top;
+}
+
+MunitResult string_pool(const MunitParameter params[], void* fixture) {
+	tokenizer_ctx tctx = tctx_from_cstr("\"hello world\" \"hello world\" == \"hello world\" \"hello worlD\" ==");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	munit_assert_size(cvector_size(program.p), ==, 2);
+
+	// equal literals share one entry, stored without the quotes
+	Expression* same = program.p[0].stmtExpr.expr;
+	munit_assert_int(same->type, ==, EXPRESSION_TYPE_EEO);
+	const strpool_entry* e = same->EEO.left->ETerm.term._string;
+	munit_assert_ptr_equal(e, same->EEO.right->ETerm.term._string);
+	munit_assert_true(sv_eq(STRPOOL_SV(e), SV("hello world")));
+	munit_assert_size(e->length, ==, 11);
+	munit_assert_char(e->data[e->length], ==, 0);
+	munit_assert_uint64(e->hash, ==, strpool_hash("hello world", 11));
+	munit_assert_ptr_equal(strpool_intern(SV("hello world")), e);
+	munit_assert_ptr_equal(strpool_find(SV("hello world"), e->hash), e);
+	Expression* other = program.p[1].stmtExpr.expr;
+	munit_assert_ptr_equal(other->EEO.left->ETerm.term._string, e);
+	munit_assert_ptr_not_equal(other->EEO.right->ETerm.term._string, e);
+
+	// so == on them is decided by the entries alone
+	interpreter_ctx ictx = ictx_new();
+	ictx_run(&ictx, program);
+	munit_assert_int(ictx.stack_top, ==, 1);
+	munit_assert_int(sn_int(ictx.stack[0]), ==, 1);
+	munit_assert_int(sn_int(ictx.stack[1]), ==, 0);
+	ictx_free(&ictx);
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	return MUNIT_OK;
+}
+
+MunitResult stack_guards(const MunitParameter params[], void* fixture) {
+	// rounded up to a page, and usable right to the end
+	interpreter_ctx ictx = ictx_new_sized(10);
+	munit_assert_size(ictx.stack_size, >=, 10);
+	for (size_t i = 0; i < ictx.stack_size; i++) ictx.stack[++ictx.stack_top] = sn_from_int(i);
+	munit_assert_int(sn_int(ictx.stack[ictx.stack_top]), ==, ictx.stack_size - 1);
+	ictx_free(&ictx);
+
+	// running off either end is a clean error, anything else still crashes
+	int status = in_child(push_forever);
+	munit_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 90);
+	status = in_child(pop_empty);
+	munit_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 90);
+	status = in_child(wild_pointer);
+	munit_assert_true(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+
+	// a run of 700 pops lands well past the guard page, every engine checks the run as a whole
+	FILE* f = fopen("/tmp/spaz_long_pop.lang", "w");
+	fputs("1 2 ", f);
+	for (int i = 0; i < 700; i++) fputc('.', f);
+	fputs(" 7 println\n", f);
+	fclose(f);
+	const char* engines[] = {"ast", "vm", "closure", "jit"};
+	for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+		if (strcmp(engines[i], "jit") == 0 && !jit_supported()) continue;
+		status = run_example("/tmp/spaz_long_pop.lang", engines[i], "/dev/null", "/dev/null");
+		munit_assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 90);
+	}
+	remove("/tmp/spaz_long_pop.lang");
+	return MUNIT_OK;
+}
+
+MunitResult constant_folding(const MunitParameter params[], void* fixture) {
+	tokenizer_ctx tctx = tctx_from_cstr("2 3 + 4 * 1.5 1 * if 1 { 7 } if 0 { 8 } 1 0 / 0 +");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	opt_stats stats = opt_fold_program(&program);
+	munit_assert_size(stats.folded, ==, 3);
+	munit_assert_size(stats.simplified, ==, 1);
+	munit_assert_size(stats.ifs, ==, 2);
+
+	// 20, 1.5, 7 from the if that always runs, the 0 the other one leaves, and the division that traps
+	munit_assert_size(cvector_size(program.p), ==, 5);
+	Expression* e[5];
+	for (int i = 0; i < 5; i++) {
+		munit_assert_int(program.p[i].stmtExpr.type, ==, STATEMENT_EXPR_TYPE_EXPRESSION);
+		e[i] = program.p[i].stmtExpr.expr;
+	}
+	munit_assert_int(e[0]->ETerm.term._integer, ==, 20);
+	munit_assert_double(e[1]->ETerm.term._double, ==, 1.5);
+	munit_assert_int(e[2]->ETerm.term._integer, ==, 7);
+	munit_assert_int(e[3]->ETerm.term._integer, ==, 0);
+	munit_assert_int(e[4]->type, ==, EXPRESSION_TYPE_EEO);
+	munit_assert_int(e[4]->EEO.operation.code, ==, OPERATOR_CODE_DIV);
+
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	return MUNIT_OK;
+}
+
+MunitResult stack_op_runs(const MunitParameter params[], void* fixture) {
+	tokenizer_ctx tctx = tctx_from_cstr("1 2 ;;; .. 3 ; print . 4 print .");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	interp_builtin_link(program);
+
+	// ';;;' then '..' is one DUP, '; print .' is a plain print, 'print .' is one instruction
+	bytecode bc = bc_compile_program(program);
+	const bc_op expect[] = {BC_PUSH_INT, BC_PUSH_INT, BC_DUP, BC_PUSH_INT, BC_CALL, BC_PUSH_INT, BC_CALL_POP};
+	munit_assert_size(cvector_size(bc.code), ==, 7 * 5);
+	for (int i = 0; i < 7; i++) {
+		munit_assert_int(bc.code[i * 5], ==, expect[i]);
+	}
+
+	// runs are counted on every engine, what print writes doesn't matter here
+	fflush(stdout);
+	int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+	dup2(null, STDOUT_FILENO);
+	for (int engine = 0; engine < 3; engine++) {
+		interpreter_ctx ictx = ictx_new();
+		if (engine == 0) {
+			ictx_run(&ictx, program);
+		}
+		else if (engine == 1) {
+			vm_run(&ictx, &bc);
+		}
+		else {
+			closure_program cp = cl_compile_program(program);
+			cl_run(&ictx, &cp);
+			cl_free(&cp);
+		}
+		munit_assert_int(ictx.stack_top, ==, 3);
+		munit_assert_int(sn_int(ictx.stack[2]), ==, 2);
+		munit_assert_int(sn_int(ictx.stack[3]), ==, 3);
+		ictx_free(&ictx);
+	}
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+	close(null);
+	bc_free(&bc);
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+
+	// a run of n commas copies the value n - 1 below the top, a single one is free
+	tctx = tctx_from_cstr("7 8 9 ,,, , ,,");
+	pctx = pctx_new(100);
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	program = (Program) {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	bc = bc_compile_program(program);
+	munit_assert_size(cvector_size(bc.code), ==, 5 * 5);
+	munit_assert_int(bc.code[3 * 5], ==, BC_PEEK);
+	munit_assert_int(bc.code[4 * 5], ==, BC_PEEK);
+	const int peeked[] = {7, 8, 9, 7, 9};
+	for (int engine = 0; engine < 3; engine++) {
+		interpreter_ctx ictx = ictx_new();
+		if (engine == 0) {
+			ictx_run(&ictx, program);
+		}
+		else if (engine == 1) {
+			vm_run(&ictx, &bc);
+		}
+		else {
+			closure_program cp = cl_compile_program(program);
+			cl_run(&ictx, &cp);
+			cl_free(&cp);
+		}
+		munit_assert_int(ictx.stack_top, ==, 4);
+		for (int i = 0; i < 5; i++) munit_assert_int(sn_int(ictx.stack[i]), ==, peeked[i]);
+		ictx_free(&ictx);
+	}
+	bc_free(&bc);
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	return MUNIT_OK;
+}
+
+static vfy_result verify_source(const char* src) {
+	tokenizer_ctx tctx = tctx_from_cstr(src);
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	interp_builtin_link(program);
+	vfy_result v = vfy_program(program);
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	return v;
+}
+
+MunitResult stack_effects(const MunitParameter params[], void* fixture) {
+	vfy_result v = verify_source("1 2 ;; 3 + println ..");
+	munit_assert_true(v.ok);
+	munit_assert_int(v.max_depth, ==, 5);
+
+	v = verify_source("1 println ..");
+	munit_assert_false(v.ok);
+	munit_assert_int(v.need, ==, 2);
+	munit_assert_int(v.have, ==, 1);
+
+	// the block may or may not run, so afterwards there are 1 to 3 values
+	v = verify_source("7 input if , 5 == { 1 2 } ..");
+	munit_assert_true(v.ok);
+	munit_assert_false(v.may_underflow);
+	// only the path through the block has three, the program runs with its checks
+	v = verify_source("\"\" . input if , { 1 1 1 } ...");
+	munit_assert_true(v.ok);
+	munit_assert_true(v.may_underflow);
+	v = verify_source("7 input if , 5 == { 1 2 } ....");
+	munit_assert_false(v.ok);
+	munit_assert_int(v.have, ==, 3);
+
+	// a peek needs the value it copies
+	v = verify_source("1 2 ,, + println ..");
+	munit_assert_true(v.ok);
+	munit_assert_int(v.max_depth, ==, 3);
+	v = verify_source("1 2 ,,,");
+	munit_assert_false(v.ok);
+	munit_assert_int(v.need, ==, 3);
+
+	// nothing after exit runs
+	v = verify_source("0 exit ...");
+	munit_assert_true(v.ok);
+	v = verify_source("0 exit nothing_named_this");
+	munit_assert_true(v.ok);
+
+	// a call that reaches a name nothing has is rejected, not just warned about
+	v = verify_source("1 nothing_named_this println");
+	munit_assert_false(v.ok);
+	munit_assert_size(v.unknown.count, ==, strlen("nothing_named_this"));
+	v = verify_source("\"\" . input if , { nothing_named_this }");
+	munit_assert_false(v.ok);
+	return MUNIT_OK;
+}
+
+MunitResult typed_opcodes(const MunitParameter params[], void* fixture) {
+	tokenizer_ctx tctx = tctx_from_cstr("1 2 + 3 * 1.5 2.5 * < input 1 +");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	interp_builtin_link(program);
+
+	// ints, doubles, an int against a double, then whatever input gave
+	bytecode bc = bc_compile_program(program);
+	bc_op ops[16];
+	int count = 0;
+	for (size_t pc = 0; pc < cvector_size(bc.code); count++) {
+		ops[count] = bc.code[pc];
+		pc += ops[count] < BC_ADD || ops[count] > BC_EQ_D ? 5 : 1;
+	}
+	const bc_op expect[] = {
+		BC_PUSH_INT, BC_PUSH_INT, BC_ADD_I, BC_PUSH_INT, BC_MUL_I,
+		BC_PUSH_DOUBLE, BC_PUSH_DOUBLE, BC_MUL_D, BC_LT,
+		BC_CALL, BC_PUSH_INT, BC_ADD,
+	};
+	munit_assert_int(count, ==, sizeof(expect) / sizeof(expect[0]));
+	for (int i = 0; i < count; i++) {
+		munit_assert_int(ops[i], ==, expect[i]);
+	}
+	bc_free(&bc);
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	return MUNIT_OK;
+}
+
+// A straight-line program that never underflows or divides by zero
+static void random_program(FILE* f) {
+	// the logic operators are only defined for ints, keep them rare so most programs run to the end
+	static const char* ops[] = {"+", "-", "*", "+", "-", "*", ">", "<", "==", "&&", "||"};
+	int depth = 0;
+	for (int i = 0; i < 40; i++) {
+		int pick = munit_rand_int_range(0, 9);
+		if (depth < 2 || pick < 3) {
+			if (munit_rand_int_range(0, 3) == 0)
+				fprintf(f, "%d.%d ", munit_rand_int_range(0, 99), munit_rand_int_range(0, 9));
+			else
+				fprintf(f, "%d ", munit_rand_int_range(0, 999));
+			depth++;
+		}
+		else if (pick < 7) {
+			fprintf(f, "%s ", ops[munit_rand_int_range(0, 10)]);
+			depth--;
+		}
+		else if (pick == 7) {
+			fprintf(f, "%d %s ", munit_rand_int_range(1, 9), munit_rand_int_range(0, 1) ? "/" : "%");
+		}
+		else if (pick == 8) {
+			// a dup, or a peek no deeper than the stack
+			int n = munit_rand_int_range(1, depth < 4 ? depth : 4);
+			fprintf(f, "%.*s ", n, n == 1 ? ";" : ",,,");
+			depth++;
+		}
+		else {
+			fprintf(f, "println . ");
+			depth--;
+		}
+	}
+	fprintf(f, "showstack\n");
+}
+
+MunitResult jit_differential(const MunitParameter params[], void* fixture) {
+	if (!jit_supported()) return MUNIT_SKIP;
+	char src_path[] = "/tmp/spaz_srcXXXXXX", in_path[] = "/tmp/spaz_inXXXXXX";
+	char ast_path[] = "/tmp/spaz_astXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(src_path));
+	close(mkstemp(in_path));
+	close(mkstemp(ast_path));
+	close(mkstemp(out_path));
+	for (int i = 0; i < 30; i++) {
+		FILE* f = fopen(src_path, "w");
+		random_program(f);
+		fclose(f);
+		int ast_status = run_example(src_path, "ast", in_path, ast_path);
+		int status = run_example(src_path, "jit", in_path, out_path);
+		char* ast_out = read_all(ast_path);
+		char* out = read_all(out_path);
+		munit_assert_int(status, ==, ast_status);
+		munit_assert_string_equal(out, ast_out);
+		free(ast_out);
+		free(out);
+	}
+	unlink(src_path);
+	unlink(in_path);
+	unlink(ast_path);
+	unlink(out_path);
+	return MUNIT_OK;
+}
+
+MunitResult emit_c(const MunitParameter params[], void* fixture) {
+	tokenizer_ctx tctx = tctx_from_cstr("\"a\tb\" println . 1 input if , 1 == { \"a\tb\" 2.5 } .. nope");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	interp_builtin_link(program);
+
+	char* text = NULL;
+	size_t size = 0;
+	FILE* f = open_memstream(&text, &size);
+	emitc_program(f, program, 4, true);
+	fclose(f);
+	// the literal is interned once and used twice, the block is a C if
+	munit_assert_not_null(strstr(text, "rt_start(4, true);"));
+	munit_assert_not_null(strstr(text, "strings[0] = rt_string(\"a\\011b\", 3);"));
+	munit_assert_null(strstr(text, "strings[1] ="));
+	munit_assert_not_null(strstr(text, "if (rt_branch(ictx)) {\n\t\trt_push(ictx, strings[0]);"));
+	munit_assert_not_null(strstr(text, "sn_from_double(0x1.4p+1)"));
+	munit_assert_not_null(strstr(text, "rt_pop(ictx, 2);"));
+	munit_assert_not_null(strstr(text, "rt_bad_call(\"nope\");"));
+	free(text);
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+	return MUNIT_OK;
+}
+
+MunitResult streaming(const MunitParameter params[], void* fixture) {
+	// taking statements as they complete runs the same program as parsing all of it first:
+	// operator chains longer than the lookbehind, procedures, blocks inside blocks
+	char src_path[] = "/tmp/spaz_srcXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(out_path));
+	int fd = mkstemp(src_path);
+	const char* src =
+		"\"\" . 1 2 3 + + println . 2 3 4 * + 1 - println .\n"
+		"sq { ; * } cube { ; sq * }\n"
+		"3 sq println . 2 cube println .\n"
+		"1 if , { 2 if , { \"in\" println . } \"out\" println . }\n"
+		"0 while ; 3 < { 1 + ; println . } . \"end\" println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+
+	for (const char** engine = (const char*[]) {"ast", "ast-stream", "vm-stream", "closure-stream", jit_supported() ? "jit-stream" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, "/dev/null", out_path);
+		char* out = read_all(out_path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 0);
+		munit_assert_string_equal(out, "6\n13\n9\n8\nin\nout\n1\n2\n3\nend\n");
+		free(out);
+	}
+	unlink(src_path);
+	unlink(out_path);
+	return MUNIT_OK;
+}
+
+MunitResult procedures(const MunitParameter params[], void* fixture) {
+	// a tail call reuses the caller's frame, so down can go far deeper than the return stack;
+	// nt's call isn't in tail position and overflows it
+	char src_path[] = "/tmp/spaz_srcXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(out_path));
+	int fd = mkstemp(src_path);
+	const char* src =
+		"sq { ; * }\n"
+		"down { 1 - if ; { down } }\n"
+		"nt { 1 - if ; { nt 0 + } }\n"
+		"5 sq println . 3 twice println .\n"
+		"twice { sq sq }\n"
+		"50000 down println . 100 nt println .\n"
+		"5000 nt\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", "vm-O1", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, "/dev/null", out_path);
+		char* out = read_all(out_path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 90);
+		munit_assert_string_equal(out, "25\n81\n0\n0\n");
+		free(out);
+	}
+	unlink(src_path);
+	unlink(out_path);
+
+	// recursion hides how deep the stack goes, a call that doesn't recurse is walked like inline code
+	vfy_result v = verify_source("down { 1 - if ; { down } } 5 down");
+	munit_assert_true(v.ok);
+	munit_assert_false(v.bounded);
+	v = verify_source("sq { ; * } 1 2 sq sq +");
+	munit_assert_true(v.ok);
+	munit_assert_true(v.bounded);
+	munit_assert_int(v.max_depth, ==, 3);
+	v = verify_source("drop2 { .. } 1 drop2");
+	munit_assert_false(v.ok);
+	return MUNIT_OK;
+}
+
+MunitResult loops(const MunitParameter params[], void* fixture) {
+	char src_path[] = "/tmp/spaz_srcXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(out_path));
+	int fd = mkstemp(src_path);
+	const char* src =
+		"sum { 0 while ; 10 < { ; , 1 + } . }\n"
+		"3 while ; { ; println 1 - } .\n"
+		"sum println .\n"
+		"1 2 3 while ; 1 > { . } . 0 + println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", "vm-O1", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, "/dev/null", out_path);
+		char* out = read_all(out_path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 0);
+		munit_assert_string_equal(out, "3\n2\n1\n10\n1\n");
+		free(out);
+	}
+	unlink(src_path);
+	unlink(out_path);
+
+	// the counts live in the While nodes, hottest first and each where its while starts
+	tokenizer_ctx tctx = tctx_from_cstr("7 while ; { 1 - } .\n2 while ; { 1 - } .");
+	parse_ctx pctx = pctx_new(100);
+	token tok;
+	while ((tok = tctx_get_next(&tctx)).type != T_EOF) {
+		tctx_advance(&tctx);
+		pctx_consume_token(&pctx, tok);
+	}
+	Program program = {0};
+	for (int i = 0; i <= pctx.pstack.top; i++) cvector_push_back(program.p, pctx.pstack.data[i]);
+	interp_builtin_link(program);
+	interpreter_ctx ictx = ictx_new();
+	bytecode bc = bc_compile_program(program);
+	vm_run(&ictx, &bc);
+	prof_report profile = {0};
+	prof_collect(&profile, program);
+	munit_assert_int(cvector_size(profile.loops), ==, 2);
+	munit_assert_int(profile.loops[0].iterations, ==, 7);
+	munit_assert_int(profile.loops[0].state.line, ==, 0);
+	munit_assert_int(profile.loops[1].iterations, ==, 2);
+	munit_assert_int(profile.loops[1].state.line, ==, 1);
+	prof_free(&profile);
+	bc_free(&bc);
+	ictx_free(&ictx);
+	ast_free_program(program);
+	pctx_free(&pctx);
+	tctx_free(&tctx);
+
+	// a loop that keeps its depth has a fixed point, one that grows doesn't
+	vfy_result v = verify_source("5 while ; { 1 - } .");
+	munit_assert_true(v.ok);
+	munit_assert_true(v.bounded);
+	v = verify_source("5 while ; 0 > { 1 - 7 }");
+	munit_assert_true(v.ok);
+	munit_assert_false(v.bounded);
+	return MUNIT_OK;
+}
+
+MunitResult switch_dispatch(const MunitParameter params[], void* fixture) {
+	char src_path[] = "/tmp/spaz_srcXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(out_path));
+	int fd = mkstemp(src_path);
+	const char* src =
+		"name { switch , { 1: { \"one\" } 2: { \"two\" } 100: { \"hundred\" } default: { \"many\" } } }\n"
+		"3 name println . 100 name println . 1 name println .\n"
+		"\"-\" switch , { \"+\": { 5 3 + } \"-\": { 5 3 - } } , println .\n"
+		"'b' switch , { 'a': { 1 } 'b': { 2 } } , println .\n"
+		"7 switch , { 7000000: { 1 } } 0 println .\n"
+		// the short form, a literal and the one expression it runs, and a default with nothing
+		"\"-\" switch , { \"+\" 8 \"-\" 2 default: } println .\n"
+		"9 switch , { 1 2 default: } 0 println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", "vm-O1", "ast-stream", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, "/dev/null", out_path);
+		char* out = read_all(out_path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 0);
+		munit_assert_string_equal(out, "many\nhundred\none\n2\n2\n0\n2\n0\n");
+		free(out);
+	}
+	unlink(src_path);
+
+	// ex/main.lang switches on the operator it reads, one it has no case for leaves the second number
+	const char* runs[][2] = {{"5\n3\n*\n", "15"}, {"5\n3\n-\n", "2"}, {"5\n3\n%\n", "3"}};
+	char in_path[] = "/tmp/spaz_inXXXXXX";
+	int in_fd = mkstemp(in_path);
+	for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+		munit_assert_int(ftruncate(in_fd, 0), ==, 0);
+		munit_assert_int(pwrite(in_fd, runs[i][0], strlen(runs[i][0]), 0), ==, strlen(runs[i][0]));
+		char want[256];
+		snprintf(want, sizeof(want), "6.0350390Hello WorldEnter a number : Enter a second number : Enter an operator to use : %s", runs[i][1]);
+		for (const char** engine = (const char*[]) {"ast", "vm", "closure", "ast-stream", "vm-stream", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+			int status = run_example("ex/main.lang", *engine, in_path, out_path);
+			char* out = read_all(out_path);
+			munit_assert_true(WIFEXITED(status));
+			munit_assert_int(WEXITSTATUS(status), ==, 0);
+			munit_assert_string_equal(out, want);
+			free(out);
+		}
+	}
+	close(in_fd);
+	unlink(in_path);
+	unlink(out_path);
+
+	// close ints get a table, spread out ones are hashed like strings, with one probe each
+	sw_table* t = sw_build((sw_case[]) {{sn_from_int(3)}, {sn_from_int(5)}, {.is_default = true}, {sn_from_int(3)}}, 4);
+	munit_assert_int(t->int_span, ==, 3);
+	munit_assert_int(sw_lookup(t, sn_from_int(3)), ==, 0);
+	munit_assert_int(sw_lookup(t, sn_from_int(5)), ==, 1);
+	munit_assert_int(sw_lookup(t, sn_from_int(4)), ==, 2);
+	munit_assert_int(sw_lookup(t, sn_from_double(3.0)), ==, 2);
+	sw_free(t);
+
+	sw_case cases[64];
+	for (int i = 0; i < 32; i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "case%d", i);
+		cases[i] = (sw_case) {ictx_string_from_sv(sv_from_cstr(name))};
+		cases[32 + i] = (sw_case) {sn_from_int(i * 1000003)};
+	}
+	t = sw_build(cases, 64);
+	munit_assert_int(t->int_span, ==, 0);
+	munit_assert_int(t->probes, ==, 1);
+	for (int i = 0; i < 64; i++) {
+		munit_assert_int(sw_lookup(t, cases[i].value), ==, i);
+	}
+	munit_assert_int(sw_lookup(t, ictx_string_from_sv(sv_from_cstr("case32"))), ==, -1);
+	munit_assert_int(sw_lookup(t, sn_from_int(1)), ==, -1);
+	sw_free(t);
+
+	// one case runs, or none without a default
+	vfy_result v = verify_source("1 switch , { 1: { 2 3 } 2: { 4 } }");
+	munit_assert_true(v.ok);
+	munit_assert_int(v.max_depth, ==, 2);
+	v = verify_source("1 switch , { 1: { 2 } } .");
+	munit_assert_true(v.ok);
+	v = verify_source("1 switch , { 1: { 2 } default: { } } .");
+	munit_assert_true(v.ok);
+	v = verify_source("1 switch , { default: { } } .");
+	munit_assert_false(v.ok);
+	return MUNIT_OK;
+}
+
+MunitResult string_concat(const MunitParameter params[], void* fixture) {
+	char src_path[] = "/tmp/spaz_srcXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(out_path));
+	int fd = mkstemp(src_path);
+	const char* src =
+		"\"ab\" \"cd\" + println .\n"
+		"\"hello \" \"world\" + ; println . \"hello world\" == println .\n"
+		"\"\" while ; \"xxxxxxxxxx\" == 0 == { \"x\" + } . println .\n"
+		"\"ab\" \"cdefg\" + switch , { \"abcdefg\": { 1 } default: { 2 } } , println .\n"
+		// either side of the five bytes that fit inline
+		"\"abcd\" \"e\" + len println . \"abcde\" \"f\" + ; len println . \"abcdef\" == println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", "vm-O1", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, "/dev/null", out_path);
+		char* out = read_all(out_path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 0);
+		munit_assert_string_equal(out, "abcd\nhello world\n1\nxxxxxxxxxx\n1\n5\n6\n1\n");
+		free(out);
+	}
+	unlink(src_path);
+	unlink(out_path);
+
+	// short results go inline, long ones stay ropes until their bytes are needed
+	stack_node ab = rope_concat(ictx_string_from_sv(SV("a")), ictx_string_from_sv(SV("b")));
+	munit_assert_true(ab.bits & SN_STRING_INLINE);
+	munit_assert_true(ictx_string_eq(ab, ictx_string_from_sv(SV("ab"))));
+
+	// appending in a loop, the rope as deep as the loop ran
+	stack_node s = ictx_string_from_sv(SV(""));
+	for (int i = 0; i < 100000; i++) {
+		s = rope_concat(s, ictx_string_from_sv(SV("xy")));
+	}
+	munit_assert_true(sn_is_rope(s));
+	munit_assert_false(sn_rope(s)->flat.bits);
+	munit_assert_int(rope_length(s), ==, 200000);
+	String_View flat = sn_string(&s);
+	munit_assert_int(flat.count, ==, 200000);
+	munit_assert_true(sv_eq(sv_from_parts(flat.data + 199998, 2), SV("xy")));
+	munit_assert_true(sn_rope(s)->flat.bits);
+	// the bytes are a heap string and the halves are let go, the next collection frees
+	// every node under it and keeps the rest while the stack holds it
+	munit_assert_true(sn_is_heapstr(sn_rope(s)->flat));
+	munit_assert_true(sn_rope(s)->left.bits == SN_UNDEFINED.bits);
+	interpreter_ctx ictx = ictx_new_sized(10);
+	ictx.stack[++ictx.stack_top] = s;
+	ictx_collect(&ictx);
+	flat = sn_string(&s);
+	munit_assert_int(flat.count, ==, 200000);
+	munit_assert_true(sv_eq(sv_from_parts(flat.data, 2), SV("xy")));
+	ictx_free(&ictx);
+
+	// a rope equals the interned string with the same bytes, and one of another length
+	// doesn't need flattening to tell
+	stack_node hw = rope_concat(ictx_string_from_sv(SV("hello ")), ictx_string_from_sv(SV("world")));
+	munit_assert_false(ictx_string_eq(hw, ictx_string_from_sv(SV("hello"))));
+	munit_assert_false(sn_rope(hw)->flat.bits);
+	munit_assert_true(ictx_string_eq(hw, ictx_string_from_sv(SV("hello world"))));
+	rope_free();
+	hs_free();
+	return MUNIT_OK;
+}
+
+static size_t file_size(int fd) {
+	return lseek(fd, 0, SEEK_END);
+}
+
+MunitResult buffered_output(const MunitParameter params[], void* fixture) {
+	char path[] = "/tmp/spaz_outXXXXXX";
+	int fd = mkstemp(path);
+
+	// nothing reaches the fd until the buffer is flushed or full
+	output_buf* ob = ob_new(fd, 16);
+	ob_int(ob, INT_MIN);
+	ob_char(ob, ' ');
+	ob_newline(ob);
+	munit_assert_size(file_size(fd), ==, 0);
+	ob_write(ob, SV("abcd"));
+	munit_assert_size(file_size(fd), ==, 13);
+	// one too big to buffer goes out right after what was buffered
+	ob_write(ob, SV("0123456789abcdef0123"));
+	munit_assert_size(file_size(fd), ==, 37);
+	ob_double(ob, "%0.4f", 2.5);
+	ob_flush(ob);
+	munit_assert_size(file_size(fd), ==, 43);
+	ob_resize(ob, 0);
+	ob_char(ob, '!');
+	munit_assert_size(file_size(fd), ==, 44);
+	ob_free(ob);
+	close(fd);
+	char* out = read_all(path);
+	munit_assert_string_equal(out, "-2147483648 \nabcd0123456789abcdef01232.5000!");
+	free(out);
+
+	// exit and errors still get out what was printed before them, in order
+	char src_path[] = "/tmp/spaz_srcXXXXXX";
+	fd = mkstemp(src_path);
+	const char* src = "1 println . \"two\" println . 3 showstack exit 4 println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, "/dev/null", path);
+		out = read_all(path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 100);
+		munit_assert_string_equal(out, "1\ntwo\n0: INTEGER: 3\n");
+		free(out);
+	}
+	unlink(src_path);
+	unlink(path);
+	return MUNIT_OK;
+}
+
+MunitResult buffered_input(const MunitParameter params[], void* fixture) {
+	char in_path[] = "/tmp/spaz_inXXXXXX";
+	int fd = mkstemp(in_path);
+	char line[1000];
+	memset(line, 'x', sizeof(line));
+	munit_assert_int(write(fd, "hi\n\n", 4), ==, 4);
+	munit_assert_int(write(fd, line, sizeof(line)), ==, sizeof(line));
+	munit_assert_int(write(fd, "\n12\nlast", 8), ==, 8);
+
+	// chunks far smaller than a line grow to fit it, the last line needs no newline.
+	// Lines handed out stay where they are while the rest is read
+	lseek(fd, 0, SEEK_SET);
+	input_buf* in = in_new(fd, 4);
+	String_View sv, hi;
+	munit_assert_true(in_line(in, &hi) && sv_eq(hi, SV("hi")));
+	munit_assert_true(in_line(in, &sv) && sv.count == 0);
+	munit_assert_true(in_line(in, &sv) && sv_eq(sv, sv_from_parts(line, sizeof(line))));
+	munit_assert_true(in_line(in, &sv) && sv_eq(sv, SV("12")));
+	munit_assert_true(in_line(in, &sv) && sv_eq(sv, SV("last")));
+	munit_assert_false(in_line(in, &sv));
+	munit_assert_int(in_all(in).count, ==, 0);
+	munit_assert_true(sv_eq(hi, SV("hi")));
+	in_close(in);
+
+	// readall after a line is everything after it
+	lseek(fd, 0, SEEK_SET);
+	in = in_new(fd, 4);
+	munit_assert_true(in_line(in, &hi) && sv_eq(hi, SV("hi")));
+	sv = in_all(in);
+	munit_assert_int(sv.count, ==, 1 + sizeof(line) + 8);
+	munit_assert_true(sv_eq(sv_from_parts(sv.data + sv.count - 4, 4), SV("last")));
+	munit_assert_true(sv_eq(hi, SV("hi")));
+	in_close(in);
+	close(fd);
+
+	// input keeps long lines whole, every engine
+	char src_path[] = "/tmp/spaz_srcXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(out_path));
+	fd = mkstemp(src_path);
+	const char* src = "\"\" . input println . input println . readall println . input println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+	char expect[1100];
+	snprintf(expect, sizeof(expect), "hi\n0\n%.*s\n12\nlast\n0\n", (int) sizeof(line), line);
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, in_path, out_path);
+		char* out = read_all(out_path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 0);
+		munit_assert_string_equal(out, expect);
+		free(out);
+	}
+	unlink(src_path);
+	unlink(out_path);
+	unlink(in_path);
+	return MUNIT_OK;
+}
+
+MunitResult typed_arrays(const MunitParameter params[], void* fixture) {
+	char src_path[] = "/tmp/spaz_srcXXXXXX", out_path[] = "/tmp/spaz_outXXXXXX";
+	close(mkstemp(out_path));
+	int fd = mkstemp(src_path);
+	const char* src =
+		"\"\" . 4 0 array 0 1 set 1 2 set 2 3 set 3 4 set ; println . ; sum println . ; len println .\n"
+		"; min println . ; max println . ; 2 get println . ; ; dot println . .\n"
+		"3 0.5 array 1 2 set ; sum println . ; ; dot println . .\n"
+		"3 2000000000 array sum println . \"hello world\" len println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+	for (const char** engine = (const char*[]) {"ast", "vm", "closure", "vm-O1", jit_supported() ? "jit" : NULL, NULL}; *engine; engine++) {
+		int status = run_example(src_path, *engine, "/dev/null", out_path);
+		char* out = read_all(out_path);
+		munit_assert_true(WIFEXITED(status));
+		munit_assert_int(WEXITSTATUS(status), ==, 0);
+		munit_assert_string_equal(out, "[1, 2, 3, 4]\n10\n4\n1\n4\n3\n30\n3.0000\n4.5000\n6000000000.0000\n11\n");
+		free(out);
+	}
+
+	// indexing past the end is an error, not a read
+	fd = open(src_path, O_WRONLY | O_TRUNC);
+	src = "\"\" . 4 0 array 4 get println .\n";
+	munit_assert_int(write(fd, src, strlen(src)), ==, strlen(src));
+	close(fd);
+	int status = run_example(src_path, "vm", "/dev/null", out_path);
+	munit_assert_int(WEXITSTATUS(status), ==, 90);
+	unlink(src_path);
+	unlink(out_path);
+
+	// AVX2 and the scalar loops give the same bits, every length around the lane counts
+	bool simd = arr_simd();
+	for (size_t n = 0; n < 40; n++) {
+		stack_node iv = arr_new(n, sn_from_int(0)), dv = arr_new(n, sn_from_double(0.0));
+		array *ia = sn_array(iv), *da = sn_array(dv);
+		for (size_t i = 0; i < n; i++) {
+			ia->ints[i] = munit_rand_int_range(INT_MIN / 2, INT_MAX / 2);
+			da->doubles[i] = munit_rand_double() * 1e6 - 5e5;
+		}
+		stack_node r[2][6];
+		for (int pass = 0; pass < 2; pass++) {
+			arr_use_simd(pass == 0);
+			r[pass][0] = arr_sum(ia);
+			r[pass][1] = arr_dot(ia, ia);
+			r[pass][2] = arr_sum(da);
+			r[pass][3] = arr_dot(da, da);
+			if (n == 0) {
+				munit_assert_false(arr_min(ia, &r[pass][4]));
+				r[pass][4] = r[pass][5] = SN_UNDEFINED;
+				continue;
+			}
+			arr_min(da, &r[pass][4]);
+			arr_max(ia, &r[pass][5]);
+		}
+		for (int k = 0; k < 6; k++) munit_assert_uint64(r[0][k].bits, ==, r[1][k].bits);
+		int64_t sum = 0;
+		int32_t max = n ? ia->ints[0] : 0;
+		for (size_t i = 0; i < n; i++) {
+			sum += ia->ints[i];
+			if (ia->ints[i] > max) max = ia->ints[i];
+		}
+		munit_assert_double(sn_is_int(r[0][0]) ? sn_int(r[0][0]) : sn_double(r[0][0]), ==, (double) sum);
+		if (n) munit_assert_int(sn_int(r[0][5]), ==, max);
+	}
+	arr_use_simd(simd);
+	arr_free();
+	return MUNIT_OK;
+}